@@ -5,7 +5,7 @@ target("shaders")
     add_files("**.slang")
     
     -- Make shaders visible in Visual Studio
-    add_headerfiles("**.slang")
+    add_headerfiles("**.slang", "**.slangh")
     
     -- Custom build rule for shader compilation
     add_rules("shader_compile")
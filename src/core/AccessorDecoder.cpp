@@ -0,0 +1,175 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "AccessorDecoder.h"
+
+namespace CV
+{
+	namespace
+	{
+		// pointer to the first element, or null if the accessor can't be read directly
+		const u8* GetAccessorData(const cgltf_accessor* accessor)
+		{
+			if (accessor->is_sparse || !accessor->buffer_view)
+				return nullptr;
+
+			const u8* base = static_cast<const u8*>(cgltf_buffer_view_data(accessor->buffer_view));
+			if (!base)
+				return nullptr;
+
+			return base + accessor->offset;
+		}
+
+		// fixed size copies, the compiler turns these into plain vector loads/stores
+		template <u32 N>
+		void CopyFloatsStrided(const u8* src, size_t srcStride, float* dst, size_t dstStride, size_t count)
+		{
+			u8* out = reinterpret_cast<u8*>(dst);
+			for (size_t i = 0; i < count; i++)
+			{
+				memcpy(out, src, N * sizeof(float));
+				src += srcStride;
+				out += dstStride;
+			}
+		}
+
+		// same math as cgltf_component_read_float so the output matches the per element path bit for bit
+		template <typename T, u32 N>
+		void ConvertNormalizedStrided(const u8* src, size_t srcStride, float* dst, size_t dstStride, size_t count, float maxValue)
+		{
+			u8* out = reinterpret_cast<u8*>(dst);
+			for (size_t i = 0; i < count; i++)
+			{
+				T values[N];
+				memcpy(values, src, sizeof(values));
+				float* outFloats = reinterpret_cast<float*>(out);
+				for (u32 c = 0; c < N; c++)
+					outFloats[c] = static_cast<float>(values[c]) / maxValue;
+				src += srcStride;
+				out += dstStride;
+			}
+		}
+
+		template <typename T>
+		void WidenIndices(const u8* src, size_t srcStride, u32* dst, size_t count)
+		{
+			if (srcStride == sizeof(T))
+			{
+				const T* in = reinterpret_cast<const T*>(src);
+				std::copy(in, in + count, dst);
+				return;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				T value;
+				memcpy(&value, src + i * srcStride, sizeof(T));
+				dst[i] = value;
+			}
+		}
+
+		bool DecodeFloatsFast(const cgltf_accessor* accessor, float* dst, size_t count, u32 components, size_t dstStride)
+		{
+			const u8* src = GetAccessorData(accessor);
+			if (!src || cgltf_num_components(accessor->type) != components)
+				return false;
+
+			const size_t srcStride = accessor->stride;
+
+			if (accessor->component_type == cgltf_component_type_r_32f)
+			{
+				if (srcStride == components * sizeof(float) && dstStride == srcStride)
+				{
+					memcpy(dst, src, count * srcStride);
+					return true;
+				}
+				switch (components)
+				{
+				case 2: CopyFloatsStrided<2>(src, srcStride, dst, dstStride, count); return true;
+				case 3: CopyFloatsStrided<3>(src, srcStride, dst, dstStride, count); return true;
+				case 4: CopyFloatsStrided<4>(src, srcStride, dst, dstStride, count); return true;
+				default: return false;
+				}
+			}
+
+			if (!accessor->normalized)
+				return false;
+
+			// normalized u8/u16 shows up for quantized UVs (KHR_mesh_quantization)
+			if (accessor->component_type == cgltf_component_type_r_8u)
+			{
+				switch (components)
+				{
+				case 2: ConvertNormalizedStrided<u8, 2>(src, srcStride, dst, dstStride, count, 255.f); return true;
+				case 3: ConvertNormalizedStrided<u8, 3>(src, srcStride, dst, dstStride, count, 255.f); return true;
+				case 4: ConvertNormalizedStrided<u8, 4>(src, srcStride, dst, dstStride, count, 255.f); return true;
+				default: return false;
+				}
+			}
+			if (accessor->component_type == cgltf_component_type_r_16u)
+			{
+				switch (components)
+				{
+				case 2: ConvertNormalizedStrided<u16, 2>(src, srcStride, dst, dstStride, count, 65535.f); return true;
+				case 3: ConvertNormalizedStrided<u16, 3>(src, srcStride, dst, dstStride, count, 65535.f); return true;
+				case 4: ConvertNormalizedStrided<u16, 4>(src, srcStride, dst, dstStride, count, 65535.f); return true;
+				default: return false;
+				}
+			}
+			return false;
+		}
+	}
+
+	bool DecodeAccessorFloats(const cgltf_accessor* accessor, float* dst, size_t dstCount, u32 components, size_t dstStride)
+	{
+		if (!accessor || accessor->count == 0)
+			return accessor != nullptr;
+
+		// a malformed file can carry more elements than the destination holds, those are dropped
+		const size_t count = std::min<size_t>(accessor->count, dstCount);
+		if (DecodeFloatsFast(accessor, dst, count, components, dstStride))
+			return accessor->count == dstCount;
+
+		// generic path: unpack everything once (handles sparse and every component type), then interleave
+		const size_t srcComponents = cgltf_num_components(accessor->type);
+		std::vector<float> unpacked(accessor->count * srcComponents);
+		if (cgltf_accessor_unpack_floats(accessor, unpacked.data(), unpacked.size()) != unpacked.size())
+			return false;
+
+		const size_t copyComponents = std::min<size_t>(components, srcComponents);
+		u8* out = reinterpret_cast<u8*>(dst);
+		for (size_t i = 0; i < count; i++)
+		{
+			memcpy(out, &unpacked[i * srcComponents], copyComponents * sizeof(float));
+			out += dstStride;
+		}
+		return copyComponents == components && accessor->count == dstCount;
+	}
+
+	bool DecodeAccessorIndices(const cgltf_accessor* accessor, u32* dst)
+	{
+		if (!accessor)
+			return false;
+
+		const u8* src = GetAccessorData(accessor);
+		const size_t count = accessor->count;
+
+		if (src)
+		{
+			switch (accessor->component_type)
+			{
+			case cgltf_component_type_r_8u: WidenIndices<u8>(src, accessor->stride, dst, count); return true;
+			case cgltf_component_type_r_16u: WidenIndices<u16>(src, accessor->stride, dst, count); return true;
+			case cgltf_component_type_r_32u: WidenIndices<u32>(src, accessor->stride, dst, count); return true;
+			default: break;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = static_cast<u32>(cgltf_accessor_read_index(accessor, i));
+		}
+		return true;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef ACCESSOR_DECODER_H
+#define ACCESSOR_DECODER_H
+
+#include <cgltf.h>
+
+#include "StandardTypes.h"
+
+// bulk glTF accessor decoding. Reads a whole accessor in one go and writes it straight into an interleaved
+// (AoS) destination, instead of going through cgltf_accessor_read_float for every single element.
+// The common layouts (float vecN, normalized u8/u16, u8/u16/u32 indices) are copied directly from the buffer view,
+// everything else (sparse, odd component types) goes through cgltf_accessor_unpack_floats once.
+
+namespace CV
+{
+	// writes up to dstCount elements of `components` floats each to dst, advancing dstStride bytes per element.
+	// Missing components (accessor narrower than requested) are left untouched. False as well if the accessor's
+	// count isn't dstCount, whatever fits has still been written
+	bool DecodeAccessorFloats(const cgltf_accessor* accessor, float* dst, size_t dstCount, u32 components, size_t dstStride);
+
+	// writes accessor->count indices to dst
+	bool DecodeAccessorIndices(const cgltf_accessor* accessor, u32* dst);
+}
+
+#endif
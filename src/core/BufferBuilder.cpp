@@ -27,9 +27,8 @@ namespace CV
 		return *this;
 	}
 
-	vk::Buffer BufferBuilder::build(vk::DeviceMemory& outMemory) const {
+	vk::Buffer BufferBuilder::build(Allocation& outMemory) const {
 		const auto device = _resourceManager.getDevice();
-		const auto physicalDevice = _resourceManager.getPhysicalDevice();
 		vk::BufferCreateInfo bufferCI{};
 		bufferCI.size = m_size;
 		bufferCI.usage = m_usage;
@@ -42,36 +41,12 @@ namespace CV
 			{
 				device.destroyBuffer(buffer);
 			});
-		vk::MemoryRequirements memRequirements;
-		device.getBufferMemoryRequirements(buffer, &memRequirements);
 
-		vk::MemoryAllocateFlagsInfo allocFlagsInfo{};
-
-		auto memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, m_memProps);
-
-		vk::MemoryAllocateInfo allocInfo = {};
-		if (m_usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
-			allocFlagsInfo.flags = vk::MemoryAllocateFlagBits::eDeviceAddress;
-			allocInfo.pNext = &allocFlagsInfo;
-		}
-		else allocInfo.pNext = nullptr;
-
-		allocInfo.allocationSize = memRequirements.size;
-		if (memoryTypeIndex.has_value())
-			allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, m_memProps).value();
-		else printl(Log::LogLevel::Error, "[VULKAN] No memory type found");
-
-		VK_ASSERT(device.allocateMemory(&allocInfo, nullptr, &outMemory),
-			[&] ()
-			{
-				device.destroyBuffer(buffer);
-			});
-
-		device.bindBufferMemory(buffer, outMemory, 0);
-		if (!buffer) {
+		// sub-allocated and bound at its offset, blocks that can back device address buffers are allocated with the flag
+		outMemory = _resourceManager.getAllocator().allocateForBuffer(buffer, m_memProps);
+		if (!outMemory) {
 			printl(Log::LogLevel::Error,"[BUFFER] Failed to bind memory to buffer");
 			vkDestroyBuffer(device, buffer, nullptr);
-			vkFreeMemory(device, outMemory, nullptr);
 			throw std::runtime_error("Failed to bind memory to buffer");
 		}
 
@@ -3,6 +3,8 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "MemoryAllocator.h"
+
 // have the staging buffers here so no staging buffer copying or such is not visible in the application side
 
 namespace CV
@@ -19,7 +21,8 @@ namespace CV
 		BufferBuilder& setUsage(vk::BufferUsageFlags usage);
 		BufferBuilder& setMemoryProperties(vk::MemoryPropertyFlags properties);
 
-		vk::Buffer build(vk::DeviceMemory& outMemory) const;
+		// memory comes from the resource manager's allocator, free it there
+		vk::Buffer build(Allocation& outMemory) const;
 
 	private:
 		ResourceManager& _resourceManager;
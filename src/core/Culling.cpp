@@ -0,0 +1,149 @@
+#include <pch.h>
+
+#include <bit>
+#include <limits>
+
+#include "Culling.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CV_CULL_AVX 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CV_TARGET_AVX
+#else
+// only the kernel is compiled for AVX, the rest of the binary stays baseline x86-64
+#define CV_TARGET_AVX __attribute__((target("avx")))
+#endif
+#else
+#define CV_CULL_AVX 0
+#endif
+
+namespace
+{
+	using namespace CV;
+
+#if CV_CULL_AVX
+	// cpuid says the CPU has it and xgetbv that the OS saves the ymm registers
+	bool CpuHasAvx()
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+
+	CV_TARGET_AVX u32 CullBoxesAvx(const CullBounds& bounds, const glm::vec4 planes[6], u8* visible)
+	{
+		const u32 padded = bounds.GetPaddedCount();
+		u32 visibleCount = 0;
+
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm256_set1_ps(planes[p].x);
+			planeY[p] = _mm256_set1_ps(planes[p].y);
+			planeZ[p] = _mm256_set1_ps(planes[p].z);
+			planeW[p] = _mm256_set1_ps(planes[p].w);
+		}
+
+		for (u32 i = 0; i < padded; i += CullBounds::kBatch)
+		{
+			const __m256 minX = _mm256_loadu_ps(&bounds.minX[i]);
+			const __m256 minY = _mm256_loadu_ps(&bounds.minY[i]);
+			const __m256 minZ = _mm256_loadu_ps(&bounds.minZ[i]);
+			const __m256 maxX = _mm256_loadu_ps(&bounds.maxX[i]);
+			const __m256 maxY = _mm256_loadu_ps(&bounds.maxY[i]);
+			const __m256 maxZ = _mm256_loadu_ps(&bounds.maxZ[i]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const __m256 x = planes[p].x > 0.0f ? maxX : minX;
+				const __m256 y = planes[p].y > 0.0f ? maxY : minY;
+				const __m256 z = planes[p].z > 0.0f ? maxZ : minZ;
+				const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+				                                      _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			const u32 mask = static_cast<u32>(_mm256_movemask_ps(inside));
+			for (u32 lane = 0; lane < CullBounds::kBatch; lane++)
+				visible[i + lane] = static_cast<u8>((mask >> lane) & 1u);
+			visibleCount += static_cast<u32>(std::popcount(mask));
+		}
+		return visibleCount;
+	}
+#endif
+
+	u32 CullBoxesScalar(const CullBounds& bounds, const glm::vec4 planes[6], u8* visible)
+	{
+		const u32 padded = bounds.GetPaddedCount();
+		u32 visibleCount = 0;
+		for (u32 i = 0; i < padded; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const glm::vec4& plane = planes[p];
+				const float x = plane.x > 0.0f ? bounds.maxX[i] : bounds.minX[i];
+				const float y = plane.y > 0.0f ? bounds.maxY[i] : bounds.minY[i];
+				const float z = plane.z > 0.0f ? bounds.maxZ[i] : bounds.minZ[i];
+				inside = plane.x * x + plane.y * y + plane.z * z + plane.w >= 0.0f;
+			}
+			visible[i] = inside ? 1 : 0;
+			visibleCount += inside ? 1 : 0;
+		}
+		return visibleCount;
+	}
+}
+
+namespace CV
+{
+	void CullBounds::Resize(u32 newCount)
+	{
+		count = newCount;
+		const u32 padded = (newCount + kBatch - 1) / kBatch * kBatch;
+
+		// inverted boxes: whichever corner a plane picks is at -infinity along its normal, so the padding always fails
+		constexpr float kFar = std::numeric_limits<float>::max();
+		for (std::vector<float>* component : { &minX, &minY, &minZ })
+			component->assign(padded, kFar);
+		for (std::vector<float>* component : { &maxX, &maxY, &maxZ })
+			component->assign(padded, -kFar);
+		for (std::vector<float>* component : { &centerX, &centerY, &centerZ, &radius, &scale })
+			component->assign(padded, 0.0f);
+	}
+
+	void CullBounds::Set(u32 index, const glm::vec3& min, const glm::vec3& max, const glm::vec3& center, float sphereRadius, float maxScale)
+	{
+		minX[index] = min.x;
+		minY[index] = min.y;
+		minZ[index] = min.z;
+		maxX[index] = max.x;
+		maxY[index] = max.y;
+		maxZ[index] = max.z;
+		centerX[index] = center.x;
+		centerY[index] = center.y;
+		centerZ[index] = center.z;
+		radius[index] = sphereRadius;
+		scale[index] = maxScale;
+	}
+
+	u32 CullBoxes(const CullBounds& bounds, const glm::vec4 planes[6], u8* visible)
+	{
+		// a box is outside as soon as its corner furthest along some plane's normal is behind that plane. Which corner that
+		// is only depends on the signs of the plane, so it is picked per plane rather than per box
+#if CV_CULL_AVX
+		static const bool hasAvx = CpuHasAvx();
+		if (hasAvx)
+			return CullBoxesAvx(bounds, planes, visible);
+#endif
+		return CullBoxesScalar(bounds, planes, visible);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "StandardTypes.h"
+
+// CPU frustum culling. World space bounds are kept SoA so the kernel loads kBatch of one component at once and tests a
+// whole batch against each plane with a handful of vector ops (8 boxes per AVX iteration). The AVX kernel is picked at
+// runtime, CPUs without it run the scalar loop.
+
+namespace CV
+{
+	struct CullBounds
+	{
+		static constexpr u32 kBatch = 8;
+
+		// boxes
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+		// spheres around the same geometry, plus the largest axis scale of the transform (LOD error is scaled by it)
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> radius;
+		std::vector<float> scale;
+		u32 count = 0;
+
+		// rounded up to kBatch, the padding is never visible
+		void Resize(u32 newCount);
+		void Set(u32 index, const glm::vec3& min, const glm::vec3& max, const glm::vec3& center, float sphereRadius, float maxScale);
+		[[nodiscard]] u32 GetPaddedCount() const { return static_cast<u32>(minX.size()); }
+		[[nodiscard]] glm::vec3 GetCenter(u32 index) const { return { centerX[index], centerY[index], centerZ[index] }; }
+	};
+
+	// planes as from getFrustumPlanes (UtilsMath.h), they don't have to be normalised. visible needs GetPaddedCount()
+	// entries, 1 for every box that is at least partly inside. Returns how many are
+	u32 CullBoxes(const CullBounds& bounds, const glm::vec4 planes[6], u8* visible);
+}
+
+#endif
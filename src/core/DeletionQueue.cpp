@@ -0,0 +1,135 @@
+#include <pch.h>
+
+#include "DeletionQueue.h"
+#include "Log.h"
+
+namespace CV
+{
+	DeletionQueue::DeletionQueue(vk::Device device, u32 framesInFlight)
+		: m_device(device), m_framesInFlight(framesInFlight)
+	{
+	}
+
+	DeletionQueue::~DeletionQueue()
+	{
+		Flush();
+	}
+
+	void DeletionQueue::Enqueue(vk::Buffer buffer, MemoryAllocator* allocator, const Allocation& memory)
+	{
+		if (buffer)
+			Push(Kind::Buffer, reinterpret_cast<u64>(static_cast<VkBuffer>(buffer)));
+		if (allocator && memory)
+			Push(Kind::Memory, 0, allocator, memory);
+	}
+
+	void DeletionQueue::Enqueue(vk::Image image, MemoryAllocator* allocator, const Allocation& memory)
+	{
+		if (image)
+			Push(Kind::Image, reinterpret_cast<u64>(static_cast<VkImage>(image)));
+		if (allocator && memory)
+			Push(Kind::Memory, 0, allocator, memory);
+	}
+
+	void DeletionQueue::Enqueue(MemoryAllocator& allocator, const Allocation& memory)
+	{
+		if (memory)
+			Push(Kind::Memory, 0, &allocator, memory);
+	}
+
+	void DeletionQueue::Enqueue(vk::DeviceMemory memory)
+	{
+		if (memory)
+			Push(Kind::DeviceMemory, reinterpret_cast<u64>(static_cast<VkDeviceMemory>(memory)));
+	}
+
+	void DeletionQueue::Enqueue(vk::ImageView view)
+	{
+		if (view)
+			Push(Kind::ImageView, reinterpret_cast<u64>(static_cast<VkImageView>(view)));
+	}
+
+	void DeletionQueue::Enqueue(vk::Sampler sampler)
+	{
+		if (sampler)
+			Push(Kind::Sampler, reinterpret_cast<u64>(static_cast<VkSampler>(sampler)));
+	}
+
+	void DeletionQueue::Enqueue(vk::Pipeline pipeline)
+	{
+		if (pipeline)
+			Push(Kind::Pipeline, reinterpret_cast<u64>(static_cast<VkPipeline>(pipeline)));
+	}
+
+	void DeletionQueue::Enqueue(vk::DescriptorPool pool)
+	{
+		if (pool)
+			Push(Kind::DescriptorPool, reinterpret_cast<u64>(static_cast<VkDescriptorPool>(pool)));
+	}
+
+	void DeletionQueue::Push(Kind kind, u64 handle, MemoryAllocator* allocator, const Allocation& memory)
+	{
+		std::lock_guard lock(m_mutex);
+		m_entries.push_back({ m_frame, kind, handle, allocator, memory });
+	}
+
+	void DeletionQueue::BeginFrame()
+	{
+		std::lock_guard lock(m_mutex);
+		m_frame++;
+		// the fence just waited on belongs to the frame recorded framesInFlight frames ago, so that one and everything
+		// before it is retired
+		while (!m_entries.empty() && m_entries.front().frame + m_framesInFlight <= m_frame)
+		{
+			Release(m_entries.front());
+			m_entries.pop_front();
+		}
+	}
+
+	void DeletionQueue::Flush()
+	{
+		std::lock_guard lock(m_mutex);
+		if (!m_entries.empty())
+			printl(Log::LogLevel::Info, "[DELETE] Releasing {} pending resource(s)", m_entries.size());
+		for (Entry& entry : m_entries)
+			Release(entry);
+		m_entries.clear();
+	}
+
+	size_t DeletionQueue::GetPendingCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_entries.size();
+	}
+
+	void DeletionQueue::Release(Entry& entry)
+	{
+		switch (entry.kind)
+		{
+		case Kind::Buffer:
+			m_device.destroyBuffer(reinterpret_cast<VkBuffer>(entry.handle));
+			break;
+		case Kind::Image:
+			m_device.destroyImage(reinterpret_cast<VkImage>(entry.handle));
+			break;
+		case Kind::Memory:
+			entry.allocator->free(entry.memory);
+			break;
+		case Kind::DeviceMemory:
+			m_device.freeMemory(reinterpret_cast<VkDeviceMemory>(entry.handle));
+			break;
+		case Kind::ImageView:
+			m_device.destroyImageView(reinterpret_cast<VkImageView>(entry.handle));
+			break;
+		case Kind::Sampler:
+			m_device.destroySampler(reinterpret_cast<VkSampler>(entry.handle));
+			break;
+		case Kind::Pipeline:
+			m_device.destroyPipeline(reinterpret_cast<VkPipeline>(entry.handle));
+			break;
+		case Kind::DescriptorPool:
+			m_device.destroyDescriptorPool(reinterpret_cast<VkDescriptorPool>(entry.handle));
+			break;
+		}
+	}
+}
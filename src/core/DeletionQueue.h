@@ -0,0 +1,78 @@
+#ifndef DELETION_QUEUE_H
+#define DELETION_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "MemoryAllocator.h"
+
+// deferred destruction. Anything a recorded frame may still reference is enqueued instead of destroyed, tagged with the
+// frame being recorded, and released once that frame's in flight fence has been waited on: BeginFrame() is called right
+// after the wait, at which point everything enqueued framesInFlight frames ago (or earlier) is done on the GPU.
+// Resources only touched by upload batches that have been waited on can be destroyed directly.
+
+namespace CV
+{
+	class DeletionQueue
+	{
+	public:
+		DeletionQueue(vk::Device device, u32 framesInFlight);
+		// releases whatever is left, the device has to be idle by then
+		~DeletionQueue();
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+		// allocator is whoever handed the memory out, an empty Allocation is skipped
+		void Enqueue(vk::Buffer buffer, MemoryAllocator* allocator = nullptr, const Allocation& memory = {});
+		void Enqueue(vk::Image image, MemoryAllocator* allocator = nullptr, const Allocation& memory = {});
+		void Enqueue(MemoryAllocator& allocator, const Allocation& memory);
+		void Enqueue(vk::DeviceMemory memory);
+		void Enqueue(vk::ImageView view);
+		void Enqueue(vk::Sampler sampler);
+		void Enqueue(vk::Pipeline pipeline);
+		void Enqueue(vk::DescriptorPool pool);
+
+		// after waiting on the fence of the frame about to be recorded
+		void BeginFrame();
+		// everything, now. Only after a waitIdle
+		void Flush();
+
+		[[nodiscard]] u64 GetFrame() const { return m_frame; }
+		[[nodiscard]] size_t GetPendingCount();
+
+	private:
+		enum class Kind : u8
+		{
+			Buffer,
+			Image,
+			Memory,			// sub-allocation, goes back to its allocator
+			DeviceMemory,	// own vkAllocateMemory
+			ImageView,
+			Sampler,
+			Pipeline,
+			DescriptorPool
+		};
+
+		struct Entry
+		{
+			u64 frame = 0;
+			Kind kind = Kind::Buffer;
+			u64 handle = 0;		// the Vulkan handle, as its raw value
+			MemoryAllocator* allocator = nullptr;
+			Allocation memory;
+		};
+
+		void Push(Kind kind, u64 handle, MemoryAllocator* allocator = nullptr, const Allocation& memory = {});
+		void Release(Entry& entry);
+
+		vk::Device m_device;
+		u32 m_framesInFlight;
+		u64 m_frame = 0;
+		std::deque<Entry> m_entries;	// in frame order
+		std::mutex m_mutex;
+	};
+}
+
+#endif
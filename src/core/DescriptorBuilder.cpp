@@ -3,7 +3,6 @@
 #include "DescriptorBuilder.h"
 #include "ResourceManager.h"
 #include "Log.h"
-#include "Texture.h"
 
 namespace CV 
 {
@@ -25,7 +24,7 @@ namespace CV
 		return descriptorSet;
 	}
 
-	vk::DescriptorSet DescriptorBuilder::updateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize bufferSize, std::optional<std::vector<CV::Texture>> texturesOpt) const
+	vk::DescriptorSet DescriptorBuilder::updateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize bufferSize, std::span<const vk::DescriptorImageInfo> images) const
 	{
 
 		// here the binding is for the descriptor in the descriptor set.
@@ -35,7 +34,7 @@ namespace CV
 
 
 		auto device = _resourceManager.getDevice();
-		if (buffer && (!texturesOpt.has_value()))
+		if (buffer && images.empty())
 		{
 			vk::DescriptorBufferInfo descBI{};
 			descBI.buffer = buffer;
@@ -53,24 +52,9 @@ namespace CV
 			device.updateDescriptorSets(1u, &uboSet, 0, nullptr);
 		}
 
-		if (!buffer && texturesOpt.has_value())
+		if (!buffer && !images.empty())
 		{
-			// bindless
-			std::vector<vk::DescriptorImageInfo> imageInfos{};
-			std::vector<Texture>& textures = texturesOpt.value();
-			for (auto& tex : textures)
-			{
-				vk::DescriptorImageInfo info{};
-				assert(tex.m_texImage);
-				assert(tex.m_texSampler);
-				assert(tex.m_texImageView);
-				info.sampler = tex.m_texSampler;
-				info.imageView = tex.m_texImageView;
-				info.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-
-				imageInfos.push_back(info);
-			}
-
+			// bindless, the infos come straight from the texture pool (see ResourceManager::WriteTextureDescriptors)
 			// here the binding is for the descriptor in the descriptor set.
 			// 0 for ubo , 1 for texture image and both are part of the same m_descriptorSet[frameNumber]
 			// refer to YouTube Brendan Galea's descriptor to get an image of what's going on.
@@ -80,9 +64,9 @@ namespace CV
 			sampSet.dstSet = set;
 			sampSet.dstBinding = binding;
 			sampSet.dstArrayElement = 0;
-			sampSet.descriptorCount = static_cast<uint32_t>(textures.size());
+			sampSet.descriptorCount = static_cast<uint32_t>(images.size());
 			sampSet.descriptorType = type;
-			sampSet.pImageInfo = imageInfos.data();
+			sampSet.pImageInfo = images.data();
 			device.updateDescriptorSets(1u, &sampSet, 0, nullptr);
 		}
 		return set;
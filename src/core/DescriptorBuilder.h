@@ -3,14 +3,13 @@
 
 #include <vector>
 #include <memory>
-#include <optional>
+#include <span>
 
 #include <vulkan/vulkan.hpp>
 
 namespace CV
 {
 	class ResourceManager;
-	class Texture;
 
 	class DescriptorBuilder
 	{
@@ -18,7 +17,7 @@ namespace CV
 		// methods
 		DescriptorBuilder(ResourceManager& resourceManager);
 		vk::DescriptorSet allocateDescriptorSet(vk::DescriptorSetLayout layout) const;
-		vk::DescriptorSet updateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize bufferSize, std::optional<std::vector<CV::Texture>> textures) const;
+		vk::DescriptorSet updateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize bufferSize, std::span<const vk::DescriptorImageInfo> images = {}) const;
 
 		// vars
 		ResourceManager& _resourceManager;
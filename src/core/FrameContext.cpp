@@ -0,0 +1,69 @@
+#include <pch.h>
+
+#include "FrameContext.h"
+#include "common.h"
+#include "Log.h"
+
+namespace CV
+{
+	FrameContext::FrameContext(vk::Device device, u32 queueFamily, MemoryAllocator& allocator, u32 index, u32 secondaryCount)
+		: m_device(device), m_index(index), m_uploadRing(device, allocator, 1)
+	{
+		// no eResetCommandBuffer, the pool is only ever reset as a whole
+		vk::CommandPoolCreateInfo poolInfo{};
+		poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+		poolInfo.queueFamilyIndex = queueFamily;
+		m_commandPool = m_device.createCommandPool(poolInfo);
+
+		vk::CommandBufferAllocateInfo allocInfo{};
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+		allocInfo.commandBufferCount = 1;
+		m_commandBuffer = m_device.allocateCommandBuffers(allocInfo)[0];
+
+		m_secondaryPools.resize(secondaryCount);
+		m_secondaryCommandBuffers.resize(secondaryCount);
+		for (u32 i = 0; i < secondaryCount; i++)
+		{
+			m_secondaryPools[i] = m_device.createCommandPool(poolInfo);
+			allocInfo.commandPool = m_secondaryPools[i];
+			allocInfo.level = vk::CommandBufferLevel::eSecondary;
+			m_secondaryCommandBuffers[i] = m_device.allocateCommandBuffers(allocInfo)[0];
+		}
+
+		// signalled, so the first Begin doesn't wait on a submit that never happened
+		vk::FenceCreateInfo fenceInfo{};
+		fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled;
+		m_fence = m_device.createFence(fenceInfo);
+		m_imageAvailable = m_device.createSemaphore(vk::SemaphoreCreateInfo{});
+
+		printl(Log::LogLevel::Info, "[FRAME] Frame context {} created, {} secondary command pools", m_index, secondaryCount);
+	}
+
+	FrameContext::~FrameContext()
+	{
+		m_device.destroySemaphore(m_imageAvailable);
+		m_device.destroyFence(m_fence);
+		for (vk::CommandPool pool : m_secondaryPools)
+			m_device.destroyCommandPool(pool);
+		m_device.destroyCommandPool(m_commandPool);
+	}
+
+	void FrameContext::Begin()
+	{
+		VK_ASSERT(m_device.waitForFences(1u, &m_fence, VK_TRUE, UINT64_MAX));
+		VK_ASSERT(m_device.resetFences(1u, &m_fence));
+
+		m_device.resetCommandPool(m_commandPool);
+		for (vk::CommandPool pool : m_secondaryPools)
+			m_device.resetCommandPool(pool);
+		m_uploadRing.BeginFrame(0);
+	}
+
+	bool FrameContext::ConsumeTextureSetDirty()
+	{
+		const bool dirty = m_textureSetDirty;
+		m_textureSetDirty = false;
+		return dirty;
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef FRAME_CONTEXT_H
+#define FRAME_CONTEXT_H
+
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "UploadRing.h"
+
+// everything one frame in flight records into or allocates from. Begin() waits on the frame's fence and then resets all of
+// it as a unit: the command pools, each in one resetCommandPool (their buffers keep their memory for the next recording,
+// nothing is freed and reallocated per buffer), the upload ring, and the texture descriptor set if it was marked dirty.
+// Besides the primary there is one pool per secondary, so every ParallelRecorder chunk records from a pool of its own.
+// The render finished semaphores stay with the swapchain images, they are signalled per image rather than per frame.
+
+namespace CV
+{
+	class FrameContext
+	{
+	public:
+		// secondaryCount: ParallelRecorder::GetMaxChunkCount(), 0 without parallel recording
+		FrameContext(vk::Device device, u32 queueFamily, MemoryAllocator& allocator, u32 index, u32 secondaryCount = 0);
+		~FrameContext();
+		FrameContext(const FrameContext&) = delete;
+		FrameContext& operator=(const FrameContext&) = delete;
+
+		// blocks until the GPU is done with this frame's previous submit, then resets it. The command buffer is ready to begin
+		void Begin();
+
+		// the next time round, after the fence. For data the set reads that changed (streamed textures)
+		void MarkTextureSetDirty() { m_textureSetDirty = true; }
+		// true once per MarkTextureSetDirty, after Begin. The caller rewrites the set
+		bool ConsumeTextureSetDirty();
+
+		[[nodiscard]] u32 GetIndex() const { return m_index; }
+		[[nodiscard]] vk::CommandBuffer GetCommandBuffer() const { return m_commandBuffer; }
+		// for ParallelRecorder::Record
+		[[nodiscard]] std::span<const vk::CommandBuffer> GetSecondaryCommandBuffers() const { return m_secondaryCommandBuffers; }
+		// signalled by the submit of this frame, waited on in Begin
+		[[nodiscard]] vk::Fence GetFence() const { return m_fence; }
+		[[nodiscard]] vk::Semaphore GetImageAvailableSemaphore() const { return m_imageAvailable; }
+		[[nodiscard]] UploadRing& GetUploadRing() { return m_uploadRing; }
+
+		// allocated from the resource manager's descriptor pool, handed in once after creation
+		void SetTextureSet(vk::DescriptorSet set) { m_textureSet = set; }
+		[[nodiscard]] const vk::DescriptorSet& GetTextureSet() const { return m_textureSet; }
+
+	private:
+		vk::Device m_device;
+		u32 m_index;
+		vk::CommandPool m_commandPool;
+		vk::CommandBuffer m_commandBuffer;
+		std::vector<vk::CommandPool> m_secondaryPools;
+		std::vector<vk::CommandBuffer> m_secondaryCommandBuffers;	// [i] from m_secondaryPools[i]
+		vk::Fence m_fence;
+		vk::Semaphore m_imageAvailable;
+		UploadRing m_uploadRing;
+		vk::DescriptorSet m_textureSet;
+		bool m_textureSetDirty = false;
+	};
+}
+
+#endif
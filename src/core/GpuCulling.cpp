@@ -0,0 +1,103 @@
+#include <pch.h>
+
+#include <algorithm>
+
+#include "GpuCulling.h"
+#include "PipelineManager.h"
+#include "ResourceManager.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		constexpr u32 kGroupSize = 64;	// numthreads of cull.comp.slang
+
+		void GlobalBarrier(vk::CommandBuffer cmd, vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess,
+			vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess)
+		{
+			vk::MemoryBarrier2 memoryBarrier{};
+			memoryBarrier.srcStageMask = srcStage;
+			memoryBarrier.srcAccessMask = srcAccess;
+			memoryBarrier.dstStageMask = dstStage;
+			memoryBarrier.dstAccessMask = dstAccess;
+
+			vk::DependencyInfo depInfo{};
+			depInfo.memoryBarrierCount = 1;
+			depInfo.pMemoryBarriers = &memoryBarrier;
+			cmd.pipelineBarrier2(depInfo);
+		}
+	}
+
+	GpuCulling::GpuCulling(ResourceManager& resourceManager, const u32 regionOffset[DRAW_REGION_COUNT], const u32 regionCount[DRAW_REGION_COUNT])
+		: m_resourceManager(resourceManager)
+	{
+		for (u32 region = 0; region < DRAW_REGION_COUNT; region++)
+		{
+			m_regionOffset[region] = regionOffset[region];
+			m_regionCount[region] = regionCount[region];
+			m_recordCount = std::max(m_recordCount, regionOffset[region] + regionCount[region]);
+		}
+
+		m_commandBuffer = m_resourceManager.CreateBuffer(std::max(m_recordCount, 1u) * sizeof(vk::DrawIndexedIndirectCommand),
+			vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		m_countBuffer = m_resourceManager.CreateBuffer(DRAW_REGION_COUNT * sizeof(u32),
+			vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+			vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		PipelineManager* pipelineManager = m_resourceManager.getPipelineManager();
+		m_pipeline = PipelineManager::Builder(pipelineManager)
+			.setComputeShader("shaders/cull.comp.spv")
+			.setPushConstants(vk::ShaderStageFlagBits::eCompute, sizeof(CullConstants))
+			.build("gpu_cull");
+		m_pipelineLayout = pipelineManager->getPipelineLayout(
+			PipelineManager::makePipelineLayoutKey({}, vk::ShaderStageFlagBits::eCompute, sizeof(CullConstants)));
+
+		printl(Log::LogLevel::Info, "[CULL] GPU culling {} draw records", m_recordCount);
+	}
+
+	GpuCulling::~GpuCulling()
+	{
+		m_resourceManager.DestroyBuffer(m_commandBuffer);
+		m_resourceManager.DestroyBuffer(m_countBuffer);
+	}
+
+	void GpuCulling::Dispatch(vk::CommandBuffer cmd, vk::DeviceAddress frameConstants, vk::DeviceAddress drawRecords)
+	{
+		if (m_recordCount == 0)
+			return;
+
+		// the previous frame's indirect draws have to be done reading before the counts and commands are overwritten
+		GlobalBarrier(cmd, vk::PipelineStageFlagBits2::eDrawIndirect, {},
+			vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader, {});
+		cmd.fillBuffer(m_resourceManager.getBuffer(m_countBuffer), 0, DRAW_REGION_COUNT * sizeof(u32), 0);
+		GlobalBarrier(cmd, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+		CullConstants constants{};
+		constants.frameConstantsAddress = frameConstants;
+		constants.drawRecordAddress = drawRecords;
+		constants.commandAddress = m_resourceManager.getBufferAddress(m_commandBuffer);
+		constants.countAddress = m_resourceManager.getBufferAddress(m_countBuffer);
+		constants.recordCount = m_recordCount;
+		for (u32 region = 0; region < DRAW_REGION_COUNT; region++)
+			constants.regionOffset[region] = m_regionOffset[region];
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+		cmd.pushConstants(m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants), &constants);
+		cmd.dispatch((m_recordCount + kGroupSize - 1) / kGroupSize, 1, 1);
+
+		GlobalBarrier(cmd, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+	}
+
+	void GpuCulling::Draw(vk::CommandBuffer cmd, u32 region) const
+	{
+		if (m_regionCount[region] == 0)
+			return;
+
+		cmd.drawIndexedIndirectCount(m_resourceManager.getBuffer(m_commandBuffer), m_regionOffset[region] * sizeof(vk::DrawIndexedIndirectCommand),
+			m_resourceManager.getBuffer(m_countBuffer), region * sizeof(u32), m_regionCount[region], sizeof(vk::DrawIndexedIndirectCommand));
+	}
+}
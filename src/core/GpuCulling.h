@@ -0,0 +1,48 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "Handle.h"
+#include "Vertex.h"
+
+// GPU driven culling for the raster path. cull.comp.slang tests every DrawRecord against the frustum, picks its LOD and
+// appends a vk::DrawIndexedIndirectCommand to its region of the command buffer, counting the draws per region. Each
+// region is then drawn with one drawIndexedIndirectCount, so the CPU cost no longer grows with the instance count.
+// The command and count buffers are rewritten every frame; the barriers in Dispatch() order that against the previous
+// frame's indirect reads, so one set is enough even with several frames in flight.
+
+namespace CV
+{
+	class ResourceManager;
+
+	class GpuCulling
+	{
+	public:
+		// regionOffset / regionCount as in Model::_drawRegionOffset / _drawRegionCount
+		GpuCulling(ResourceManager& resourceManager, const u32 regionOffset[DRAW_REGION_COUNT], const u32 regionCount[DRAW_REGION_COUNT]);
+		~GpuCulling();
+		GpuCulling(const GpuCulling&) = delete;
+		GpuCulling& operator=(const GpuCulling&) = delete;
+
+		// outside of rendering, before the draws. frameConstants needs the frustum planes and LOD terms filled in
+		void Dispatch(vk::CommandBuffer cmd, vk::DeviceAddress frameConstants, vk::DeviceAddress drawRecords);
+		// inside rendering, with the region's index buffer and the raster pipeline bound
+		void Draw(vk::CommandBuffer cmd, u32 region) const;
+
+		[[nodiscard]] u32 GetRecordCount() const { return m_recordCount; }
+
+	private:
+		ResourceManager& m_resourceManager;
+		BufferHandle m_commandBuffer;	// vk::DrawIndexedIndirectCommand per record
+		BufferHandle m_countBuffer;		// u32 per region
+		vk::Pipeline m_pipeline;
+		vk::PipelineLayout m_pipelineLayout;
+		u32 m_regionOffset[DRAW_REGION_COUNT]{};
+		u32 m_regionCount[DRAW_REGION_COUNT]{};
+		u32 m_recordCount = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <pch.h>
+
+#include "GpuTimer.h"
+#include "Log.h"
+
+namespace CV
+{
+	GpuTimer::GpuTimer(vk::Device device, vk::PhysicalDevice physicalDevice, u32 queueFamily, u32 frameCount)
+		: m_device(device), m_frameCount(frameCount)
+	{
+		const u32 validBits = physicalDevice.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+		if (validBits == 0)
+		{
+			printl(Log::LogLevel::Warn, "[TIMER] Queue family {} has no timestamps, GPU times stay 0", queueFamily);
+			return;
+		}
+		m_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		m_period = physicalDevice.getProperties().limits.timestampPeriod;
+
+		vk::QueryPoolCreateInfo createInfo{};
+		createInfo.queryType = vk::QueryType::eTimestamp;
+		createInfo.queryCount = 2 * m_frameCount;
+		m_queryPool = m_device.createQueryPool(createInfo);
+	}
+
+	GpuTimer::~GpuTimer()
+	{
+		if (m_queryPool)
+			m_device.destroyQueryPool(m_queryPool);
+	}
+
+	void GpuTimer::Resolve(u32 frameIndex)
+	{
+		const u32 frameBit = 1u << frameIndex;
+		if (!m_queryPool || !(m_writtenMask & frameBit))
+			return;
+		m_writtenMask &= ~frameBit;
+
+		u64 timestamps[2] = {};
+		const vk::Result result = m_device.getQueryPoolResults(m_queryPool, 2 * frameIndex, 2, sizeof(timestamps), timestamps, sizeof(u64),
+			vk::QueryResultFlagBits::e64);
+		if (result != vk::Result::eSuccess)
+			return;
+
+		const double ticks = static_cast<double>((timestamps[1] - timestamps[0]) & m_validMask);
+		const float milliseconds = static_cast<float>(ticks * m_period * 1e-6);
+		m_milliseconds = m_milliseconds == 0.0f ? milliseconds : m_milliseconds * 0.95f + milliseconds * 0.05f;
+	}
+
+	void GpuTimer::Begin(vk::CommandBuffer cmd, u32 frameIndex)
+	{
+		if (!m_queryPool)
+			return;
+		cmd.resetQueryPool(m_queryPool, 2 * frameIndex, 2);
+		cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, m_queryPool, 2 * frameIndex);
+	}
+
+	void GpuTimer::End(vk::CommandBuffer cmd, u32 frameIndex)
+	{
+		if (!m_queryPool)
+			return;
+		cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, m_queryPool, 2 * frameIndex + 1);
+		m_writtenMask |= 1u << frameIndex;
+	}
+}
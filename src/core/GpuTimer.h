@@ -0,0 +1,41 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+
+// GPU time of a frame's work, from a pair of timestamps per frame in flight. The results are read once the frame's fence
+// has signalled, so they are always framesInFlight frames old and reading them never stalls.
+
+namespace CV
+{
+	class GpuTimer
+	{
+	public:
+		GpuTimer(vk::Device device, vk::PhysicalDevice physicalDevice, u32 queueFamily, u32 frameCount);
+		~GpuTimer();
+		GpuTimer(const GpuTimer&) = delete;
+		GpuTimer& operator=(const GpuTimer&) = delete;
+
+		// after waiting on the frame's fence, picks up what it measured the last time round
+		void Resolve(u32 frameIndex);
+		// first and last thing in the frame's command buffer
+		void Begin(vk::CommandBuffer cmd, u32 frameIndex);
+		void End(vk::CommandBuffer cmd, u32 frameIndex);
+
+		// exponential average, 0 until something has been measured or if the queue has no timestamps
+		[[nodiscard]] float GetMilliseconds() const { return m_milliseconds; }
+
+	private:
+		vk::Device m_device;
+		vk::QueryPool m_queryPool;
+		u32 m_frameCount;
+		double m_period = 0.0;		// nanoseconds per tick
+		u64 m_validMask = 0;
+		u32 m_writtenMask = 0;		// frames whose queries hold a result not read yet
+		float m_milliseconds = 0.0f;
+	};
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include <cassert>
+#include <vector>
+
+#include "StandardTypes.h"
+
+// 32 bit generational handles. The low bits are the slot in the owning pool's arrays (for textures that is also the
+// bindless descriptor index the shaders see), the high bits the slot's generation, bumped every time the slot is freed.
+// A handle kept past its resource's lifetime no longer matches and trips the pool's assert in debug builds.
+// Generations start at 1, so a zero handle is never valid.
+
+namespace CV
+{
+	template<typename Tag>
+	struct Handle
+	{
+		static constexpr u32 kIndexBits = 20;
+		static constexpr u32 kIndexMask = (1u << kIndexBits) - 1;
+		static constexpr u32 kGenerationMask = (1u << (32 - kIndexBits)) - 1;
+
+		u32 value = 0;
+
+		static Handle Make(u32 index, u32 generation) { return { (generation << kIndexBits) | index }; }
+
+		[[nodiscard]] u32 Index() const { return value & kIndexMask; }
+		[[nodiscard]] u32 Generation() const { return value >> kIndexBits; }
+		explicit operator bool() const { return value != 0; }
+		bool operator==(const Handle&) const = default;
+	};
+
+	using TextureHandle = Handle<struct TextureTag>;
+	using BufferHandle = Handle<struct BufferTag>;
+
+	// slot bookkeeping only, the resource data lives in parallel arrays next to the pool, sized to GetCapacity()
+	template<typename Tag>
+	class HandlePool
+	{
+	public:
+		// a freed slot if there is one, otherwise a new one at the end
+		Handle<Tag> Allocate()
+		{
+			m_count++;
+			if (!m_freeSlots.empty())
+			{
+				const u32 index = m_freeSlots.back();
+				m_freeSlots.pop_back();
+				return Handle<Tag>::Make(index, m_generations[index]);
+			}
+
+			const u32 index = static_cast<u32>(m_generations.size());
+			assert(index <= Handle<Tag>::kIndexMask);
+			m_generations.push_back(1);
+			return Handle<Tag>::Make(index, 1);
+		}
+
+		void Free(Handle<Tag> handle)
+		{
+			assert(IsValid(handle));
+			u32& generation = m_generations[handle.Index()];
+			generation = (generation + 1) & Handle<Tag>::kGenerationMask;
+			if (generation == 0)
+				generation = 1;
+			m_freeSlots.push_back(handle.Index());
+			m_count--;
+		}
+
+		[[nodiscard]] bool IsValid(Handle<Tag> handle) const
+		{
+			return handle && handle.Index() < m_generations.size() && m_generations[handle.Index()] == handle.Generation();
+		}
+
+		// every slot ever handed out, freed ones included
+		[[nodiscard]] u32 GetCapacity() const { return static_cast<u32>(m_generations.size()); }
+		[[nodiscard]] u32 GetCount() const { return m_count; }
+
+	private:
+		std::vector<u32> m_generations;
+		std::vector<u32> m_freeSlots;
+		u32 m_count = 0;
+	};
+}
+
+#endif
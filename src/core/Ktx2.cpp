@@ -0,0 +1,313 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+#include "Ktx2.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		constexpr u8 kKtx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+		struct Ktx2Header
+		{
+			u8 identifier[12];
+			u32 vkFormat;
+			u32 typeSize;
+			u32 pixelWidth;
+			u32 pixelHeight;
+			u32 pixelDepth;
+			u32 layerCount;
+			u32 faceCount;
+			u32 levelCount;
+			u32 supercompressionScheme;
+			u32 dfdByteOffset;
+			u32 dfdByteLength;
+			u32 kvdByteOffset;
+			u32 kvdByteLength;
+			u64 sgdByteOffset;
+			u64 sgdByteLength;
+		};
+		static_assert(sizeof(Ktx2Header) == 80);
+
+		struct Ktx2LevelIndex
+		{
+			u64 byteOffset;
+			u64 byteLength;
+			u64 uncompressedByteLength;
+		};
+
+		// Khronos data format descriptor values, only the block compressed models the cooker writes
+		enum : u8
+		{
+			KHR_DF_MODEL_BC1A = 128,
+			KHR_DF_MODEL_BC3 = 130,
+			KHR_DF_MODEL_BC4 = 131,
+			KHR_DF_MODEL_BC5 = 132,
+			KHR_DF_PRIMARIES_BT709 = 1,
+			KHR_DF_TRANSFER_LINEAR = 1,
+			KHR_DF_TRANSFER_SRGB = 2,
+			KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10,
+		};
+
+		struct DfdSample
+		{
+			u16 bitOffset;
+			u8 bitLength;		// minus one
+			u8 channelType;
+			u8 samplePosition[4];
+			u32 sampleLower;
+			u32 sampleUpper;
+		};
+		static_assert(sizeof(DfdSample) == 16);
+
+		struct BlockFormatInfo
+		{
+			u8 colorModel;
+			u8 blockBytes;
+			u8 sampleCount;
+			u8 channels[2];		// channel id per 64 bit half
+		};
+
+		bool GetBlockFormatInfo(vk::Format format, BlockFormatInfo& info)
+		{
+			switch (format)
+			{
+			case vk::Format::eBc1RgbUnormBlock:
+			case vk::Format::eBc1RgbSrgbBlock: info = { KHR_DF_MODEL_BC1A, 8, 1, { 0, 0 } }; return true;
+			case vk::Format::eBc3UnormBlock:
+			case vk::Format::eBc3SrgbBlock: info = { KHR_DF_MODEL_BC3, 16, 2, { 15, 0 } }; return true;	// alpha block, then colour
+			case vk::Format::eBc4UnormBlock: info = { KHR_DF_MODEL_BC4, 8, 1, { 0, 0 } }; return true;
+			case vk::Format::eBc5UnormBlock: info = { KHR_DF_MODEL_BC5, 16, 2, { 0, 1 } }; return true;
+			default: return false;
+			}
+		}
+
+		u64 AlignUp(u64 value, u64 alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		void AppendKeyValue(std::vector<u8>& kvd, const std::string& key, const std::string& value)
+		{
+			const u32 length = static_cast<u32>(key.size() + 1 + value.size() + 1);
+			const size_t start = kvd.size();
+			kvd.resize(AlignUp(start + sizeof(u32) + length, 4), 0);
+			memcpy(kvd.data() + start, &length, sizeof(u32));
+			memcpy(kvd.data() + start + sizeof(u32), key.c_str(), key.size() + 1);
+			memcpy(kvd.data() + start + sizeof(u32) + key.size() + 1, value.c_str(), value.size() + 1);
+		}
+	}
+
+	bool ReadKtx2(const std::string& path, Ktx2Image& image)
+	{
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in)
+			return false;
+
+		const size_t size = static_cast<size_t>(in.tellg());
+		image.data.resize(size);
+		in.seekg(0);
+		in.read(reinterpret_cast<char*>(image.data.data()), static_cast<std::streamsize>(size));
+		if (!in || size < sizeof(Ktx2Header))
+		{
+			printl(Log::LogLevel::Warn, "[KTX2] Failed to read {}", path);
+			return false;
+		}
+
+		Ktx2Header header;
+		memcpy(&header, image.data.data(), sizeof(header));
+		if (memcmp(header.identifier, kKtx2Identifier, sizeof(kKtx2Identifier)) != 0)
+		{
+			printl(Log::LogLevel::Warn, "[KTX2] {} is not a KTX2 file", path);
+			return false;
+		}
+		if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+			header.pixelWidth == 0 || header.pixelHeight == 0)
+		{
+			printl(Log::LogLevel::Warn, "[KTX2] {} uses unsupported features (supercompression, arrays, cubemaps or 3D)", path);
+			return false;
+		}
+
+		const u32 levelCount = std::max(header.levelCount, 1u);
+		if (sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex) > size)
+		{
+			printl(Log::LogLevel::Warn, "[KTX2] {} is truncated", path);
+			return false;
+		}
+
+		image.format = static_cast<vk::Format>(header.vkFormat);
+		image.width = header.pixelWidth;
+		image.height = header.pixelHeight;
+		image.levels.resize(levelCount);
+		for (u32 level = 0; level < levelCount; level++)
+		{
+			Ktx2LevelIndex index;
+			memcpy(&index, image.data.data() + sizeof(Ktx2Header) + level * sizeof(Ktx2LevelIndex), sizeof(index));
+			if (index.byteOffset > size || index.byteLength > size - index.byteOffset)
+			{
+				printl(Log::LogLevel::Warn, "[KTX2] {} level {} is out of bounds", path, level);
+				image.levels.clear();
+				return false;
+			}
+			image.levels[level] = { index.byteOffset, index.byteLength };
+		}
+
+		// key/value data, only the swizzle matters here
+		image.swizzle = "rgba";
+		if (header.kvdByteLength && header.kvdByteOffset <= size && header.kvdByteLength <= size - header.kvdByteOffset)
+		{
+			const u8* kvd = image.data.data() + header.kvdByteOffset;
+			u32 position = 0;
+			while (position + sizeof(u32) <= header.kvdByteLength)
+			{
+				u32 length;
+				memcpy(&length, kvd + position, sizeof(u32));
+				if (length > header.kvdByteLength - position - sizeof(u32))
+					break;
+
+				const char* entry = reinterpret_cast<const char*>(kvd + position + sizeof(u32));
+				const size_t keyLength = strnlen(entry, length);
+				if (keyLength < length && std::string_view(entry, keyLength) == "KTXswizzle" && length - keyLength - 1 >= 4)
+					image.swizzle.assign(entry + keyLength + 1, 4);
+
+				position = static_cast<u32>(AlignUp(position + sizeof(u32) + length, 4));
+			}
+		}
+		return true;
+	}
+
+	bool WriteKtx2(const std::string& path, const Ktx2Image& image, bool srgb)
+	{
+		BlockFormatInfo info;
+		if (!GetBlockFormatInfo(image.format, info) || image.levels.empty())
+		{
+			printl(Log::LogLevel::Error, "[KTX2] Can't write {}: format {} is not supported by the writer", path, vk::to_string(image.format));
+			return false;
+		}
+
+		// data format descriptor: total size, then one basic descriptor block with a sample per 64 bit half
+		std::vector<u8> dfd(sizeof(u32) + 24 + info.sampleCount * sizeof(DfdSample), 0);
+		{
+			const u32 totalSize = static_cast<u32>(dfd.size());
+			const u32 blockSize = totalSize - sizeof(u32);
+			const u32 descriptorType = 0;				// vendor khronos, basic format
+			const u32 versionAndSize = 2 | (blockSize << 16);
+			memcpy(dfd.data(), &totalSize, sizeof(u32));
+			memcpy(dfd.data() + 4, &descriptorType, sizeof(u32));
+			memcpy(dfd.data() + 8, &versionAndSize, sizeof(u32));
+			dfd[12] = info.colorModel;
+			dfd[13] = KHR_DF_PRIMARIES_BT709;
+			dfd[14] = srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR;
+			dfd[15] = 0;								// straight alpha
+			dfd[16] = 3;								// 4x4x1x1 texel block, stored minus one
+			dfd[17] = 3;
+			dfd[20] = info.blockBytes;					// bytesPlane0
+			for (u32 s = 0; s < info.sampleCount; s++)
+			{
+				DfdSample sample{};
+				sample.bitOffset = static_cast<u16>(s * 64);
+				sample.bitLength = 63;
+				sample.channelType = info.channels[s];
+				// alpha is never sRGB encoded
+				if (srgb && info.channels[s] == 15)
+					sample.channelType |= KHR_DF_SAMPLE_DATATYPE_LINEAR;
+				sample.sampleUpper = 0xFFFFFFFF;
+				memcpy(dfd.data() + 28 + s * sizeof(DfdSample), &sample, sizeof(sample));
+			}
+		}
+
+		// keys have to be sorted
+		std::vector<u8> kvd;
+		AppendKeyValue(kvd, "KTXswizzle", image.swizzle);
+		AppendKeyValue(kvd, "KTXwriter", "cravillac texture cooker");
+
+		const u32 levelCount = static_cast<u32>(image.levels.size());
+		Ktx2Header header{};
+		memcpy(header.identifier, kKtx2Identifier, sizeof(kKtx2Identifier));
+		header.vkFormat = static_cast<u32>(image.format);
+		header.typeSize = 1;
+		header.pixelWidth = image.width;
+		header.pixelHeight = image.height;
+		header.faceCount = 1;
+		header.levelCount = levelCount;
+		header.dfdByteOffset = static_cast<u32>(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex));
+		header.dfdByteLength = static_cast<u32>(dfd.size());
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = static_cast<u32>(kvd.size());
+
+		// smallest level first so a streamer could stop reading early, each level aligned to the block size
+		std::vector<Ktx2LevelIndex> levelIndex(levelCount);
+		u64 offset = header.kvdByteOffset + header.kvdByteLength;
+		for (u32 level = levelCount; level-- > 0;)
+		{
+			offset = AlignUp(offset, info.blockBytes);
+			levelIndex[level] = { offset, image.levels[level].size, image.levels[level].size };
+			offset += image.levels[level].size;
+		}
+
+		const std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				printl(Log::LogLevel::Warn, "[KTX2] Failed to open {} for writing", tempPath);
+				return false;
+			}
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(levelIndex.data()), static_cast<std::streamsize>(levelIndex.size() * sizeof(Ktx2LevelIndex)));
+			out.write(reinterpret_cast<const char*>(dfd.data()), static_cast<std::streamsize>(dfd.size()));
+			out.write(reinterpret_cast<const char*>(kvd.data()), static_cast<std::streamsize>(kvd.size()));
+			for (u32 level = levelCount; level-- > 0;)
+			{
+				static constexpr char zeros[16] = {};
+				const u64 position = static_cast<u64>(out.tellp());
+				out.write(zeros, static_cast<std::streamsize>(levelIndex[level].byteOffset - position));
+				out.write(reinterpret_cast<const char*>(image.data.data() + image.levels[level].offset), static_cast<std::streamsize>(image.levels[level].size));
+			}
+
+			if (!out)
+			{
+				printl(Log::LogLevel::Warn, "[KTX2] Failed writing {}", tempPath);
+				return false;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, path, ec);
+		if (ec)
+		{
+			printl(Log::LogLevel::Warn, "[KTX2] Failed to move {} into place: {}", tempPath, ec.message());
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+		return true;
+	}
+
+	vk::ComponentMapping Ktx2Swizzle(const std::string& swizzle)
+	{
+		auto component = [](char c)
+		{
+			switch (c)
+			{
+			case 'r': return vk::ComponentSwizzle::eR;
+			case 'g': return vk::ComponentSwizzle::eG;
+			case 'b': return vk::ComponentSwizzle::eB;
+			case 'a': return vk::ComponentSwizzle::eA;
+			case '0': return vk::ComponentSwizzle::eZero;
+			case '1': return vk::ComponentSwizzle::eOne;
+			default: return vk::ComponentSwizzle::eIdentity;
+			}
+		};
+		if (swizzle.size() < 4)
+			return {};
+		return { component(swizzle[0]), component(swizzle[1]), component(swizzle[2]), component(swizzle[3]) };
+	}
+}
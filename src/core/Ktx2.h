@@ -0,0 +1,45 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+
+// minimal KTX2 container support: single 2D image (no layers/faces/depth), no supercompression. Enough for what the
+// texture cooker writes (BC1/BC3/BC4/BC5 with a full mip chain) and for anything else that sticks to that subset.
+// Level data is kept exactly as it sits in the file so the runtime can copy it straight into a staging buffer.
+
+namespace CV
+{
+	struct Ktx2Level
+	{
+		u64 offset;		// into Ktx2Image::data
+		u64 size;
+	};
+
+	struct Ktx2Image
+	{
+		vk::Format format = vk::Format::eUndefined;
+		u32 width = 0;
+		u32 height = 0;
+		std::vector<Ktx2Level> levels;	// level 0 (full size) first
+		std::vector<u8> data;
+		// KTXswizzle metadata, one of r g b a 0 1 per output channel. Formats that pack channels (BC5 metallic
+		// roughness) rely on it to read back the way the shader expects
+		std::string swizzle = "rgba";
+
+		[[nodiscard]] bool Empty() const { return levels.empty(); }
+	};
+
+	bool ReadKtx2(const std::string& path, Ktx2Image& image);
+
+	// srgb only selects the transfer function in the data format descriptor, the vk::Format already carries it
+	bool WriteKtx2(const std::string& path, const Ktx2Image& image, bool srgb);
+
+	// KTXswizzle string -> view component mapping
+	vk::ComponentMapping Ktx2Swizzle(const std::string& swizzle);
+}
+
+#endif
@@ -0,0 +1,407 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+
+#include "MemoryAllocator.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	MemoryAllocator::MemoryAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize)
+		: m_device(device), m_memoryProperties(physicalDevice.getMemoryProperties()), m_blockSize(blockSize)
+	{
+	}
+
+	MemoryAllocator::~MemoryAllocator()
+	{
+		// dedicated allocations belong to their owners, blocks are ours
+		for (Pool& pool : m_pools)
+		{
+			for (Block& block : pool.blocks)
+			{
+				if (block.memory)
+					m_device.freeMemory(block.memory);
+			}
+		}
+	}
+
+	Allocation MemoryAllocator::allocateForBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags properties)
+	{
+		vk::BufferMemoryRequirementsInfo2 info{ buffer };
+		vk::MemoryDedicatedRequirements dedicatedRequirements{};
+		vk::MemoryRequirements2 requirements{};
+		requirements.pNext = &dedicatedRequirements;
+		m_device.getBufferMemoryRequirements2(&info, &requirements);
+
+		const bool dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+		Allocation allocation = allocate(requirements.memoryRequirements, properties, true, dedicated, buffer, VK_NULL_HANDLE);
+		if (allocation)
+			m_device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	Allocation MemoryAllocator::allocateForImage(vk::Image image, vk::MemoryPropertyFlags properties)
+	{
+		vk::ImageMemoryRequirementsInfo2 info{ image };
+		vk::MemoryDedicatedRequirements dedicatedRequirements{};
+		vk::MemoryRequirements2 requirements{};
+		requirements.pNext = &dedicatedRequirements;
+		m_device.getImageMemoryRequirements2(&info, &requirements);
+
+		const bool dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+		Allocation allocation = allocate(requirements.memoryRequirements, properties, false, dedicated, VK_NULL_HANDLE, image);
+		if (allocation)
+			m_device.bindImageMemory(image, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	Allocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear,
+		bool dedicated, vk::Buffer dedicatedBuffer, vk::Image dedicatedImage)
+	{
+		std::optional<u32> memoryType;
+		for (u32 i = 0; !memoryType && i < m_memoryProperties.memoryTypeCount; i++)
+		{
+			if ((requirements.memoryTypeBits & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+				memoryType = i;
+		}
+		if (!memoryType)
+		{
+			printl(Log::LogLevel::Error, "[MEMORY] No memory type found for {}", vk::to_string(properties));
+			return {};
+		}
+
+		std::lock_guard lock(m_mutex);
+
+		// big resources would only fragment the blocks, and a block sized allocation has nothing to share anyway
+		if (dedicated || requirements.size >= m_blockSize / 2)
+			return allocateDedicated(requirements, memoryType.value(), dedicatedBuffer, dedicatedImage);
+
+		const u32 poolIndex = getPool(memoryType.value(), linear);
+		Pool& pool = m_pools[poolIndex];
+
+		const vk::DeviceSize size = AlignUp(requirements.size, kGranularity);
+		const vk::DeviceSize alignment = std::max(requirements.alignment, kGranularity);
+		// node offsets are already granularity aligned, larger alignments may need that much padding in front
+		const vk::DeviceSize searchSize = size + alignment - kGranularity;
+
+		u32 nodeIndex = findFree(pool, searchSize);
+		if (nodeIndex == kNull)
+		{
+			// sized for the list findFree searches, not just searchSize, so the second lookup can't miss
+			if (!createBlock(pool, poolIndex, roundUpSearchSize(searchSize)))
+				return {};
+			nodeIndex = findFree(pool, searchSize);
+			if (nodeIndex == kNull)
+			{
+				printl(Log::LogLevel::Error, "[MEMORY] No free range of {} bytes in a new block of pool {}", searchSize, poolIndex);
+				return {};
+			}
+		}
+		removeFree(pool, nodeIndex);
+
+		// the padding in front goes back into the free lists as its own node
+		const vk::DeviceSize padding = AlignUp(pool.nodes[nodeIndex].offset, alignment) - pool.nodes[nodeIndex].offset;
+		if (padding)
+		{
+			const u32 front = createNode(pool);
+			Node& node = pool.nodes[nodeIndex];
+			pool.nodes[front] = { node.offset, padding, node.block, node.prevPhysical, nodeIndex };
+			if (node.prevPhysical != kNull)
+				pool.nodes[node.prevPhysical].nextPhysical = front;
+			node.prevPhysical = front;
+			node.offset += padding;
+			node.size -= padding;
+			insertFree(pool, front);
+		}
+
+		// and so does whatever is left behind it
+		if (pool.nodes[nodeIndex].size > size)
+		{
+			const u32 back = createNode(pool);
+			Node& node = pool.nodes[nodeIndex];
+			pool.nodes[back] = { node.offset + size, node.size - size, node.block, nodeIndex, node.nextPhysical };
+			if (node.nextPhysical != kNull)
+				pool.nodes[node.nextPhysical].prevPhysical = back;
+			node.nextPhysical = back;
+			node.size = size;
+			insertFree(pool, back);
+		}
+
+		const Node& node = pool.nodes[nodeIndex];
+		const Block& block = pool.blocks[node.block];
+		m_allocationCount++;
+		m_usedBytes += node.size;
+
+		Allocation allocation;
+		allocation.memory = block.memory;
+		allocation.offset = node.offset;
+		allocation.size = node.size;
+		allocation.mapped = block.mapped ? block.mapped + node.offset : nullptr;
+		allocation.pool = poolIndex;
+		allocation.node = nodeIndex;
+		return allocation;
+	}
+
+	Allocation MemoryAllocator::allocateDedicated(const vk::MemoryRequirements& requirements, u32 memoryType, vk::Buffer buffer, vk::Image image)
+	{
+		vk::MemoryDedicatedAllocateInfo dedicatedInfo{};
+		dedicatedInfo.buffer = buffer;
+		dedicatedInfo.image = image;
+
+		Allocation allocation;
+		allocation.memory = allocateMemory(requirements.size, memoryType, static_cast<bool>(buffer), &dedicatedInfo);
+		if (!allocation.memory)
+			return {};
+
+		allocation.size = requirements.size;
+		if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+			allocation.mapped = static_cast<u8*>(m_device.mapMemory(allocation.memory, 0, VK_WHOLE_SIZE));
+
+		m_dedicatedCount++;
+		m_dedicatedBytes += allocation.size;
+		m_allocationCount++;
+		m_usedBytes += allocation.size;
+		return allocation;
+	}
+
+	void MemoryAllocator::free(Allocation& allocation)
+	{
+		if (!allocation)
+			return;
+
+		std::lock_guard lock(m_mutex);
+		m_allocationCount--;
+		m_usedBytes -= allocation.size;
+
+		if (allocation.pool == kNull)
+		{
+			m_dedicatedCount--;
+			m_dedicatedBytes -= allocation.size;
+			m_device.freeMemory(allocation.memory);
+			allocation = {};
+			return;
+		}
+
+		Pool& pool = m_pools[allocation.pool];
+		u32 nodeIndex = allocation.node;
+
+		// merge with free physical neighbours, the merged away node goes back to the node free list
+		const u32 prev = pool.nodes[nodeIndex].prevPhysical;
+		if (prev != kNull && pool.nodes[prev].free)
+		{
+			removeFree(pool, prev);
+			Node& node = pool.nodes[nodeIndex];
+			node.offset = pool.nodes[prev].offset;
+			node.size += pool.nodes[prev].size;
+			node.prevPhysical = pool.nodes[prev].prevPhysical;
+			if (node.prevPhysical != kNull)
+				pool.nodes[node.prevPhysical].nextPhysical = nodeIndex;
+			pool.unusedNodes.push_back(prev);
+		}
+		const u32 next = pool.nodes[nodeIndex].nextPhysical;
+		if (next != kNull && pool.nodes[next].free)
+		{
+			removeFree(pool, next);
+			Node& node = pool.nodes[nodeIndex];
+			node.size += pool.nodes[next].size;
+			node.nextPhysical = pool.nodes[next].nextPhysical;
+			if (node.nextPhysical != kNull)
+				pool.nodes[node.nextPhysical].prevPhysical = nodeIndex;
+			pool.unusedNodes.push_back(next);
+		}
+
+		// empty blocks stay around for the next allocation, loading is bursty
+		insertFree(pool, nodeIndex);
+		allocation = {};
+	}
+
+	MemoryStats MemoryAllocator::getStats()
+	{
+		std::lock_guard lock(m_mutex);
+		MemoryStats stats;
+		stats.dedicatedCount = m_dedicatedCount;
+		stats.allocationCount = m_allocationCount;
+		stats.usedBytes = m_usedBytes;
+		stats.reservedBytes = m_dedicatedBytes;
+		for (const Pool& pool : m_pools)
+		{
+			stats.blockCount += static_cast<u32>(pool.blocks.size());
+			for (const Block& block : pool.blocks)
+				stats.reservedBytes += block.size;
+		}
+		return stats;
+	}
+
+	void MemoryAllocator::logStats()
+	{
+		const MemoryStats stats = getStats();
+		printl(Log::LogLevel::InfoDebug, "[MEMORY] {} allocations in {} blocks + {} dedicated ({} vkAllocateMemory), {:.1f} / {:.1f} MiB used",
+			stats.allocationCount, stats.blockCount, stats.dedicatedCount, stats.blockCount + stats.dedicatedCount,
+			stats.usedBytes / (1024.0 * 1024.0), stats.reservedBytes / (1024.0 * 1024.0));
+	}
+
+	bool MemoryAllocator::createBlock(Pool& pool, u32 poolIndex, vk::DeviceSize minSize)
+	{
+		Block block;
+		block.size = std::max(m_blockSize, AlignUp(minSize, kGranularity));
+		// every linear block may end up behind a device address buffer
+		block.memory = allocateMemory(block.size, pool.memoryType, pool.linear, nullptr);
+		if (!block.memory)
+			return false;
+
+		if (m_memoryProperties.memoryTypes[pool.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+			block.mapped = static_cast<u8*>(m_device.mapMemory(block.memory, 0, VK_WHOLE_SIZE));
+
+		const u32 blockIndex = static_cast<u32>(pool.blocks.size());
+		pool.blocks.push_back(block);
+
+		const u32 nodeIndex = createNode(pool);
+		pool.nodes[nodeIndex] = { 0, block.size, blockIndex };
+		insertFree(pool, nodeIndex);
+
+		printl(Log::LogLevel::InfoDebug, "[MEMORY] New {} MiB block for memory type {} ({}), pool {}", block.size >> 20, pool.memoryType,
+			pool.linear ? "buffers" : "images", poolIndex);
+		return true;
+	}
+
+	vk::DeviceMemory MemoryAllocator::allocateMemory(vk::DeviceSize size, u32 memoryType, bool deviceAddress, const void* pNext)
+	{
+		vk::MemoryAllocateFlagsInfo allocFlagsInfo{};
+		allocFlagsInfo.pNext = pNext;
+		allocFlagsInfo.flags = deviceAddress ? vk::MemoryAllocateFlagBits::eDeviceAddress : vk::MemoryAllocateFlags{};
+
+		vk::MemoryAllocateInfo allocInfo{};
+		allocInfo.pNext = &allocFlagsInfo;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		vk::DeviceMemory memory{};
+		try
+		{
+			memory = m_device.allocateMemory(allocInfo);
+		}
+		catch (vk::SystemError& err)
+		{
+			printl(Log::LogLevel::Error, "[MEMORY] Failed to allocate {} bytes from memory type {}: {}", size, memoryType, std::string(err.what()));
+		}
+		return memory;
+	}
+
+	u32 MemoryAllocator::getPool(u32 memoryType, bool linear)
+	{
+		for (u32 i = 0; i < m_pools.size(); i++)
+		{
+			if (m_pools[i].memoryType == memoryType && m_pools[i].linear == linear)
+				return i;
+		}
+		Pool& pool = m_pools.emplace_back();
+		pool.memoryType = memoryType;
+		pool.linear = linear;
+		for (auto& row : pool.freeHeads)
+			row.fill(kNull);
+		return static_cast<u32>(m_pools.size() - 1);
+	}
+
+	u32 MemoryAllocator::createNode(Pool& pool)
+	{
+		if (!pool.unusedNodes.empty())
+		{
+			const u32 index = pool.unusedNodes.back();
+			pool.unusedNodes.pop_back();
+			pool.nodes[index] = {};
+			return index;
+		}
+		pool.nodes.emplace_back();
+		return static_cast<u32>(pool.nodes.size() - 1);
+	}
+
+	void MemoryAllocator::mappingInsert(vk::DeviceSize size, u32& fl, u32& sl)
+	{
+		if (size < (1ull << kFlShift))
+		{
+			fl = 0;
+			sl = static_cast<u32>(size / ((1ull << kFlShift) / kSlCount));
+			return;
+		}
+		const u32 msb = 63 - static_cast<u32>(std::countl_zero(size));
+		sl = static_cast<u32>(size >> (msb - kSlLog2)) ^ kSlCount;
+		fl = msb - kFlShift + 1;
+	}
+
+	void MemoryAllocator::insertFree(Pool& pool, u32 nodeIndex)
+	{
+		u32 fl, sl;
+		mappingInsert(pool.nodes[nodeIndex].size, fl, sl);
+
+		Node& node = pool.nodes[nodeIndex];
+		node.free = true;
+		node.prevFree = kNull;
+		node.nextFree = pool.freeHeads[fl][sl];
+		if (node.nextFree != kNull)
+			pool.nodes[node.nextFree].prevFree = nodeIndex;
+		pool.freeHeads[fl][sl] = nodeIndex;
+		pool.flBitmap |= 1ull << fl;
+		pool.slBitmap[fl] |= 1u << sl;
+	}
+
+	void MemoryAllocator::removeFree(Pool& pool, u32 nodeIndex)
+	{
+		u32 fl, sl;
+		mappingInsert(pool.nodes[nodeIndex].size, fl, sl);
+
+		Node& node = pool.nodes[nodeIndex];
+		if (node.prevFree != kNull)
+			pool.nodes[node.prevFree].nextFree = node.nextFree;
+		else
+			pool.freeHeads[fl][sl] = node.nextFree;
+		if (node.nextFree != kNull)
+			pool.nodes[node.nextFree].prevFree = node.prevFree;
+		node.free = false;
+		node.prevFree = node.nextFree = kNull;
+
+		if (pool.freeHeads[fl][sl] == kNull)
+		{
+			pool.slBitmap[fl] &= ~(1u << sl);
+			if (!pool.slBitmap[fl])
+				pool.flBitmap &= ~(1ull << fl);
+		}
+	}
+
+	vk::DeviceSize MemoryAllocator::roundUpSearchSize(vk::DeviceSize size)
+	{
+		// round up to the next list boundary so anything in the list found is big enough (good fit, not best fit)
+		if (size >= (1ull << kFlShift))
+			size += (1ull << (63 - std::countl_zero(size) - kSlLog2)) - 1;
+		return size;
+	}
+
+	u32 MemoryAllocator::findFree(Pool& pool, vk::DeviceSize size) const
+	{
+		u32 fl, sl;
+		mappingInsert(roundUpSearchSize(size), fl, sl);
+		if (fl >= kFlCount)
+			return kNull;
+
+		u32 slMap = pool.slBitmap[fl] & (~0u << sl);
+		if (!slMap)
+		{
+			const u64 flMap = fl + 1 < 64 ? pool.flBitmap & (~0ull << (fl + 1)) : 0;
+			if (!flMap)
+				return kNull;
+			fl = static_cast<u32>(std::countr_zero(flMap));
+			slMap = pool.slBitmap[fl];
+		}
+		sl = static_cast<u32>(std::countr_zero(slMap));
+		return pool.freeHeads[fl][sl];
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#include <array>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+
+// device memory sub-allocator. Resources are placed inside large vk::DeviceMemory blocks (one pool per memory type,
+// split into linear (buffers) and optimal (images) so bufferImageGranularity never has to be considered), and the free
+// ranges of every pool are tracked with a two level segregated fit (TLSF) free list: O(1) allocate and free,
+// neighbours merge on free so the space is reused. Big images and anything the driver wants dedicated get their own
+// vkAllocateMemory. Host visible blocks stay mapped for their whole lifetime, use Allocation::mapped.
+
+namespace CV
+{
+	struct Allocation
+	{
+		vk::DeviceMemory memory = VK_NULL_HANDLE;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+		u8* mapped = nullptr;		// null unless the memory is host visible
+		u32 pool = ~0u;				// ~0u for dedicated allocations
+		u32 node = ~0u;
+
+		explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+	};
+
+	struct MemoryStats
+	{
+		u32 blockCount = 0;
+		u32 dedicatedCount = 0;
+		u32 allocationCount = 0;
+		vk::DeviceSize reservedBytes = 0;	// blocks + dedicated
+		vk::DeviceSize usedBytes = 0;
+	};
+
+	class MemoryAllocator
+	{
+	public:
+		MemoryAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize = 64ull << 20);
+		~MemoryAllocator();
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		// allocates and binds. An empty Allocation means failure (already logged)
+		Allocation allocateForBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags properties);
+		Allocation allocateForImage(vk::Image image, vk::MemoryPropertyFlags properties);
+		void free(Allocation& allocation);
+
+		[[nodiscard]] MemoryStats getStats();
+		void logStats();
+
+	private:
+		static constexpr u32 kSlLog2 = 4;
+		static constexpr u32 kSlCount = 1u << kSlLog2;
+		static constexpr u32 kFlShift = 8;					// sizes below 256 bytes share the first row
+		static constexpr u32 kFlCount = 40 - kFlShift + 1;	// up to 1 TiB
+		static constexpr vk::DeviceSize kGranularity = 256;	// every node offset/size is a multiple of this
+		static constexpr u32 kNull = ~0u;
+
+		struct Node
+		{
+			vk::DeviceSize offset = 0;
+			vk::DeviceSize size = 0;
+			u32 block = 0;
+			u32 prevPhysical = kNull;
+			u32 nextPhysical = kNull;
+			u32 prevFree = kNull;
+			u32 nextFree = kNull;
+			bool free = false;
+		};
+
+		struct Block
+		{
+			vk::DeviceMemory memory = VK_NULL_HANDLE;
+			vk::DeviceSize size = 0;
+			u8* mapped = nullptr;
+		};
+
+		struct Pool
+		{
+			u32 memoryType = 0;
+			bool linear = true;
+			std::vector<Block> blocks;
+			std::vector<Node> nodes;
+			std::vector<u32> unusedNodes;
+			u64 flBitmap = 0;
+			std::array<u32, kFlCount> slBitmap{};
+			std::array<std::array<u32, kSlCount>, kFlCount> freeHeads{};
+		};
+
+		Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear,
+			bool dedicated, vk::Buffer dedicatedBuffer, vk::Image dedicatedImage);
+		Allocation allocateDedicated(const vk::MemoryRequirements& requirements, u32 memoryType, vk::Buffer buffer, vk::Image image);
+		bool createBlock(Pool& pool, u32 poolIndex, vk::DeviceSize minSize);
+		vk::DeviceMemory allocateMemory(vk::DeviceSize size, u32 memoryType, bool deviceAddress, const void* pNext);
+
+		u32 getPool(u32 memoryType, bool linear);
+		u32 createNode(Pool& pool);
+		void insertFree(Pool& pool, u32 nodeIndex);
+		void removeFree(Pool& pool, u32 nodeIndex);
+		u32 findFree(Pool& pool, vk::DeviceSize size) const;
+		static void mappingInsert(vk::DeviceSize size, u32& fl, u32& sl);
+		// size rounded up so that every free list findFree may pick for it only holds nodes at least that big
+		static vk::DeviceSize roundUpSearchSize(vk::DeviceSize size);
+
+		vk::Device m_device;
+		vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+		vk::DeviceSize m_blockSize;
+		std::vector<Pool> m_pools;
+		u32 m_dedicatedCount = 0;
+		vk::DeviceSize m_dedicatedBytes = 0;
+		u32 m_allocationCount = 0;
+		vk::DeviceSize m_usedBytes = 0;
+		std::mutex m_mutex;
+	};
+}
+
+#endif
@@ -0,0 +1,453 @@
+#include <pch.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MeshCache.h"
+#include "Log.h"
+
+namespace CV
+{
+	static_assert(std::is_trivially_copyable_v<Vertex>);
+	static_assert(std::is_trivially_copyable_v<MeshInfo>);
+	static_assert(std::is_trivially_copyable_v<MeshInstance>);
+	static_assert(std::is_trivially_copyable_v<CookedMaterial>);
+	static_assert(std::is_trivially_copyable_v<Meshlet>);
+
+	namespace
+	{
+		constexpr u64 kSectionAlignment = 16;
+
+		u64 AlignUp(u64 value, u64 alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		bool GetFileStamp(const std::filesystem::path& path, u64& size, i64& writeTime)
+		{
+			std::error_code ec;
+			size = std::filesystem::file_size(path, ec);
+			if (ec)
+				return false;
+			auto time = std::filesystem::last_write_time(path, ec);
+			if (ec)
+				return false;
+			writeTime = static_cast<i64>(time.time_since_epoch().count());
+			return true;
+		}
+
+		template <typename T>
+		std::span<const T> SectionView(const u8* base, u64 offset, u64 count)
+		{
+			return { reinterpret_cast<const T*>(base + offset), static_cast<size_t>(count) };
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		m_file = file;
+		m_mapping = mapping;
+		m_data = static_cast<const u8*>(view);
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st{};
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+
+		m_fd = fd;
+		m_data = static_cast<const u8*>(view);
+		m_size = static_cast<size_t>(st.st_size);
+#endif
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (!m_data)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		m_mapping = nullptr;
+		m_file = nullptr;
+#else
+		munmap(const_cast<u8*>(m_data), m_size);
+		close(m_fd);
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	std::string MeshCache::GetCachePath(const std::string& sourcePath)
+	{
+		return std::filesystem::path(sourcePath).replace_extension(".cvmesh").string();
+	}
+
+	u64 MeshCache::HashFile(const std::string& path)
+	{
+		// FNV-1a, the .gltf itself is only json so this is cheap. External buffers are covered by the dependency table
+		MappedFile file;
+		if (!file.Open(path))
+			return 0;
+
+		u64 hash = 0xcbf29ce484222325ull;
+		const u8* data = file.Data();
+		for (size_t i = 0; i < file.Size(); i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	bool MeshCache::Open(const std::string& cachePath, u64 sourceHash, const std::string& dirPath)
+	{
+		if (!m_file.Open(cachePath))
+			return false;
+
+		const u8* base = m_file.Data();
+		const size_t size = m_file.Size();
+
+		if (size < sizeof(CookedModelHeader))
+		{
+			Close();
+			return false;
+		}
+
+		CookedModelHeader header;
+		memcpy(&header, base, sizeof(header));
+
+		if (header.magic != kCookedModelMagic || header.version != kImporterVersion || header.sourceHash != sourceHash)
+		{
+			printl(Log::LogLevel::InfoDebug, "[CACHE] {} is stale, re-importing", cachePath);
+			Close();
+			return false;
+		}
+
+		// divided rather than multiplied, a corrupt count could overflow count * stride and pass
+		auto sectionFits = [size](u64 offset, u64 count, u64 stride) { return offset <= size && count <= (size - offset) / stride; };
+		if (!sectionFits(header.dependencyOffset, header.dependencyCount, sizeof(CookedDependency)) ||
+			!sectionFits(header.vertexOffset, header.vertexCount, sizeof(Vertex)) ||
+			!sectionFits(header.indexOffset, header.indexCount, sizeof(u32)) ||
+			!sectionFits(header.meshOffset, header.meshCount, sizeof(MeshInfo)) ||
+			!sectionFits(header.instanceOffset, header.instanceCount, sizeof(MeshInstance)) ||
+			!sectionFits(header.materialOffset, header.materialCount, sizeof(CookedMaterial)) ||
+			!sectionFits(header.meshletOffset, header.meshletCount, sizeof(Meshlet)) ||
+			!sectionFits(header.meshletVertexOffset, header.meshletVertexCount, sizeof(u32)) ||
+			!sectionFits(header.meshletTriangleOffset, header.meshletTriangleBytes, 1) ||
+			header.textureOffset > size)
+		{
+			printl(Log::LogLevel::Warn, "[CACHE] {} is truncated", cachePath);
+			Close();
+			return false;
+		}
+
+		for (const CookedDependency& dependency : SectionView<CookedDependency>(base, header.dependencyOffset, header.dependencyCount))
+		{
+			if (!memchr(dependency.path, 0, sizeof(dependency.path)))
+			{
+				printl(Log::LogLevel::Warn, "[CACHE] {} has a broken dependency table", cachePath);
+				Close();
+				return false;
+			}
+
+			u64 depSize = 0;
+			i64 depTime = 0;
+			std::filesystem::path depPath = std::filesystem::path(dirPath) / dependency.path;
+			if (!GetFileStamp(depPath, depSize, depTime) || depSize != dependency.size || depTime != dependency.writeTime)
+			{
+				printl(Log::LogLevel::InfoDebug, "[CACHE] Dependency {} changed, re-importing", dependency.path);
+				Close();
+				return false;
+			}
+		}
+
+		vertices = SectionView<Vertex>(base, header.vertexOffset, header.vertexCount);
+		indices = SectionView<u32>(base, header.indexOffset, header.indexCount);
+		meshes = SectionView<MeshInfo>(base, header.meshOffset, header.meshCount);
+		instances = SectionView<MeshInstance>(base, header.instanceOffset, header.instanceCount);
+		materials = SectionView<CookedMaterial>(base, header.materialOffset, header.materialCount);
+		meshlets.meshlets = SectionView<Meshlet>(base, header.meshletOffset, header.meshletCount);
+		meshlets.vertices = SectionView<u32>(base, header.meshletVertexOffset, header.meshletVertexCount);
+		meshlets.triangles = SectionView<u8>(base, header.meshletTriangleOffset, header.meshletTriangleBytes);
+
+		// texture table: u32 length + chars, per texture
+		texturePaths.clear();
+		texturePaths.reserve(header.textureCount);
+		u64 cursor = header.textureOffset;
+		for (u64 i = 0; i < header.textureCount; i++)
+		{
+			u32 length = 0;
+			if (cursor + sizeof(length) > size)
+				break;
+			memcpy(&length, base + cursor, sizeof(length));
+			cursor += sizeof(length);
+			if (cursor + length > size)
+				break;
+			texturePaths.emplace_back(reinterpret_cast<const char*>(base + cursor), length);
+			cursor += length;
+		}
+
+		if (texturePaths.size() != header.textureCount)
+		{
+			printl(Log::LogLevel::Warn, "[CACHE] {} has a broken texture table", cachePath);
+			Close();
+			return false;
+		}
+
+		if (!ContentsInRange())
+		{
+			printl(Log::LogLevel::Warn, "[CACHE] {} has out of range contents, re-importing", cachePath);
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool MeshCache::ContentsInRange() const
+	{
+		// u64 throughout, the sums of two u32 fields can't wrap
+		auto rangeFits = [](u64 first, u64 count, u64 size) { return first <= size && count <= size - first; };
+
+		for (u32 meshIndex = 0; meshIndex < meshes.size(); meshIndex++)
+		{
+			const MeshInfo& mesh = meshes[meshIndex];
+			if (!rangeFits(mesh.startVertex, mesh.vertexCount, vertices.size()) ||
+				!rangeFits(mesh.startIndex, mesh.indexCount, indices.size()) ||
+				!rangeFits(mesh.instanceOffset, mesh.instanceCount, instances.size()) ||
+				!rangeFits(mesh.meshletOffset, mesh.meshletCount, meshlets.meshlets.size()) ||
+				mesh.lodCount == 0 || mesh.lodCount > MAX_LODS)
+				return false;
+
+			// indices are relative to startVertex (the draws pass it as vertexOffset)
+			for (u32 lod = 0; lod < mesh.lodCount; lod++)
+			{
+				if (!rangeFits(mesh.lods[lod].startIndex, mesh.lods[lod].indexCount, indices.size()))
+					return false;
+				for (u32 index : indices.subspan(mesh.lods[lod].startIndex, mesh.lods[lod].indexCount))
+				{
+					if (index >= mesh.vertexCount)
+						return false;
+				}
+			}
+
+			// instances are sorted by mesh, the range has to hold exactly this mesh's ones
+			for (const MeshInstance& instance : instances.subspan(mesh.instanceOffset, mesh.instanceCount))
+			{
+				if (instance.meshIndex != meshIndex)
+					return false;
+			}
+		}
+
+		for (const MeshInstance& instance : instances)
+		{
+			if (instance.meshIndex >= meshes.size() || instance.materialIndex >= materials.size())
+				return false;
+		}
+
+		// -1 is no texture, anything else indexes the texture table
+		auto textureFits = [this](u32 textureIndex) { return textureIndex == u32(-1) || textureIndex < texturePaths.size(); };
+		for (const CookedMaterial& material : materials)
+		{
+			if (!textureFits(material.albedoIndex) || !textureFits(material.normalIndex) || !textureFits(material.metallicIndex) ||
+				!textureFits(material.emissiveIndex))
+				return false;
+		}
+
+		// the mesh shader sizes its outputs for the limits, triangle bytes index the meshlet's own vertices
+		for (const Meshlet& meshlet : meshlets.meshlets)
+		{
+			if (meshlet.vertexCount > MESHLET_MAX_VERTICES || meshlet.triangleCount > MESHLET_MAX_TRIANGLES ||
+				!rangeFits(meshlet.vertexOffset, meshlet.vertexCount, meshlets.vertices.size()) ||
+				!rangeFits(meshlet.triangleOffset, u64(meshlet.triangleCount) * 3, meshlets.triangles.size()))
+				return false;
+			for (u8 vertex : meshlets.triangles.subspan(meshlet.triangleOffset, meshlet.triangleCount * 3))
+			{
+				if (vertex >= meshlet.vertexCount)
+					return false;
+			}
+		}
+		// already offset by the mesh's startVertex, so against the whole vertex section
+		for (u32 vertex : meshlets.vertices)
+		{
+			if (vertex >= vertices.size())
+				return false;
+		}
+		return true;
+	}
+
+	bool MeshCache::Write(const std::string& cachePath, u64 sourceHash, const std::string& dirPath,
+		const std::vector<std::string>& dependencies, std::span<const Vertex> vertices, std::span<const u32> indices,
+		std::span<const MeshInfo> meshes, std::span<const MeshInstance> instances, std::span<const CookedMaterial> materials, const CookedMeshlets& meshlets,
+		const std::vector<std::string>& texturePaths)
+	{
+		std::vector<CookedDependency> cookedDependencies;
+		for (const auto& dependency : dependencies)
+		{
+			CookedDependency cooked{};
+			if (dependency.size() >= sizeof(cooked.path) ||
+				!GetFileStamp(std::filesystem::path(dirPath) / dependency, cooked.size, cooked.writeTime))
+			{
+				printl(Log::LogLevel::Warn, "[CACHE] Can't track dependency {}, not writing cache", dependency);
+				return false;
+			}
+			memcpy(cooked.path, dependency.data(), dependency.size());
+			cookedDependencies.push_back(cooked);
+		}
+
+		CookedModelHeader header{};
+		header.magic = kCookedModelMagic;
+		header.version = kImporterVersion;
+		header.sourceHash = sourceHash;
+		header.dependencyCount = cookedDependencies.size();
+		header.vertexCount = vertices.size();
+		header.indexCount = indices.size();
+		header.meshCount = meshes.size();
+		header.instanceCount = instances.size();
+		header.materialCount = materials.size();
+		header.meshletCount = meshlets.meshlets.size();
+		header.meshletVertexCount = meshlets.vertices.size();
+		header.meshletTriangleBytes = meshlets.triangles.size();
+		header.textureCount = texturePaths.size();
+
+		u64 offset = AlignUp(sizeof(header), kSectionAlignment);
+		header.dependencyOffset = offset;
+		offset = AlignUp(offset + cookedDependencies.size() * sizeof(CookedDependency), kSectionAlignment);
+		header.vertexOffset = offset;
+		offset = AlignUp(offset + vertices.size_bytes(), kSectionAlignment);
+		header.indexOffset = offset;
+		offset = AlignUp(offset + indices.size_bytes(), kSectionAlignment);
+		header.meshOffset = offset;
+		offset = AlignUp(offset + meshes.size_bytes(), kSectionAlignment);
+		header.instanceOffset = offset;
+		offset = AlignUp(offset + instances.size_bytes(), kSectionAlignment);
+		header.materialOffset = offset;
+		offset = AlignUp(offset + materials.size_bytes(), kSectionAlignment);
+		header.meshletOffset = offset;
+		offset = AlignUp(offset + meshlets.meshlets.size_bytes(), kSectionAlignment);
+		header.meshletVertexOffset = offset;
+		offset = AlignUp(offset + meshlets.vertices.size_bytes(), kSectionAlignment);
+		header.meshletTriangleOffset = offset;
+		offset = AlignUp(offset + meshlets.triangles.size_bytes(), kSectionAlignment);
+		header.textureOffset = offset;
+
+		// write to a temp file and rename, so a crash mid write never leaves a half cache behind
+		const std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				printl(Log::LogLevel::Warn, "[CACHE] Failed to open {} for writing", tempPath);
+				return false;
+			}
+
+			auto writeSection = [&out](u64 sectionOffset, const void* data, size_t bytes)
+			{
+				static constexpr char zeros[kSectionAlignment] = {};
+				u64 position = static_cast<u64>(out.tellp());
+				if (sectionOffset > position)
+					out.write(zeros, static_cast<std::streamsize>(sectionOffset - position));
+				if (bytes)
+					out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+			};
+
+			writeSection(0, &header, sizeof(header));
+			writeSection(header.dependencyOffset, cookedDependencies.data(), cookedDependencies.size() * sizeof(CookedDependency));
+			writeSection(header.vertexOffset, vertices.data(), vertices.size_bytes());
+			writeSection(header.indexOffset, indices.data(), indices.size_bytes());
+			writeSection(header.meshOffset, meshes.data(), meshes.size_bytes());
+			writeSection(header.instanceOffset, instances.data(), instances.size_bytes());
+			writeSection(header.materialOffset, materials.data(), materials.size_bytes());
+			writeSection(header.meshletOffset, meshlets.meshlets.data(), meshlets.meshlets.size_bytes());
+			writeSection(header.meshletVertexOffset, meshlets.vertices.data(), meshlets.vertices.size_bytes());
+			writeSection(header.meshletTriangleOffset, meshlets.triangles.data(), meshlets.triangles.size_bytes());
+			writeSection(header.textureOffset, nullptr, 0);
+			for (const auto& texturePath : texturePaths)
+			{
+				u32 length = static_cast<u32>(texturePath.size());
+				out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+				out.write(texturePath.data(), length);
+			}
+
+			if (!out)
+			{
+				printl(Log::LogLevel::Warn, "[CACHE] Failed writing {}", tempPath);
+				return false;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, cachePath, ec);
+		if (ec)
+		{
+			printl(Log::LogLevel::Warn, "[CACHE] Failed to move {} into place: {}", tempPath, ec.message());
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+
+		printl(Log::LogLevel::Info, "[CACHE] Wrote {}", cachePath);
+		return true;
+	}
+}
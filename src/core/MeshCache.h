@@ -0,0 +1,133 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "StandardTypes.h"
+#include "Model.h"
+#include "Vertex.h"
+
+// cooked model cache (.cvmesh). Holds the final output of the glTF import (optimised vertices/indices, mesh table,
+// materials, texture references), so a warm start can skip cgltf + meshopt entirely and upload straight from a
+// memory mapped file.
+//
+// layout: CookedModelHeader | dependency table | vertices | indices | meshes | instances | materials | meshlets | meshlet vertices
+//         | meshlet triangles | texture path table
+// every section starts 16 byte aligned, offsets in the header are from the start of the file.
+
+namespace CV
+{
+	// bump whenever the import output (vertex layout, optimisation chain, MeshInfo layout...) changes.
+	// meshlets are only built with MESH_SHADING, so the flag is part of the version
+	constexpr u32 kImporterVersion = 5 | (MESH_SHADING << 16);
+	constexpr u32 kCookedModelMagic = 0x534D5643; // "CVMS"
+
+	struct CookedModelHeader
+	{
+		u32 magic;
+		u32 version;
+		u64 sourceHash;		// hash of the .gltf file contents
+		u64 dependencyCount;	// external buffers (.bin), validated by size + write time
+		u64 vertexCount;
+		u64 indexCount;
+		u64 meshCount;
+		u64 instanceCount;
+		u64 materialCount;
+		u64 meshletCount;
+		u64 meshletVertexCount;
+		u64 meshletTriangleBytes;
+		u64 textureCount;
+		u64 dependencyOffset;
+		u64 vertexOffset;
+		u64 indexOffset;
+		u64 meshOffset;
+		u64 instanceOffset;
+		u64 materialOffset;
+		u64 meshletOffset;
+		u64 meshletVertexOffset;
+		u64 meshletTriangleOffset;
+		u64 textureOffset;
+	};
+
+	struct CookedDependency
+	{
+		char path[256];		// relative to the model directory
+		u64 size;
+		i64 writeTime;
+	};
+
+	struct CookedMaterial
+	{
+		u32 albedoIndex;
+		u32 normalIndex;
+		u32 metallicIndex;
+		u32 emissiveIndex;
+	};
+
+	struct CookedMeshlets
+	{
+		std::span<const Meshlet> meshlets;
+		std::span<const u32> vertices;
+		std::span<const u8> triangles;
+	};
+
+	// read only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::string& path);
+		void Close();
+		[[nodiscard]] const u8* Data() const { return m_data; }
+		[[nodiscard]] size_t Size() const { return m_size; }
+
+	private:
+		const u8* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_fd = -1;
+#endif
+	};
+
+	class MeshCache
+	{
+	public:
+		static std::string GetCachePath(const std::string& sourcePath);
+		static u64 HashFile(const std::string& path);
+
+		// maps the cache and checks magic/version/source hash/dependencies, and that every range and index in it stays inside
+		// its section. Views stay valid until Close()
+		bool Open(const std::string& cachePath, u64 sourceHash, const std::string& dirPath);
+		void Close() { m_file.Close(); }
+
+		static bool Write(const std::string& cachePath, u64 sourceHash, const std::string& dirPath,
+			const std::vector<std::string>& dependencies, std::span<const Vertex> vertices, std::span<const u32> indices,
+			std::span<const MeshInfo> meshes, std::span<const MeshInstance> instances, std::span<const CookedMaterial> materials, const CookedMeshlets& meshlets,
+			const std::vector<std::string>& texturePaths);
+
+		std::span<const Vertex> vertices;
+		std::span<const u32> indices;
+		std::span<const MeshInfo> meshes;
+		std::span<const MeshInstance> instances;
+		std::span<const CookedMaterial> materials;
+		CookedMeshlets meshlets;
+		std::vector<std::string> texturePaths;
+
+	private:
+		// the views are set, a corrupt or stale file that got past the hash check mustn't be read or drawn out of bounds
+		[[nodiscard]] bool ContentsInRange() const;
+
+		MappedFile m_file;
+	};
+}
+
+#endif
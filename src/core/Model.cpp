@@ -7,7 +7,14 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm\gtx\euler_angles.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
+
+#include "AccessorDecoder.h"
 #include "Log.h"
+#include "MeshCache.h"
 #include "Texture.h"
 #include "renderer.h"
 #include "Vertex.h"
@@ -18,15 +25,68 @@ CV::Model::Model()
 }
 CV::Model::~Model()
 {
+    if (!_resourceManager)
+        return;
+
+    // anything still uploading has to land before its resources can go
+    _streamBatch.reset();
+    _uploadBatch.reset();
+
+    // deferred by the resource manager, the last frames recorded with this model may still be in flight
+    for (BufferHandle buffer : { _vertexBuffer, _indexBuffer, _indexBuffer16, _instanceBuffer, _meshletBuffer, _meshletVertexBuffer,
+                                 _meshletTriangleBuffer, _drawRecordBuffer, _materialBuffer })
+        _resourceManager->DestroyBuffer(buffer);
+    for (TextureHandle texture : _textures)
+        _resourceManager->DestroyTexture(texture);
 }
 
-void CV::Model::LoadModel(const std::shared_ptr<Renderer>& renderer, const std::string& path)
+void CV::Model::LoadModel(const std::shared_ptr<Renderer>& renderer, ResourceManager& resourceManager, const std::string& path)
 {
+    using Clock = std::chrono::high_resolution_clock;
+    auto elapsedMs = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
     this->_renderer = renderer;
 
-    _resourceManager = new ResourceManager(_renderer);
+    _resourceManager = &resourceManager;
+    _dirPath = path.substr(0, path.find_last_of("/"));
+
+    // shared by the texture decodes (queued while materials are discovered) and the primitive import
+    _importPool = std::make_unique<ThreadPool>(_importThreadCount);
+    _uploadBatch = CreateUploadBatch();
+    // bound in every texture slot until the real one is resident (a failed decode is white too). Shared by every model
+    if (!_resourceManager->getFallbackTexture())
+    {
+        Texture fallback;
+        fallback.Upload(_renderer, *_uploadBatch, TextureData{});
+        const TextureHandle fallbackHandle = _resourceManager->ReserveTexture();
+        _resourceManager->SetTexture(fallbackHandle, fallback);
+        _resourceManager->SetTextureResident(fallbackHandle);   // LoadModel waits for _uploadBatch before returning
+        _resourceManager->setFallbackTexture(fallbackHandle);
+    }
+
+    // warm start: the cooked cache skips cgltf and the whole optimisation chain
+    auto stageStart = Clock::now();
+    const std::string cachePath = MeshCache::GetCachePath(path);
+    const u64 sourceHash = MeshCache::HashFile(path);
+    {
+        MeshCache cache;
+        if (cache.Open(cachePath, sourceHash, _dirPath))
+        {
+            LoadFromCache(cache);
+            FinishUploads();
+            printl(Log::LogLevel::Info, "[CACHE] Loaded {} in {:.2f} ms", cachePath, elapsedMs(stageStart));
+            ValidateResources();
+            if (!_streamBatch)
+                _importPool.reset();
+            _resourceManager->getAllocator().logStats();
+            return;
+        }
+    }
+
     cgltf_options options = {};
     cgltf_data *data = nullptr;
+
+    stageStart = Clock::now();
     cgltf_result result = cgltf_parse_file(&options, path.c_str(), &data);
 
     if (result != cgltf_result_success)
@@ -45,6 +105,7 @@ void CV::Model::LoadModel(const std::shared_ptr<Renderer>& renderer, const std::
     {
         printl(Log::LogLevel::Info,"[CGLTF] Successfully loaded buffers");
     }
+    printl(Log::LogLevel::InfoDebug, "[IMPORT] Parse + buffer load: {:.2f} ms", elapsedMs(stageStart));
 
     cgltf_scene *scene = data->scene;
 
@@ -55,33 +116,180 @@ void CV::Model::LoadModel(const std::shared_ptr<Renderer>& renderer, const std::
     else
     {
         printl(Log::LogLevel::Info,"[CGLTF] Scene found in gltf file");
-        _dirPath = path.substr(0, path.find_last_of("/"));
 
+        // serial pass: walk the node graph, resolve materials/textures and collect one job per primitive
+        stageStart = Clock::now();
+        _primitiveJobs.clear();
+        _primitiveLookup.clear();
+        _instances.clear();
         for (size_t i = 0; i < (scene->nodes_count); i++)
         {
             Transformation transform;
-            ProcessNode(scene->nodes[i], data, _vertices, _indices, transform);
+            ProcessNode(scene->nodes[i], data, transform);
         }
         // no of nodes
         printl(Log::LogLevel::InfoDebug,"[CGLTF] No of nodes in the scene: {} ", scene->nodes_count);
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Node walk + materials: {:.2f} ms ({} unique primitives, {} instances)",
+            elapsedMs(stageStart), _primitiveJobs.size(), _instances.size());
+
+        // parallel pass: decode + optimise every primitive independently
+        stageStart = Clock::now();
+        std::vector<PrimitiveResult> results(_primitiveJobs.size());
+        // texture decodes queued during the node walk are ahead in the queue, the calling thread starts on primitives right away
+        _importPool->ParallelFor(_primitiveJobs.size(), [&](size_t i)
+        {
+            ImportPrimitive(_primitiveJobs[i], results[i]);
+        });
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Decode + optimise: {:.2f} ms on {} threads", elapsedMs(stageStart), _importPool->GetWorkerCount() + 1);
+
+        // concatenate in job order so the output matches the serial import exactly
+        stageStart = Clock::now();
+        MergePrimitives(results);
+        _primitiveJobs.clear();
+        _primitiveLookup.clear();
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Merge: {:.2f} ms", elapsedMs(stageStart));
 
-        SetBuffers();
+        stageStart = Clock::now();
+        WriteCache(cachePath, sourceHash, data);
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Cache write: {:.2f} ms", elapsedMs(stageStart));
+
+        stageStart = Clock::now();
+        SetBuffers(_vertices, _indices);
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Buffer staging: {:.2f} ms", elapsedMs(stageStart));
 
         printl(Log::LogLevel::Info,"[CGLTF] Successfully loaded gltf file");
     }
 
+    // textures queued during the node walk land last, so their decode overlaps everything above
+    stageStart = Clock::now();
+    FinishTextureLoads();
+    if (_streamBatch)
+    {
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Streaming {} textures", _textures.size());
+    }
+    else
+    {
+        _importPool.reset();
+        printl(Log::LogLevel::InfoDebug, "[IMPORT] Texture wait + record: {:.2f} ms ({} textures)", elapsedMs(stageStart), _textures.size());
+    }
+
+    stageStart = Clock::now();
+    FinishUploads();
+    printl(Log::LogLevel::InfoDebug, "[IMPORT] Upload submit + wait: {:.2f} ms", elapsedMs(stageStart));
+    _resourceManager->getAllocator().logStats();
+
     ValidateResources();
 
     cgltf_free(data);
 }
 
+void CV::Model::LoadFromCache(const MeshCache& cache)
+{
+    _meshes.assign(cache.meshes.begin(), cache.meshes.end());
+    _instances.assign(cache.instances.begin(), cache.instances.end());   // already sorted, ranges are in the MeshInfos
+    BuildInstanceBounds();
+
+    // textures were cooked in load order, so the material indices stay valid as long as they're loaded in the same order
+    for (const auto& texturePath : cache.texturePaths)
+    {
+        LoadTextureFile(texturePath);
+    }
+
+    _materials.reserve(cache.materials.size());
+    for (const CookedMaterial& cooked : cache.materials)
+    {
+        Material mat = {};
+        mat.albedoIndex = cooked.albedoIndex;
+        mat.normalIndex = cooked.normalIndex;
+        mat.metallicIndex = cooked.metallicIndex;
+        mat.emmisiveIndex = cooked.emissiveIndex;
+        _materials.push_back(mat);
+    }
+
+    _meshlets.assign(cache.meshlets.meshlets.begin(), cache.meshlets.meshlets.end());
+    _meshletVertices.assign(cache.meshlets.vertices.begin(), cache.meshlets.vertices.end());
+    _meshletTriangles.assign(cache.meshlets.triangles.begin(), cache.meshlets.triangles.end());
+
+    // straight from the mapping into the staging buffers, the texture decodes keep running meanwhile
+    SetBuffers(cache.vertices, cache.indices);
+    FinishTextureLoads();
+}
+
+void CV::Model::WriteCache(const std::string& cachePath, u64 sourceHash, const cgltf_data* data) const
+{
+    // external buffers are the only other input to the geometry, embedded (data:) ones are covered by the source hash
+    std::vector<std::string> dependencies;
+    for (size_t i = 0; i < data->buffers_count; i++)
+    {
+        const char* uri = data->buffers[i].uri;
+        if (uri && strncmp(uri, "data:", 5) != 0)
+            dependencies.emplace_back(uri);
+    }
+
+    std::vector<CookedMaterial> materials;
+    materials.reserve(_materials.size());
+    for (const Material& mat : _materials)
+    {
+        materials.push_back({ mat.albedoIndex, mat.normalIndex, mat.metallicIndex, mat.emmisiveIndex });
+    }
+
+    MeshCache::Write(cachePath, sourceHash, _dirPath, dependencies, _vertices, _indices, _meshes, _instances, materials,
+        { _meshlets, _meshletVertices, _meshletTriangles }, _texturePaths);
+}
+
 //glm::mat4 CV::Model::ComputeNormalMatrix(const glm::mat4 worldMatrix)
 //{
 //    glm::mat4 normalMatrix = ;
 //    return normalMatrix;
 //}
 
-void CV::Model::ProcessNode(cgltf_node *node, const cgltf_data *data, std::vector<Vertex> &vertices, std::vector<u32> &indices, Transformation& parentTransform)
+namespace
+{
+    // world matrix of every copy a node draws: just the node itself, or one per EXT_mesh_gpu_instancing entry (relative to the node)
+    std::vector<glm::mat4> GetInstanceTransforms(const cgltf_node* node, const glm::mat4& nodeMatrix)
+    {
+        if (!node->has_mesh_gpu_instancing)
+            return { nodeMatrix };
+
+        const cgltf_accessor* translation = nullptr;
+        const cgltf_accessor* rotation = nullptr;
+        const cgltf_accessor* scale = nullptr;
+        for (size_t i = 0; i < node->mesh_gpu_instancing.attributes_count; i++)
+        {
+            const cgltf_attribute& attribute = node->mesh_gpu_instancing.attributes[i];
+            if (strcmp(attribute.name, "TRANSLATION") == 0) translation = attribute.data;
+            if (strcmp(attribute.name, "ROTATION") == 0) rotation = attribute.data;
+            if (strcmp(attribute.name, "SCALE") == 0) scale = attribute.data;
+        }
+
+        const cgltf_accessor* any = translation ? translation : rotation ? rotation : scale;
+        if (!any || any->count == 0)
+            return { nodeMatrix };
+
+        const size_t count = any->count;
+        std::vector<glm::vec3> translations(count, glm::vec3(0.0f));
+        std::vector<glm::vec4> rotations(count, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        std::vector<glm::vec3> scales(count, glm::vec3(1.0f));
+        if ((translation && translation->count != count) || (rotation && rotation->count != count) || (scale && scale->count != count))
+        {
+            printl(Log::LogLevel::Warn, "[CGLTF] EXT_mesh_gpu_instancing attributes differ in count, ignoring instancing");
+            return { nodeMatrix };
+        }
+        if (translation) CV::DecodeAccessorFloats(translation, &translations[0].x, count, 3, sizeof(glm::vec3));
+        if (rotation) CV::DecodeAccessorFloats(rotation, &rotations[0].x, count, 4, sizeof(glm::vec4));
+        if (scale) CV::DecodeAccessorFloats(scale, &scales[0].x, count, 3, sizeof(glm::vec3));
+
+        std::vector<glm::mat4> transforms(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const glm::quat q(rotations[i].w, rotations[i].x, rotations[i].y, rotations[i].z);
+            transforms[i] = nodeMatrix * glm::translate(glm::mat4(1.0f), translations[i]) * glm::mat4_cast(q) * glm::scale(glm::mat4(1.0f), scales[i]);
+        }
+        return transforms;
+    }
+}
+
+void CV::Model::ProcessNode(cgltf_node *node, const cgltf_data *data, Transformation& parentTransform)
 {
     Transformation localTransform = parentTransform;
     glm::mat4 translationMatrix(1.0f);
@@ -128,6 +336,7 @@ void CV::Model::ProcessNode(cgltf_node *node, const cgltf_data *data, std::vecto
     // Process meshInfo if exists
     if (node->mesh)
     {
+        const std::vector<glm::mat4> instanceTransforms = GetInstanceTransforms(node, localTransform.Matrix);
         for (size_t i = 0; i < (node->mesh->primitives_count); i++)
         {
             //Log::InfoDebug("[CGLTF] parentTransform Matrix: {}", localTransform.Matrix);
@@ -135,25 +344,19 @@ void CV::Model::ProcessNode(cgltf_node *node, const cgltf_data *data, std::vecto
             Log::InfoDebug("[CGLTF] parentTransform Rotation: {}", localTransform.Rotation);
             Log::InfoDebug("[CGLTF] parentTransform Scale: {}", localTransform.Scale);*/
 
-            ProcessMesh(&node->mesh->primitives[i], vertices, indices, localTransform);   // remember that the indices and the vertices passed here are _indices and _vertices refs
+            ProcessMesh(&node->mesh->primitives[i], instanceTransforms);
         }
     }
 
     // Recursively process child nodes
     for (size_t i = 0; i < node->children_count; i++)
     {
-        ProcessNode(node->children[i], data, vertices, indices, localTransform);
+        ProcessNode(node->children[i], data, localTransform);
     }
 }
 
-void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &vertices, std::vector<u32> &indices, Transformation& parentTransform)
+void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::span<const glm::mat4> instanceTransforms)
 {
-    u32 vertexOffset = static_cast<u32>(vertices.size());
-    u32 indexOffset = static_cast<u32>(indices.size());
-
-    std::vector<Vertex> tempVertices;
-    std::vector<u32> tempIndices;
-
     if (primitive->type != cgltf_primitive_type_triangles)
     {
         printl(Log::LogLevel::Warn,"[CGLTF] Primitive type is not triangles");
@@ -172,11 +375,6 @@ void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &ver
         return;
     }
 
-    MeshInfo meshInfo;
-
-    meshInfo.transform = parentTransform;
-    //meshInfo.normalMatrix = ComputeNormalMatrix(parentTransform.Matrix);
-
     // Get attributes
     cgltf_attribute *pos_attribute = nullptr;
     cgltf_attribute *tex_attribute = nullptr;
@@ -209,42 +407,6 @@ void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &ver
         return;
     }
 
-    size_t vertexCount;
-    vertexCount = pos_attribute->data->count;
-    size_t indexCount;
-    indexCount = primitive->indices->count;
-
-    for (size_t i = 0; i < vertexCount; i++)
-    {
-        Vertex vertex = {};
-
-        // Read original vertex data
-        if (cgltf_accessor_read_float(pos_attribute->data, i, &vertex.pos.x, 3) == 0)
-        {
-            printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Position attributes!");
-        }
-        if (cgltf_accessor_read_float(tex_attribute->data, i, &vertex.texCoord.x, 2) == 0)
-        {
-            printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Texture attributes!");
-        }
-        if (cgltf_accessor_read_float(norm_attribute->data, i, &vertex.normal.x, 3) == 0)
-        {
-            printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Normal attributes!");
-        }
-        if (cgltf_accessor_read_float(tang_attribute->data, i, &vertex.tangent.x, 4) == 0)
-        {
-            printl(Log::LogLevel::Warn, "[CGLTF] Unable to read Tangent attributes!");
-        }
-        tempVertices.push_back(vertex);
-        //vertices.push_back(vertex);
-    }
-
-    for (size_t i = 0; i < indexCount; i++)
-    {
-        tempIndices.push_back(cgltf_accessor_read_index(primitive->indices, i));
-        //indices.push_back(cgltf_accessor_read_index(primitive->indices, i));
-    }
-
     // material
     // remember this is pointing towards the material pointer.
     // In gltf as long as the material remains the same, the pointer is the same even for diff primitives
@@ -314,18 +476,12 @@ void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &ver
                 // Cache the index for this image file
                 loadedTextures.insert(imageName);
                 textureIndexLookup[imageName] = textureIndex;
-                printl(Log::LogLevel::Info, "[Texture] Loaded texture {} with index {}", imageName, textureIndex);
+                printl(Log::LogLevel::Info, "[Texture] Queued texture {} with index {}", imageName, textureIndex);
             }
             else
             {
                 textureIndex = textureIndexLookup[imageName];
                 printl(Log::LogLevel::Warn, "[Texture] Reusing texture {} with index {}", imageName, textureIndex);
-                Texture& existingTex = modelTextures[textureIndex];
-                if (type == TextureType::ALBEDO) mat.AlbedoView = existingTex.m_texImageView;
-                if (type == TextureType::NORMAL) mat.NormalView = existingTex.m_texImageView;
-                if (type == TextureType::METALLIC_ROUGHNESS) mat.MetallicRoughnessView = existingTex.m_texImageView;
-                if (type == TextureType::EMISSIVE) mat.EmissiveView= existingTex.m_texImageView;
-                // ... rest types TODO
             }
 
             if (type == TextureType::ALBEDO) mat.albedoIndex = textureIndex;
@@ -333,55 +489,251 @@ void CV::Model::ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &ver
             if (type == TextureType::METALLIC_ROUGHNESS) mat.metallicIndex = textureIndex;
             if (type == TextureType::EMISSIVE) mat.emmisiveIndex = textureIndex;
             // ... rest types TODO
+            // the views only exist once the texture is uploaded, see ResolveMaterialViews
         }
 
         _materials.push_back(mat);
         materialLookup[material] = _materials.size() - 1;
     }
-    meshInfo.materialIndex = static_cast<u32>(materialLookup[material]);
-    meshInfo.transform = parentTransform;
-    meshInfo.startIndex = indexOffset;
-    meshInfo.startVertex = vertexOffset;
+
+    // the geometry is imported once per distinct set of accessors, every further reference is only an instance
+    const std::array<const cgltf_accessor*, 5> geometryKey = {
+        primitive->indices, pos_attribute->data, tex_attribute->data, norm_attribute->data, tang_attribute ? tang_attribute->data : nullptr
+    };
+    auto [geometry, isNew] = _primitiveLookup.try_emplace(geometryKey, static_cast<u32>(_primitiveJobs.size()));
+    if (isNew)
+    {
+        PrimitiveJob job;
+        job.primitive = primitive;
+        job.position = pos_attribute->data;
+        job.texCoord = tex_attribute->data;
+        job.normal = norm_attribute->data;
+        job.tangent = tang_attribute ? tang_attribute->data : nullptr;
+        _primitiveJobs.push_back(job);
+    }
+
+    const u32 materialIndex = static_cast<u32>(materialLookup[material]);
+    for (const glm::mat4& world : instanceTransforms)
+    {
+        _instances.push_back({ world, geometry->second, materialIndex });
+    }
+}
+
+// runs on the import workers, must not touch any Model state apart from reading the job
+void CV::Model::ImportPrimitive(const PrimitiveJob& job, PrimitiveResult& result) const
+{
+    const cgltf_primitive* primitive = job.primitive;
+
+    size_t vertexCount;
+    vertexCount = job.position->count;
+    size_t indexCount;
+    indexCount = primitive->indices->count;
+
+    if (vertexCount == 0 || indexCount == 0)
+    {
+        printl(Log::LogLevel::Warn, "[CGLTF] Empty primitive skipped");
+        return;
+    }
+    // every attribute of a primitive has to have the position count (glTF spec), the vertex array is sized by it
+    if (job.texCoord->count != vertexCount || job.normal->count != vertexCount || (job.tangent && job.tangent->count != vertexCount))
+    {
+        printl(Log::LogLevel::Warn, "[CGLTF] Primitive attributes differ in count from its positions, skipped");
+        return;
+    }
+
+    // value initialised, so a missing tangent stream just stays zero
+    std::vector<Vertex> tempVertices(vertexCount);
+    std::vector<u32> tempIndices(indexCount);
+
+    // whole accessors at once, interleaved straight into the Vertex array
+    if (!DecodeAccessorFloats(job.position, &tempVertices[0].pos.x, vertexCount, 3, sizeof(Vertex)))
+    {
+        printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Position attributes!");
+    }
+    if (!DecodeAccessorFloats(job.texCoord, &tempVertices[0].texCoord.x, vertexCount, 2, sizeof(Vertex)))
+    {
+        printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Texture attributes!");
+    }
+    if (!DecodeAccessorFloats(job.normal, &tempVertices[0].normal.x, vertexCount, 3, sizeof(Vertex)))
+    {
+        printl(Log::LogLevel::Warn,"[CGLTF] Unable to read Normal attributes!");
+    }
+    if (job.tangent && !DecodeAccessorFloats(job.tangent, &tempVertices[0].tangent.x, vertexCount, 4, sizeof(Vertex)))
+    {
+        printl(Log::LogLevel::Warn, "[CGLTF] Unable to read Tangent attributes!");
+    }
+
+    if (!DecodeAccessorIndices(primitive->indices, tempIndices.data()))
+    {
+        printl(Log::LogLevel::Warn, "[CGLTF] Unable to read Index data!");
+    }
+
+    MeshInfo& meshInfo = result.meshInfo;
     meshInfo.vertexCount = vertexCount;
     meshInfo.indexCount = indexCount;
 
-    Mesh mesh;
-    mesh.vertices = tempVertices;
-    mesh.indices = tempIndices;
+    Mesh& mesh = result.mesh;
+    mesh.vertices = std::move(tempVertices);
+    mesh.indices = std::move(tempIndices);
     mesh.vertexCount = static_cast<u32>(vertexCount);
     mesh.indexCount = static_cast<u32>(indexCount);
 
-    /*for (int i = 0; i < tempVertices.size(); i++) _vertices.push_back(tempVertices[i]);
-    for (int i = 0; i < tempIndices.size(); i++) _indices.push_back(tempIndices[i]);*/
-
     OptimiseMesh(meshInfo, mesh);
 #if MESH_SHADING
-    ProcessMeshlets(mesh);
+    BuildMeshlets(mesh);
+    meshInfo.meshletCount = static_cast<u32>(mesh.meshlets.size());
 #endif
-    _meshes.push_back(meshInfo);
 }
 
-u32 CV::Model::LoadMaterialTexture(Material &mat, const cgltf_texture_view *textureView, const TextureType type)
+void CV::Model::MergePrimitives(std::vector<PrimitiveResult>& results)
 {
-    if (textureView && textureView->texture && textureView->texture->image)
+    size_t totalVertices = _vertices.size();
+    size_t totalIndices = _indices.size();
+    for (const auto& result : results)
     {
-        cgltf_image *image = textureView->texture->image;
-        std::string path = _dirPath + "/" + std::string(image->uri);
+        totalVertices += result.mesh.vertices.size();
+        totalIndices += result.mesh.indices.size();
+    }
+    _vertices.reserve(totalVertices);
+    _indices.reserve(totalIndices);
+    _meshes.reserve(_meshes.size() + results.size());
+
+    // instances still point at jobs, empty primitives are dropped so the mesh indices shift
+    std::vector<u32> jobToMesh(results.size(), -1);
+
+    for (size_t job = 0; job < results.size(); job++)
+    {
+        auto& [meshInfo, mesh] = results[job];
+        if (mesh.indices.empty())
+            continue;
+
+        meshInfo.startIndex = static_cast<u32>(_indices.size());
+        meshInfo.startVertex = static_cast<u32>(_vertices.size());
+        for (u32 lod = 0; lod < meshInfo.lodCount; lod++)
+        {
+            meshInfo.lods[lod].startIndex += meshInfo.startIndex;
+        }
+
+        _indices.insert(_indices.end(), mesh.indices.begin(), mesh.indices.end());
+        _vertices.insert(_vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+
+        // meshlet vertices become absolute so the mesh shader can index the vertex buffer directly
+        meshInfo.meshletOffset = static_cast<u32>(_meshlets.size());
+        const u32 meshletVertexBase = static_cast<u32>(_meshletVertices.size());
+        const u32 meshletTriangleBase = static_cast<u32>(_meshletTriangles.size());
+        for (Meshlet& meshlet : mesh.meshlets)
+        {
+            meshlet.vertexOffset += meshletVertexBase;
+            meshlet.triangleOffset += meshletTriangleBase;
+            _meshlets.push_back(meshlet);
+        }
+        for (u32 vertex : mesh.meshletVertices)
+        {
+            _meshletVertices.push_back(vertex + meshInfo.startVertex);
+        }
+        _meshletTriangles.insert(_meshletTriangles.end(), mesh.meshletTriangles.begin(), mesh.meshletTriangles.end());
+
+        jobToMesh[job] = static_cast<u32>(_meshes.size());
+        _meshes.push_back(meshInfo);
+    }
+
+    for (MeshInstance& instance : _instances)
+    {
+        instance.meshIndex = jobToMesh[instance.meshIndex];
+    }
+    std::erase_if(_instances, [](const MeshInstance& instance) { return instance.meshIndex == static_cast<u32>(-1); });
+
+    BuildInstanceRanges();
+    BuildInstanceBounds();
+}
+
+void CV::Model::BuildInstanceRanges()
+{
+    // one contiguous run per mesh, so all copies of a mesh can go out in a single instanced draw
+    std::stable_sort(_instances.begin(), _instances.end(),
+        [](const MeshInstance& a, const MeshInstance& b) { return a.meshIndex < b.meshIndex; });
+
+    for (MeshInfo& meshInfo : _meshes)
+    {
+        meshInfo.instanceOffset = 0;
+        meshInfo.instanceCount = 0;
+    }
+    for (u32 i = 0; i < _instances.size(); i++)
+    {
+        MeshInfo& meshInfo = _meshes[_instances[i].meshIndex];
+        if (meshInfo.instanceCount == 0)
+            meshInfo.instanceOffset = i;
+        meshInfo.instanceCount++;
+    }
+}
+
+void CV::Model::BuildInstanceBounds()
+{
+    _instanceBounds.Resize(static_cast<u32>(_instances.size()));
+    for (u32 i = 0; i < _instances.size(); i++)
+    {
+        const MeshInstance& instance = _instances[i];
+        const MeshInfo& meshInfo = _meshes[instance.meshIndex];
+        const glm::mat4& world = instance.world;
+
+        // box: the transformed center, and the extent through the absolute linear part covers all 8 transformed corners
+        const glm::vec3 center = glm::vec3(world * glm::vec4((meshInfo.boundsMin + meshInfo.boundsMax) * 0.5f, 1.0f));
+        const glm::vec3 halfExtent = (meshInfo.boundsMax - meshInfo.boundsMin) * 0.5f;
+        const glm::mat3 absLinear(glm::abs(glm::vec3(world[0])), glm::abs(glm::vec3(world[1])), glm::abs(glm::vec3(world[2])));
+        const glm::vec3 worldExtent = absLinear * halfExtent;
 
-        Texture tex;
-        tex.LoadTexture(_renderer, path.c_str());
+        const float maxScale = glm::max(glm::length(glm::vec3(world[0])), glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        const glm::vec3 sphereCenter = glm::vec3(world * glm::vec4(meshInfo.boundsCenter, 1.0f));
 
-        // Push the texture and return its new index
-        modelTextures.push_back(tex);
-        u32 newIndex = modelTextures.size() - 1;
+        _instanceBounds.Set(i, center - worldExtent, center + worldExtent, sphereCenter, meshInfo.boundsRadius * maxScale, maxScale);
+    }
+}
 
-        // Assign the view to the material, but return the index for storage
-        if (type == TextureType::ALBEDO) mat.AlbedoView = tex.m_texImageView;
-        if (type == TextureType::NORMAL) mat.NormalView = tex.m_texImageView;
-        if (type == TextureType::METALLIC_ROUGHNESS) mat.MetallicRoughnessView = tex.m_texImageView;
-        if (type == TextureType::EMISSIVE) mat.EmissiveView = tex.m_texImageView;
+void CV::Model::UploadDrawRecords()
+{
+    // a region per index buffer, each one drawn with a single indirect call. Inside a region instances stay in mesh order
+    std::vector<DrawRecord> records;
+    records.reserve(_instances.size());
+    for (u32 region = 0; region < DRAW_REGION_COUNT; region++)
+    {
+        _drawRegionOffset[region] = static_cast<u32>(records.size());
+        for (u32 i = 0; i < _instances.size(); i++)
+        {
+            const MeshInfo& meshInfo = _meshes[_instances[i].meshIndex];
+            if ((meshInfo.shortIndices ? DRAW_REGION_INDEX16 : DRAW_REGION_INDEX32) != region)
+                continue;
+
+            DrawRecord& record = records.emplace_back();
+            record.boundsMin = { _instanceBounds.minX[i], _instanceBounds.minY[i], _instanceBounds.minZ[i] };
+            record.boundsMax = { _instanceBounds.maxX[i], _instanceBounds.maxY[i], _instanceBounds.maxZ[i] };
+            record.sphereCenter = _instanceBounds.GetCenter(i);
+            record.sphereRadius = _instanceBounds.radius[i];
+            record.instanceIndex = i;
+            record.vertexOffset = static_cast<i32>(meshInfo.startVertex);
+            record.lodCount = meshInfo.lodCount;
+            record.region = region;
+            for (u32 lod = 0; lod < meshInfo.lodCount; lod++)
+            {
+                record.firstIndex[lod] = meshInfo.lods[lod].startIndex - meshInfo.startIndex + meshInfo.gpuIndexBase;
+                record.indexCount[lod] = meshInfo.lods[lod].indexCount;
+                record.lodError[lod] = meshInfo.lods[lod].error * _instanceBounds.scale[i];
+            }
+        }
+        _drawRegionCount[region] = static_cast<u32>(records.size()) - _drawRegionOffset[region];
+    }
+
+    if (!records.empty())
+        _drawRecordBuffer = UploadBuffer(records.data(), records.size() * sizeof(DrawRecord), vk::BufferUsageFlagBits::eShaderDeviceAddress);
+}
+
+u32 CV::Model::LoadMaterialTexture(Material &mat, const cgltf_texture_view *textureView, const TextureType type)
+{
+    if (textureView && textureView->texture && textureView->texture->image)
+    {
+        cgltf_image *image = textureView->texture->image;
 
-        return newIndex;
+        // the index is reserved now, the decode runs in the background and the view is filled in after the upload
+        return LoadTextureFile(image->uri);
 
         // case TextureType::AO:
         //     mat.AOView = tex.m_texImageView;
@@ -395,6 +747,126 @@ u32 CV::Model::LoadMaterialTexture(Material &mat, const cgltf_texture_view *text
     return -1;
 }
 
+u32 CV::Model::LoadTextureFile(const std::string& uri)
+{
+    std::string path = _dirPath + "/" + uri;
+
+    // reserve the bindless slot straight away so material indices never move, decode on the import pool
+    const u32 textureIndex = static_cast<u32>(_textures.size());
+    _textures.push_back(_resourceManager->ReserveTexture());
+    _texturePaths.push_back(uri);
+    _pendingTextures.emplace_back(textureIndex, _importPool->Submit([path]() { return Texture::Decode(path); }).share());
+    return textureIndex;
+}
+
+void CV::Model::FinishTextureLoads()
+{
+    // the decodes keep running after LoadModel returns, UpdateStreaming takes them from here
+    if (_streamTextures)
+    {
+        _streamBatch = CreateUploadBatch();
+        return;
+    }
+
+    // in reservation order, later decodes keep running on the pool while the earlier ones upload
+    for (auto& [textureIndex, decode] : _pendingTextures)
+    {
+        UploadTexture(textureIndex, *_uploadBatch, decode.get());
+        _resourceManager->SetTextureResident(_textures[textureIndex]);     // LoadModel waits for _uploadBatch before returning
+    }
+    _pendingTextures.clear();
+    ResolveMaterialViews();
+}
+
+bool CV::Model::UpdateStreaming()
+{
+    // one submit in flight at a time, so recording never waits on the GPU
+    if (!_streamBatch || !_streamBatch->IsComplete())
+        return false;
+    _streamBatch->Wait();
+
+    const bool madeResident = !_streamedTextures.empty();
+    for (u32 textureIndex : _streamedTextures)
+    {
+        _resourceManager->SetTextureResident(_textures[textureIndex]);
+    }
+    _streamedTextures.clear();
+
+    // whatever finished decoding, up to a staging budget below the arena size. The first texture that doesn't fit ends
+    // this frame's streaming: staging it would run the arena out, and Stage() would then flush and wait on the GPU.
+    // Only the first texture of a frame may go over, otherwise one larger than the budget would never get in
+    constexpr vk::DeviceSize kFrameBudget = 32ull << 20;
+    vk::DeviceSize frameBytes = 0;
+    for (auto it = _pendingTextures.begin(); it != _pendingTextures.end();)
+    {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+        const TextureData& textureData = it->second.get();
+        const vk::DeviceSize stagingSize = Texture::GetStagingSize(textureData);
+        if (frameBytes > 0 && frameBytes + stagingSize > kFrameBudget)
+            break;
+        frameBytes += stagingSize;
+        UploadTexture(it->first, *_streamBatch, textureData);
+        _streamedTextures.push_back(it->first);
+        it = _pendingTextures.erase(it);
+    }
+    _streamBatch->Submit();
+
+    if (_pendingTextures.empty() && _streamedTextures.empty())
+    {
+        printl(Log::LogLevel::Info, "[STREAM] {} textures resident, {:.1f} MB in {} submits", _textures.size(),
+            _streamBatch->GetStagedBytes() / (1024.0 * 1024.0), _streamBatch->GetSubmitCount());
+        _streamBatch.reset();
+        _importPool.reset();
+        ResolveMaterialViews();
+    }
+    return madeResident;
+}
+
+void CV::Model::UploadTexture(u32 textureIndex, UploadBatch& batch, const TextureData& textureData)
+{
+    Texture texture;
+    texture.Upload(_renderer, batch, textureData);
+    _resourceManager->SetTexture(_textures[textureIndex], texture);
+}
+
+u32 CV::Model::GetBindlessIndex(u32 textureIndex) const
+{
+    return textureIndex < _textures.size() ? _textures[textureIndex].Index() : textureIndex;
+}
+
+std::unique_ptr<CV::UploadBatch> CV::Model::CreateUploadBatch() const
+{
+    // copies on the transfer queue, the graphics queue takes ownership (and does the mip blits)
+    const UploadQueue transfer{ _renderer->_transferQueue, _renderer->_transferCommandPool, _renderer->_transferQueueFamily };
+    const UploadQueue graphics{ _renderer->_graphicsQueue, _renderer->_commandPool, _renderer->_queueFamily };
+    return std::make_unique<UploadBatch>(_renderer->_device, _resourceManager->getAllocator(), transfer, graphics);
+}
+
+void CV::Model::FinishUploads()
+{
+    // everything staged so far goes to the GPU in one submit, the fence wait is the only sync point of the load
+    _uploadBatch->Flush();
+    printl(Log::LogLevel::InfoDebug, "[UPLOAD] {:.1f} MB staged in {} submit(s)", _uploadBatch->GetStagedBytes() / (1024.0 * 1024.0),
+        _uploadBatch->GetSubmitCount());
+    _uploadBatch.reset();
+}
+
+void CV::Model::ResolveMaterialViews()
+{
+    auto viewOf = [this](u32 index) { return index < _textures.size() ? _resourceManager->getTextureView(_textures[index]) : vk::ImageView{}; };
+    for (Material& mat : _materials)
+    {
+        mat.AlbedoView = viewOf(mat.albedoIndex);
+        mat.NormalView = viewOf(mat.normalIndex);
+        mat.MetallicRoughnessView = viewOf(mat.metallicIndex);
+        mat.EmissiveView = viewOf(mat.emmisiveIndex);
+    }
+}
+
 void CV::Model::OptimiseMesh(MeshInfo& meshInfo, Mesh& mesh)
 {
     size_t indexCount = meshInfo.indexCount;
@@ -421,157 +893,267 @@ void CV::Model::OptimiseMesh(MeshInfo& meshInfo, Mesh& mesh)
     // Optimization 4 - optimize access to the vertex buffer
     meshopt_optimizeVertexFetch(optVertices.data(), optIndices.data(), indexCount, optVertices.data(), optVertexCount, sizeof(Vertex));
 
-    // Optimization 5 - create simplified version of the model
-    float threshold = 0.5f;
-    size_t targetIndexCount = (size_t)(threshold * indexCount);
-    float targetError = 0.3f;
+    // Optimization 5 - LOD chain. LOD 0 is the full resolution mesh, every further level targets half the
+    // triangles of the previous one. All levels share the vertex buffer and sit back to back in the index buffer.
+    // meshopt reports the error relative to the mesh extent, simplifyScale turns it into object space units
+    const float errorScale = meshopt_simplifyScale(&(optVertices[0].pos.x), optVertexCount, sizeof(Vertex));
+    const float targetError = 0.05f;
 
-    std::vector<u32> simplifiedIndices(optIndices.size());
-    size_t optIndexCount = meshopt_simplify(simplifiedIndices.data(), optIndices.data(), indexCount,
-        &(optVertices[0].pos.x), optVertexCount, sizeof(Vertex), targetIndexCount,
-        targetError);
-    simplifiedIndices.resize(optIndexCount);
+    std::vector<u32> lodIndices = optIndices;
+    meshInfo.lods[0] = { 0, static_cast<u32>(indexCount), 0.0f };
+    meshInfo.lodCount = 1;
+
+    std::vector<u32> simplifiedIndices(indexCount);
+    for (u32 level = 1; level < MAX_LODS; level++)
+    {
+        const MeshLod& previous = meshInfo.lods[level - 1];
+        size_t targetIndexCount = (indexCount >> level) / 3 * 3;
+        if (targetIndexCount < 3)
+            break;
+
+        float lodError = 0.0f;
+        size_t lodIndexCount = meshopt_simplify(simplifiedIndices.data(), optIndices.data(), indexCount,
+            &(optVertices[0].pos.x), optVertexCount, sizeof(Vertex), targetIndexCount,
+            targetError, 0, &lodError);
+
+        // not worth a level if the simplifier got stuck (locked borders, error limit)
+        if (lodIndexCount == 0 || lodIndexCount > previous.indexCount * 9 / 10)
+            break;
+
+        meshopt_optimizeVertexCache(simplifiedIndices.data(), simplifiedIndices.data(), lodIndexCount, optVertexCount);
+
+        MeshLod& lod = meshInfo.lods[level];
+        lod.startIndex = static_cast<u32>(lodIndices.size());
+        lod.indexCount = static_cast<u32>(lodIndexCount);
+        lod.error = std::max(lodError * errorScale, previous.error);
+        lodIndices.insert(lodIndices.end(), simplifiedIndices.begin(), simplifiedIndices.begin() + lodIndexCount);
+        meshInfo.lodCount++;
+    }
 
-    _indices.insert(_indices.end(), simplifiedIndices.begin(), simplifiedIndices.end());
-    _vertices.insert(_vertices.end(), optVertices.begin(), optVertices.end());
+    // object space bounds, used for LOD selection and vertex quantisation
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+    for (const Vertex& v : optVertices)
+    {
+        boundsMin = glm::min(boundsMin, v.pos);
+        boundsMax = glm::max(boundsMax, v.pos);
+    }
+    meshInfo.boundsMin = boundsMin;
+    meshInfo.boundsMax = boundsMax;
+    meshInfo.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    meshInfo.boundsRadius = 0.0f;
+    for (const Vertex& v : optVertices)
+    {
+        meshInfo.boundsRadius = std::max(meshInfo.boundsRadius, glm::length(v.pos - meshInfo.boundsCenter));
+    }
 
-    meshInfo.indexCount = optIndexCount;
+    meshInfo.indexCount = indexCount;
     meshInfo.vertexCount = optVertexCount;
 
-    mesh.vertices = optVertices;
-    mesh.indices = optIndices;
+    mesh.vertices = std::move(optVertices);
+    mesh.indices = std::move(lodIndices);
     mesh.vertexCount = static_cast<u32>(optVertexCount);
-    mesh.indexCount = static_cast<u32>(optIndexCount);
+    mesh.indexCount = static_cast<u32>(indexCount);    // LOD 0 only
 }
-#if MESH_SHADING
-void CV::Model::ProcessMeshlets(Mesh& mesh)
+void CV::Model::BuildMeshlets(Mesh& mesh)
 {
-    Meshlet meshlet = {};
-    std::vector<u8> meshletVertices(mesh.vertexCount, 0xff);
-
-    for (size_t i = 0; i < mesh.indexCount; i += 3)
+    // LOD 0 only, the coarser levels are left to the index buffer path
+    const size_t maxMeshlets = meshopt_buildMeshletsBound(mesh.indexCount, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+    std::vector<u32> meshletVertices(maxMeshlets * MESHLET_MAX_VERTICES);
+    std::vector<u8> meshletTriangles(maxMeshlets * MESHLET_MAX_TRIANGLES * 3);
+
+    const size_t meshletCount = meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+        mesh.indices.data(), mesh.indexCount, &mesh.vertices[0].pos.x, mesh.vertices.size(), sizeof(Vertex),
+        MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, MESHLET_CONE_WEIGHT);
+
+    mesh.meshlets.reserve(meshletCount);
+    for (size_t i = 0; i < meshletCount; i++)
     {
-        unsigned int a = mesh.indices[i + 0];
-        unsigned int b = mesh.indices[i + 1];
-        unsigned int c = mesh.indices[i + 2];
+        const meshopt_Meshlet& src = meshlets[i];
+        const meshopt_Bounds bounds = meshopt_computeMeshletBounds(&meshletVertices[src.vertex_offset], &meshletTriangles[src.triangle_offset],
+            src.triangle_count, &mesh.vertices[0].pos.x, mesh.vertices.size(), sizeof(Vertex));
+
+        Meshlet meshlet = {};
+        meshlet.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+        meshlet.radius = bounds.radius;
+        meshlet.coneApex = glm::vec3(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]);
+        meshlet.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
+        meshlet.coneCutoff = bounds.cone_cutoff;
+        meshlet.vertexOffset = static_cast<u32>(mesh.meshletVertices.size());
+        meshlet.triangleOffset = static_cast<u32>(mesh.meshletTriangles.size());
+        meshlet.vertexCount = src.vertex_count;
+        meshlet.triangleCount = src.triangle_count;
+        mesh.meshlets.push_back(meshlet);
+
+        // compact copy, triangles padded to 4 bytes so the shader can fetch them as words
+        mesh.meshletVertices.insert(mesh.meshletVertices.end(), meshletVertices.begin() + src.vertex_offset,
+            meshletVertices.begin() + src.vertex_offset + src.vertex_count);
+        mesh.meshletTriangles.insert(mesh.meshletTriangles.end(), meshletTriangles.begin() + src.triangle_offset,
+            meshletTriangles.begin() + src.triangle_offset + src.triangle_count * 3);
+        mesh.meshletTriangles.resize((mesh.meshletTriangles.size() + 3) & ~size_t(3), 0);
+    }
+}
 
-        u8& av = meshletVertices[a];
-        u8& bv = meshletVertices[b];
-        u8& cv = meshletVertices[c];
+CV::BufferHandle CV::Model::UploadBuffer(const void* srcData, vk::DeviceSize bufferSize, vk::BufferUsageFlags usage)
+{
+    const BufferHandle buffer = _resourceManager->CreateBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferDst | usage,
+        vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-        if ((meshlet.vertexCount + (av == 0xff) + (bv == 0xff) + (cv == 0xff) > 64) || (meshlet.triangleCount + 1 > 126 / 3))
-        {
-            m_meshlets.push_back(meshlet);
-            meshlet = {};
-            memset(meshletVertices.data(), 0xff, meshletVertices.size());
-        }
+    // copied into the staging arena now, the GPU copy runs with the rest of the load
+    _uploadBatch->UploadBuffer(srcData, bufferSize, _resourceManager->getBuffer(buffer));
+    return buffer;
+}
 
-        if (av == 0xff)
-        {
-            av = meshlet.vertexCount;
-            meshlet.vertices[meshlet.vertexCount++] = a;
-        }
-        if (bv == 0xff)
-        {
-            bv = meshlet.vertexCount;
-            meshlet.vertices[meshlet.vertexCount++] = b;
-        }
-        if (cv == 0xff)
-        {
-            cv = meshlet.vertexCount;
-            meshlet.vertices[meshlet.vertexCount++] = c;
-        }
-        meshlet.indices[meshlet.triangleCount * 3 + 0] = av;
-        meshlet.indices[meshlet.triangleCount * 3 + 1] = bv;
-        meshlet.indices[meshlet.triangleCount * 3 + 2] = cv;
-        meshlet.triangleCount++;
+#if COMPACT_VERTICES
+namespace
+{
+    // octahedral mapping of a unit vector to [-1, 1]^2, inverse is octDecode in mesh.vert.slang
+    glm::vec2 OctEncode(glm::vec3 n)
+    {
+        const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f);
+        n /= sum;
+        if (n.z >= 0.0f)
+            return glm::vec2(n.x, n.y);
+        return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                         (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
     }
-    if (meshlet.triangleCount)
+
+    std::vector<CV::PackedVertex> PackVertices(std::span<const CV::Vertex> vertices, std::span<const MeshInfo> meshes)
     {
-        m_meshlets.push_back(meshlet);
+        std::vector<CV::PackedVertex> packed(vertices.size());
+        for (const MeshInfo& meshInfo : meshes)
+        {
+            const glm::vec3 extent = meshInfo.boundsMax - meshInfo.boundsMin;
+            const glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                                      extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                                      extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+            for (size_t i = meshInfo.startVertex; i < meshInfo.startVertex + meshInfo.vertexCount; i++)
+            {
+                const CV::Vertex& v = vertices[i];
+                CV::PackedVertex& p = packed[i];
+
+                const glm::vec3 position = (v.pos - meshInfo.boundsMin) * invExtent;
+                p.pos[0] = static_cast<u16>(meshopt_quantizeUnorm(position.x, 16));
+                p.pos[1] = static_cast<u16>(meshopt_quantizeUnorm(position.y, 16));
+                p.pos[2] = static_cast<u16>(meshopt_quantizeUnorm(position.z, 16));
+                p.tangentSign = v.tangent.w < 0.0f ? 1 : 0;
+
+                p.texCoord[0] = meshopt_quantizeHalf(v.texCoord.x);
+                p.texCoord[1] = meshopt_quantizeHalf(v.texCoord.y);
+
+                const glm::vec2 normal = OctEncode(v.normal);
+                const glm::vec2 tangent = OctEncode(glm::vec3(v.tangent));
+                p.normal[0] = static_cast<i8>(meshopt_quantizeSnorm(normal.x, 8));
+                p.normal[1] = static_cast<i8>(meshopt_quantizeSnorm(normal.y, 8));
+                p.tangent[0] = static_cast<i8>(meshopt_quantizeSnorm(tangent.x, 8));
+                p.tangent[1] = static_cast<i8>(meshopt_quantizeSnorm(tangent.y, 8));
+            }
+        }
+        return packed;
     }
 }
 #endif
 
-void CV::Model::SetBuffers()
+void CV::Model::SetBuffers(std::span<const Vertex> vertices, std::span<const u32> indices)
 {
-    vk::DeviceSize bufferSize;
-    vk::Buffer stagingBuffer{};
-    vk::DeviceMemory stagingBufferMemory{};
-    void* data;
-    // meshlet buffer stuff
-#if MESH_SHADING
-    bufferSize = m_meshlets.size() * sizeof(Meshlet);
-
-    stagingBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
-        .build(stagingBufferMemory);
-
-    data = nullptr;
-    vkMapMemory(_renderer->_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, m_meshlets.data(), bufferSize);
-    vkUnmapMemory(_renderer->_device, stagingBufferMemory);
-
-    m_meshletBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eDeviceLocal)
-        .build(m_meshletMemory);
-
-    CopyBuffer(_renderer->_device, _renderer->_commandPool, _renderer->_graphicsQueue, stagingBuffer, m_meshletBuffer,
-               bufferSize);
-    vkDestroyBuffer(_renderer->_device, stagingBuffer, nullptr);
-    vkFreeMemory(_renderer->_device, stagingBufferMemory, nullptr);
-#else
+    _vertexCount = vertices.size();
+    _indexCount = indices.size();
+
     // vertex buffer
-    bufferSize = sizeof(Vertex) * _vertices.size();
-
-    stagingBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferSrc| vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
-        .build(stagingBufferMemory);
-
-    vkMapMemory(_renderer->_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, _vertices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(_renderer->_device, stagingBufferMemory);
-
-    _vertexBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eDeviceLocal)
-        .build(_vertexMemory);
-
-    CopyBuffer(_renderer->_device, _renderer->_commandPool, _renderer->_graphicsQueue, stagingBuffer, _vertexBuffer,
-               bufferSize);
+#if COMPACT_VERTICES
+    const std::vector<PackedVertex> packedVertices = PackVertices(vertices, _meshes);
+    _vertexBuffer = UploadBuffer(packedVertices.data(), packedVertices.size() * sizeof(PackedVertex),
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+#else
+    _vertexBuffer = UploadBuffer(vertices.data(), vertices.size_bytes(),
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+#endif
+
+    // meshlet buffer stuff, all three are read through their device address
+#if MESH_SHADING
+    _meshletBuffer = UploadBuffer(_meshlets.data(), _meshlets.size() * sizeof(Meshlet),
+        vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    _meshletVertexBuffer = UploadBuffer(_meshletVertices.data(), _meshletVertices.size() * sizeof(u32),
+        vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    _meshletTriangleBuffer = UploadBuffer(_meshletTriangles.data(), _meshletTriangles.size(),
+        vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    printl(Log::LogLevel::InfoDebug, "[MODEL] {} meshlets, {} meshlet vertices, {} KB triangles",
+        _meshlets.size(), _meshletVertices.size(), _meshletTriangles.size() / 1024);
 #endif
 
+    // material table, the bindless slots of each material's textures
+    std::vector<MaterialData> materialData(_materials.size());
+    for (size_t i = 0; i < _materials.size(); i++)
+    {
+        const Material& material = _materials[i];
+        materialData[i].albedoIndex = GetBindlessIndex(material.albedoIndex);
+        materialData[i].normalIndex = GetBindlessIndex(material.normalIndex);
+        materialData[i].metallicIndex = GetBindlessIndex(material.metallicIndex);
+        materialData[i].emissiveIndex = GetBindlessIndex(material.emmisiveIndex);
+    }
+    if (!materialData.empty())
+        _materialBuffer = UploadBuffer(materialData.data(), materialData.size() * sizeof(MaterialData),
+            vk::BufferUsageFlagBits::eShaderDeviceAddress);
+
+    // instance table, the normal matrix is computed here once rather than per frame. Instances of one mesh can differ
+    // in material
+    std::vector<InstanceData> instanceData(_instances.size());
+    for (size_t i = 0; i < _instances.size(); i++)
+    {
+        const MeshInstance& instance = _instances[i];
+        InstanceData& gpuInstance = instanceData[i];
+        gpuInstance.world = instance.world * _meshes[instance.meshIndex].PositionDecode();
+        gpuInstance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.world)));
+        gpuInstance.materialIndex = instance.materialIndex;
+    }
+    _instanceBuffer = UploadBuffer(instanceData.data(), instanceData.size() * sizeof(InstanceData),
+        vk::BufferUsageFlagBits::eShaderDeviceAddress);
+
     // index buffer
-    bufferSize = _indices.size() * sizeof(_indices[0]);
-
-    stagingBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
-        .build(stagingBufferMemory);
-
-    data = nullptr;
-    vkMapMemory(_renderer->_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, _indices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(_renderer->_device, stagingBufferMemory);
-
-    _indexBuffer = _resourceManager->CreateBufferBuilder()
-        .setSize(bufferSize)
-        .setUsage(vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer)
-        .setMemoryProperties(vk::MemoryPropertyFlagBits::eDeviceLocal)
-        .build(_indexMemory);
-
-    CopyBuffer(_renderer->_device, _renderer->_commandPool, _renderer->_graphicsQueue, stagingBuffer, _indexBuffer,
-               bufferSize);
-    vkDestroyBuffer(_renderer->_device, stagingBuffer, nullptr);
-    vkFreeMemory(_renderer->_device, stagingBufferMemory, nullptr);
+#if COMPACT_VERTICES
+    // indices are local to the mesh (drawn with vertexOffset = startVertex), so anything up to 65536 vertices fits in 16 bits
+    std::vector<u16> shortIndices;
+    std::vector<u32> longIndices;
+    for (MeshInfo& meshInfo : _meshes)
+    {
+        const MeshLod& lastLod = meshInfo.lods[meshInfo.lodCount - 1];
+        const auto first = indices.begin() + meshInfo.startIndex;
+        const auto last = indices.begin() + lastLod.startIndex + lastLod.indexCount;
+
+        meshInfo.shortIndices = meshInfo.vertexCount <= 65536;
+        if (meshInfo.shortIndices)
+        {
+            meshInfo.gpuIndexBase = static_cast<u32>(shortIndices.size());
+            std::transform(first, last, std::back_inserter(shortIndices), [](u32 index) { return static_cast<u16>(index); });
+        }
+        else
+        {
+            meshInfo.gpuIndexBase = static_cast<u32>(longIndices.size());
+            longIndices.insert(longIndices.end(), first, last);
+        }
+    }
+
+    if (!shortIndices.empty())
+        _indexBuffer16 = UploadBuffer(shortIndices.data(), shortIndices.size() * sizeof(u16), vk::BufferUsageFlagBits::eIndexBuffer);
+    if (!longIndices.empty())
+        _indexBuffer = UploadBuffer(longIndices.data(), longIndices.size() * sizeof(u32), vk::BufferUsageFlagBits::eIndexBuffer);
+
+    printl(Log::LogLevel::InfoDebug, "[MODEL] Compact buffers: {} KB vertices, {} short / {} long indices",
+        _vertexCount * sizeof(PackedVertex) / 1024, shortIndices.size(), longIndices.size());
+#else
+    for (MeshInfo& meshInfo : _meshes)
+    {
+        meshInfo.gpuIndexBase = meshInfo.startIndex;
+        meshInfo.shortIndices = false;
+    }
+    _indexBuffer = UploadBuffer(indices.data(), indices.size_bytes(), vk::BufferUsageFlagBits::eIndexBuffer);
+#endif
+
+    UploadDrawRecords();
 
     // unlike DX11, samplers handled independent of pipeline, so they are handled by the texture class.
     // will be handled during the desc layout stuff. Creating a large texture array,
@@ -582,7 +1164,7 @@ void CV::Model::ValidateResources() const
 {
     printl(Log::LogLevel::Info,
                 "[CGLTF] Validating Model Resources: \nVertices: {} \nIndices: {}\nMaterials: {}\nMeshes: {}",
-                _vertices.size(), _indices.size(), _materials.size(), _meshes.size());
+                _vertexCount, _indexCount, _materials.size(), _meshes.size());
     // Check camera position
     //DirectX::XMFLOAT3 pos;
     /*XMStoreFloat3(&pos, camera->GetPosition());
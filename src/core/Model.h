@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <map>
+#include <span>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -10,7 +13,12 @@
 #include <memory>
 #include "StandardTypes.h"
 #include "common.h"
+#include "Culling.h"
 #include "ResourceManager.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+#include "UploadBatch.h"
+#include "Vertex.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -21,6 +29,7 @@ namespace CV
     struct Vertex;
     class Texture;
     struct Meshlet;
+    class MeshCache;
 }
 
 enum class TextureType
@@ -91,18 +100,76 @@ struct Mesh
     std::vector<u32> indices;
     u32 vertexCount;
     u32 indexCount;
+    // MESH_SHADING only, offsets local to this mesh until MergePrimitives
+    std::vector<CV::Meshlet> meshlets;
+    std::vector<u32> meshletVertices;
+    std::vector<u8> meshletTriangles;
 };
 
 
+struct MeshLod
+{
+    uint32_t startIndex = 0;    // into _indices
+    uint32_t indexCount = 0;
+    float error = 0.0f;         // simplification error in object space units
+};
+
+// unique geometry, shared by every node that references the same accessors. Placement and material live in MeshInstance
 struct MeshInfo
 {
     size_t vertexCount = 0;
-    size_t indexCount = 0;
-    u32 materialIndex = -1;
+    size_t indexCount = 0;      // LOD 0
     uint32_t startIndex = 0;
     uint32_t startVertex = 0;
-    Transformation transform;
-    glm::mat4 normalMatrix;
+    uint32_t instanceOffset = 0;    // into _instances, which is sorted by mesh
+    uint32_t instanceCount = 0;
+    MeshLod lods[MAX_LODS];
+    u32 lodCount = 0;
+    glm::vec3 boundsCenter{};   // object space bounding sphere
+    float boundsRadius = 0.0f;
+    glm::vec3 boundsMin{};      // object space box, also the quantisation range of PackedVertex
+    glm::vec3 boundsMax{};
+    // filled by SetBuffers: first index of this mesh in the GPU index buffer it lives in,
+    // lod.startIndex - startIndex + gpuIndexBase gives the firstIndex of a draw
+    uint32_t gpuIndexBase = 0;
+    bool shortIndices = false;  // in _indexBuffer16 rather than _indexBuffer
+    uint32_t meshletOffset = 0; // into _meshlets, built from LOD 0 (MESH_SHADING only)
+    uint32_t meshletCount = 0;
+
+    // maps the positions stored in the vertex buffer to object space
+    glm::mat4 PositionDecode() const
+    {
+#if COMPACT_VERTICES
+        return glm::scale(glm::translate(glm::mat4(1.f), boundsMin), boundsMax - boundsMin);
+#else
+        return glm::mat4(1.f);
+#endif
+    }
+};
+
+// one node (or EXT_mesh_gpu_instancing entry) drawing a mesh
+struct MeshInstance
+{
+    glm::mat4 world;
+    u32 meshIndex = -1;
+    u32 materialIndex = -1;
+};
+
+// one unique glTF primitive to be imported. Collected serially while walking the node graph (materials are resolved there),
+// then decoded and optimised in parallel
+struct PrimitiveJob
+{
+    cgltf_primitive* primitive = nullptr;
+    const cgltf_accessor* position = nullptr;
+    const cgltf_accessor* texCoord = nullptr;
+    const cgltf_accessor* normal = nullptr;
+    const cgltf_accessor* tangent = nullptr;
+};
+
+struct PrimitiveResult
+{
+    MeshInfo meshInfo;
+    Mesh mesh;
 };
 
 namespace CV
@@ -112,15 +179,44 @@ namespace CV
     public:
         Model();
         ~Model();
-        void LoadModel(const std::shared_ptr<Renderer>& renderer, const std::string& path);
+        // buffers and textures are created in (and owned by) resourceManager, which has to outlive the model
+        void LoadModel(const std::shared_ptr<Renderer>& renderer, ResourceManager& resourceManager, const std::string& path);
         glm::mat4 ComputeNormalMatrix(const glm::mat4 worldMatrix);
-        void SetBuffers();
+        // records into the load's upload batch, only valid inside LoadModel
+        void SetBuffers(std::span<const Vertex> vertices, std::span<const u32> indices);
+        // total threads used for the primitive import (calling thread included). 0 = hardware_concurrency
+        void SetImportThreadCount(u32 count) { _importThreadCount = count; }
+        // on: LoadModel returns once the geometry is up, textures keep decoding and uploading on the transfer queue and
+        // become resident over the next frames (UpdateStreaming). Off: LoadModel waits for all of them
+        void SetStreamTextures(bool enabled) { _streamTextures = enabled; }
+        // once per frame on the render thread. Records the uploads of textures whose decode has finished and retires the
+        // previous frame's. Returns true if any texture became resident, i.e. the texture descriptors need rewriting
+        bool UpdateStreaming();
+        [[nodiscard]] bool IsStreaming() const { return _streamBatch != nullptr; }
     private:
-        void ProcessNode(cgltf_node *node, const cgltf_data *data, std::vector<Vertex> &vertices, std::vector<u32> &indices, Transformation& parentTransform);
-        void ProcessMesh(cgltf_primitive *primitive, std::vector<Vertex> &vertices, std::vector<u32> &indices, Transformation& parentTransform);
-        void OptimiseMesh(MeshInfo& meshInfo, Mesh& mesh);
-        void ProcessMeshlets(Mesh& mesh);
+        void ProcessNode(cgltf_node *node, const cgltf_data *data, Transformation& parentTransform);
+        void ProcessMesh(cgltf_primitive *primitive, std::span<const glm::mat4> instanceTransforms);
+        void ImportPrimitive(const PrimitiveJob& job, PrimitiveResult& result) const;
+        void MergePrimitives(std::vector<PrimitiveResult>& results);
+        void BuildInstanceRanges();
+        void BuildInstanceBounds();
+        // after the index buffers, needs gpuIndexBase / shortIndices and _instanceBounds
+        void UploadDrawRecords();
+        void LoadFromCache(const MeshCache& cache);
+        void WriteCache(const std::string& cachePath, u64 sourceHash, const cgltf_data* data) const;
+        static void OptimiseMesh(MeshInfo& meshInfo, Mesh& mesh);
+        static void BuildMeshlets(Mesh& mesh);
+        BufferHandle UploadBuffer(const void* srcData, vk::DeviceSize bufferSize, vk::BufferUsageFlags usage);
+        // into the texture's reserved slot, resident once the batch has been waited on
+        void UploadTexture(u32 textureIndex, UploadBatch& batch, const TextureData& textureData);
+        // model texture index (as stored in Material) -> bindless slot, -1 stays -1
+        u32 GetBindlessIndex(u32 textureIndex) const;
         u32 LoadMaterialTexture(Material& mat, const cgltf_texture_view* textureView, TextureType type);
+        u32 LoadTextureFile(const std::string& uri);
+        void FinishTextureLoads();
+        void FinishUploads();
+        std::unique_ptr<UploadBatch> CreateUploadBatch() const;
+        void ResolveMaterialViews();
         void ValidateResources() const;
 
         //ConstantBuffer cb;
@@ -128,32 +224,56 @@ namespace CV
 
     public:
         std::string _dirPath;
+        // only filled on a cold import, a cache hit uploads straight from the mapped .cvmesh
         std::vector<Vertex> _vertices;
         std::vector<u32> _indices;
+        size_t _vertexCount = 0;
+        size_t _indexCount = 0;
         std::vector<MeshInfo> _meshes;
+        std::vector<MeshInstance> _instances;
+        CullBounds _instanceBounds;     // world space box + sphere per _instances entry
         std::vector<Meshlet> _meshlets;
+        std::vector<u32> _meshletVertices;
+        std::vector<u8> _meshletTriangles;
         std::vector<Material> _materials;
 
         std::shared_ptr<Renderer> _renderer;
 
 
-        vk::Buffer _vertexBuffer = VK_NULL_HANDLE;
-        vk::Buffer _indexBuffer = VK_NULL_HANDLE;
-        vk::Buffer _meshletBuffer = VK_NULL_HANDLE;
+        // all in the resource manager's pools
+        BufferHandle _vertexBuffer;
+        BufferHandle _indexBuffer;
+        BufferHandle _indexBuffer16;  // COMPACT_VERTICES only, meshes with <= 65536 vertices
+        BufferHandle _instanceBuffer;  // InstanceData per _instances entry
+        BufferHandle _materialBuffer;  // MaterialData per _materials entry
+        BufferHandle _meshletBuffer;
+        BufferHandle _meshletVertexBuffer;
+        BufferHandle _meshletTriangleBuffer;
+        BufferHandle _drawRecordBuffer;  // DrawRecord per _instances entry, grouped by DRAW_REGION_*
+        // where each region's records (and the culled draws) start, and how many there are
+        u32 _drawRegionOffset[DRAW_REGION_COUNT]{};
+        u32 _drawRegionCount[DRAW_REGION_COUNT]{};
 
-        std::vector<Texture> modelTextures;
+        std::vector<TextureHandle> _textures;      // in load order, Material texture indices point in here
+        std::vector<std::string> _texturePaths;    // uri of every _textures entry, relative to _dirPath
     private:
 
-
-        vk::DeviceMemory _vertexMemory = VK_NULL_HANDLE;
-        vk::DeviceMemory _indexMemory = VK_NULL_HANDLE;
-        vk::DeviceMemory _meshletMemory = VK_NULL_HANDLE;
-
         std::unordered_set<std::string> loadedTextures; // To track loaded textures
         std::unordered_map<cgltf_material*, size_t> materialLookup;
         std::unordered_map<std::string, size_t> textureIndexLookup;
 
-        ResourceManager* _resourceManager;
+        ResourceManager* _resourceManager = nullptr;
 
+        std::unique_ptr<ThreadPool> _importPool;   // only alive during LoadModel
+        std::unique_ptr<UploadBatch> _uploadBatch;  // same, every buffer (and texture unless streaming) of the load goes out in one submit
+        std::unique_ptr<UploadBatch> _streamBatch;  // texture streaming, alive (with _importPool) until every texture is resident
+        std::vector<u32> _streamedTextures;         // uploads in _streamBatch's last submit
+        bool _streamTextures = true;
+        // shared so UpdateStreaming can look at a decode (its staging size) and still leave it for a later frame
+        std::vector<std::pair<u32, std::shared_future<TextureData>>> _pendingTextures;
+        std::vector<PrimitiveJob> _primitiveJobs;
+        // geometry identity (indices + attribute accessors) -> index into _primitiveJobs
+        std::map<std::array<const cgltf_accessor*, 5>, u32> _primitiveLookup;
+        u32 _importThreadCount = 0;
     };
 }
\ No newline at end of file
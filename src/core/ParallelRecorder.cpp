@@ -0,0 +1,39 @@
+#include <pch.h>
+
+#include <cassert>
+
+#include "ParallelRecorder.h"
+#include "Log.h"
+
+namespace CV
+{
+	ParallelRecorder::ParallelRecorder(u32 threadCount)
+		: m_threadPool(threadCount), m_chunkCount(m_threadPool.GetWorkerCount() + 1)
+	{
+		printl(Log::LogLevel::Info, "[RECORD] {} recording threads", m_chunkCount);
+	}
+
+	std::span<const vk::CommandBuffer> ParallelRecorder::Record(std::span<const vk::CommandBuffer> secondaries, u32 chunkCount,
+		const vk::CommandBufferInheritanceRenderingInfo& renderingInfo, const std::function<void(u32, vk::CommandBuffer)>& record)
+	{
+		assert(chunkCount <= m_chunkCount && chunkCount <= secondaries.size());
+
+		m_threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+		{
+			vk::CommandBuffer cmd = secondaries[chunk];
+
+			vk::CommandBufferInheritanceInfo inheritanceInfo{};
+			inheritanceInfo.pNext = &renderingInfo;
+
+			vk::CommandBufferBeginInfo beginInfo{};
+			beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+			beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+			cmd.begin(beginInfo);
+			record(static_cast<u32>(chunk), cmd);
+			cmd.end();
+		});
+
+		return secondaries.first(chunkCount);
+	}
+}
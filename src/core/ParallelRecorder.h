@@ -0,0 +1,43 @@
+#ifndef PARALLEL_RECORDER_H
+#define PARALLEL_RECORDER_H
+
+#include <functional>
+#include <span>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "ThreadPool.h"
+
+// records the draws of one rendering scope as secondary command buffers on a thread pool, the primary then executes them
+// in chunk order. Command pools are externally synchronised, so every chunk records into a secondary of its own pool,
+// only ever touched by the one thread that picked the chunk. Those pools belong to the frame in flight (FrameContext,
+// created with GetMaxChunkCount() secondaries) and are reset with the rest of it, nothing is freed per buffer.
+// Secondaries inherit nothing but the attachment formats: pipeline, dynamic state, descriptor sets and push constants
+// have to be set again in every chunk.
+
+namespace CV
+{
+	class ParallelRecorder
+	{
+	public:
+		// threadCount includes the calling thread, 0 picks hardware_concurrency. It is also the most chunks per frame
+		explicit ParallelRecorder(u32 threadCount = 0);
+		ParallelRecorder(const ParallelRecorder&) = delete;
+		ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+		// runs record(chunk, cmd) for every chunk in [0, chunkCount) across the pool, each into secondaries[chunk], begun
+		// to continue the rendering described by renderingInfo. The secondaries of the frame being recorded, each from a
+		// pool of its own. The result goes to executeCommands, inside a rendering scope begun with
+		// vk::RenderingFlagBits::eContentsSecondaryCommandBuffers
+		std::span<const vk::CommandBuffer> Record(std::span<const vk::CommandBuffer> secondaries, u32 chunkCount,
+			const vk::CommandBufferInheritanceRenderingInfo& renderingInfo, const std::function<void(u32, vk::CommandBuffer)>& record);
+
+		[[nodiscard]] u32 GetMaxChunkCount() const { return m_chunkCount; }
+
+	private:
+		ThreadPool m_threadPool;
+		u32 m_chunkCount;
+	};
+}
+
+#endif
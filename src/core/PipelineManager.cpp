@@ -1,6 +1,12 @@
 #include <pch.h>
 
 #include "PipelineManager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include "Log.h"
 #include "ResourceManager.h"
@@ -8,21 +14,114 @@
 #include "vk_utils.h"
 #include "renderer.h"
 
+namespace
+{
+    constexpr const char* kManifestMagic = "cvpipelines";
+    constexpr uint32_t kManifestVersion = 2;
+
+    std::vector<std::string> splitString(const std::string& text, char separator)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (true)
+        {
+            const size_t end = text.find(separator, start);
+            parts.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos)
+                return parts;
+            start = end + 1;
+        }
+    }
+
+    // the file goes to a temp path first and is then renamed, a crash mid write never leaves half a file behind
+    bool writeFileAtomic(const std::string& path, const void* data, size_t size)
+    {
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                printl(Log::LogLevel::Warn, "[PIPELINE] Failed to open {} for writing", tempPath);
+                return false;
+            }
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            if (!out)
+            {
+                printl(Log::LogLevel::Warn, "[PIPELINE] Failed writing {}", tempPath);
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec)
+        {
+            printl(Log::LogLevel::Warn, "[PIPELINE] Failed to move {} into place: {}", tempPath, ec.message());
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+        return true;
+    }
+}
+
 namespace CV
 {
-    PipelineManager::PipelineManager(ResourceManager* resourceManager, const std::shared_ptr<Renderer>& renderer) : _resourceManager(resourceManager), _renderer(renderer) {}
+    PipelineManager::PipelineManager(ResourceManager* resourceManager, Renderer* renderer) : _resourceManager(resourceManager), _renderer(renderer) {}
+
+    PipelineManager::~PipelineManager()
+    {
+        finishCompiles();
+
+        const vk::Device device = _renderer->_device;
+        for (const PipelineTable::Entry& entry : m_pipelines.GetSlots())
+        {
+            if (entry.pipeline)
+                device.destroyPipeline(entry.pipeline);
+        }
+        for (auto& [layoutKey, layout] : m_pipelineLayoutCache)
+        {
+            device.destroyPipelineLayout(layout);
+        }
+        if (m_vkPipelineCache)
+        {
+            device.destroyPipelineCache(m_vkPipelineCache);
+        }
+    }
 
     vk::Pipeline PipelineManager::getPipeline(const std::string& pipelineKey)
     {
-        auto it = m_pipelineCache.find(pipelineKey);
-        if (it != m_pipelineCache.end()) {
+        auto it = m_pipelineNames.find(pipelineKey);
+        if (it != m_pipelineNames.end()) {
+            return getPipeline(it->second);
+        }
+        printl(Log::LogLevel::Error,"[PIPELINE] Pipeline not found: {}", pipelineKey);
+        throw std::runtime_error("Pipeline not found");
+    }
+
+    vk::Pipeline PipelineManager::getPipeline(u64 pipelineId)
+    {
+        const PipelineTable::Entry* entry = m_pipelines.Find(pipelineId);
+        if (entry && entry->pipeline) {
+            return entry->pipeline;
+        }
+        if (entry && entry->fallback) {
+            return getPipeline(entry->fallback);
+        }
+        printl(Log::LogLevel::Error,"[PIPELINE] Pipeline not found: {:016x}", pipelineId);
+        throw std::runtime_error("Pipeline not found");
+    }
+
+    u64 PipelineManager::getPipelineId(const std::string& pipelineKey) const
+    {
+        auto it = m_pipelineNames.find(pipelineKey);
+        if (it != m_pipelineNames.end()) {
             return it->second;
         }
         printl(Log::LogLevel::Error,"[PIPELINE] Pipeline not found: {}", pipelineKey);
         throw std::runtime_error("Pipeline not found");
     }
 
-    vk::PipelineLayout PipelineManager::getPipelineLayout(const std::string& pipelineLayoutKey)
+    vk::PipelineLayout PipelineManager::getPipelineLayout(u64 pipelineLayoutKey)
     {
         if (m_pipelineLayoutCache.contains(pipelineLayoutKey))
         {
@@ -53,9 +152,9 @@ namespace CV
         return *this;
     }
 
-    PipelineManager::Builder& PipelineManager::Builder::setPipelineLayout(vk::PipelineLayout pipelineLayout)
+    PipelineManager::Builder& PipelineManager::Builder::setComputeShader(const std::string& path)
     {
-        m_pipelineLayout = pipelineLayout;
+        m_compShaderPath = path;
         return *this;
     }
 
@@ -65,6 +164,13 @@ namespace CV
         return *this;
     }
 
+    PipelineManager::Builder& PipelineManager::Builder::setPushConstants(vk::ShaderStageFlags stages, uint32_t size)
+    {
+        m_pushConstantStages = stages;
+        m_pushConstantSize = size;
+        return *this;
+    }
+
     PipelineManager::Builder& PipelineManager::Builder::setDynamicStates(const std::vector<vk::DynamicState>& dynamicStates)
     {
         m_dynamicStates = dynamicStates;
@@ -77,6 +183,13 @@ namespace CV
         return *this;
     }
 
+    PipelineManager::Builder& PipelineManager::Builder::setCullMode(vk::CullModeFlags cullMode, vk::FrontFace frontFace)
+    {
+        m_cullMode = cullMode;
+        m_frontFace = frontFace;
+        return *this;
+    }
+
     PipelineManager::Builder& PipelineManager::Builder::setDepthTest(bool enable)
     {
         m_depthTest = enable;
@@ -89,43 +202,251 @@ namespace CV
         return *this;
     }
 
+    PipelineManager::Builder& PipelineManager::Builder::setAttachmentFormats(vk::Format colorFormat, vk::Format depthFormat)
+    {
+        m_colorFormat = colorFormat;
+        m_depthFormat = depthFormat;
+        return *this;
+    }
+
     vk::Pipeline PipelineManager::Builder::build(const std::string& pipelineKey)
     {
         return m_manager->createPipeline(pipelineKey, *this);
     }
 
+    std::shared_future<vk::Pipeline> PipelineManager::Builder::buildAsync(const std::string& pipelineKey, const std::string& fallbackKey)
+    {
+        return m_manager->createPipelineAsync(pipelineKey, fallbackKey, *this);
+    }
+
     vk::Pipeline PipelineManager::createPipeline(const std::string& pipelineKey, const Builder& builder)
     {
-        if (m_pipelineCache.contains(pipelineKey))
+        const PipelineState state = makePipelineState(builder);
+        const u64 pipelineId = HashPipelineState(state);
+        registerName(pipelineKey, pipelineId, builder);
+
+        // asked for synchronously after all, so wait for the background compile rather than start another one
+        if (m_asyncBuilds.contains(pipelineId))
+        {
+            m_asyncBuilds[pipelineId].pipeline.wait();
+            Update();
+        }
+
+        // the same state under any name is compiled once
+        if (const PipelineTable::Entry* entry = m_pipelines.Find(pipelineId, state); entry && entry->pipeline)
+        {
+            return entry->pipeline;
+        }
+
+        vk::Pipeline pipeline;
+        auto job = m_warmUpJobs.find(pipelineId);
+        if (job != m_warmUpJobs.end())
+        {
+            pipeline = job->second.get();
+            m_warmUpJobs.erase(job);
+        }
+
+        if (!pipeline)
+        {
+            const PipelineStages stages = resolveStages(builder);
+            pipeline = builder.m_compShaderPath.empty() ? compileGraphicsPipeline(pipelineKey, state, stages)
+                : compileComputePipeline(pipelineKey, stages);
+        }
+
+        m_pipelines.Insert(pipelineId, state).pipeline = pipeline;
+        return pipeline;
+    }
+
+    std::shared_future<vk::Pipeline> PipelineManager::createPipelineAsync(const std::string& pipelineKey, const std::string& fallbackKey,
+        const Builder& builder)
+    {
+        const u64 fallbackId = getPipelineId(fallbackKey);
+        const PipelineState state = makePipelineState(builder);
+        const u64 pipelineId = HashPipelineState(state);
+        registerName(pipelineKey, pipelineId, builder);
+
+        if (const PipelineTable::Entry* entry = m_pipelines.Find(pipelineId, state); entry && entry->pipeline)
+        {
+            std::promise<vk::Pipeline> ready;
+            ready.set_value(entry->pipeline);
+            return ready.get_future().share();
+        }
+        auto build = m_asyncBuilds.find(pipelineId);
+        if (build != m_asyncBuilds.end())
+        {
+            return build->second.pipeline;
+        }
+
+        std::shared_future<vk::Pipeline> pipeline;
+        auto job = m_warmUpJobs.find(pipelineId);
+        if (job != m_warmUpJobs.end())
+        {
+            pipeline = job->second.share();
+            m_warmUpJobs.erase(job);
+        }
+        else
+        {
+            const PipelineStages stages = resolveStages(builder);
+            const bool compute = !builder.m_compShaderPath.empty();
+            pipeline = getCompilePool().Submit([this, pipelineKey, state, stages, compute]() -> vk::Pipeline
+            {
+                return compute ? compileComputePipeline(pipelineKey, stages) : compileGraphicsPipeline(pipelineKey, state, stages);
+            }).share();
+        }
+
+        // in the table right away, getPipeline hands out the fallback until Update fills in the pipeline
+        m_pipelines.Insert(pipelineId, state).fallback = fallbackId;
+        m_asyncBuilds.emplace(pipelineId, AsyncBuild{ pipelineKey, pipeline });
+        return pipeline;
+    }
+
+    void PipelineManager::Update()
+    {
+        for (auto it = m_asyncBuilds.begin(); it != m_asyncBuilds.end();)
+        {
+            if (it->second.pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++it;
+                continue;
+            }
+
+            vk::Pipeline pipeline;
+            try
+            {
+                pipeline = it->second.pipeline.get();
+            }
+            catch (vk::SystemError&)
+            {
+                // already reported by the compile
+            }
+
+            PipelineTable::Entry* entry = m_pipelines.Find(it->first);
+            if (pipeline)
+            {
+                entry->pipeline = pipeline;
+                m_compiledCount++;
+            }
+            else
+            {
+                printl(Log::LogLevel::Error, "[PIPELINE] {} failed to compile, drawing with its fallback instead", it->second.pipelineKey);
+                m_failedCount++;
+            }
+            it = m_asyncBuilds.erase(it);
+        }
+    }
+
+    PipelineManager::CompileStats PipelineManager::getCompileStats() const
+    {
+        return { static_cast<uint32_t>(m_asyncBuilds.size()), m_compiledCount, m_failedCount };
+    }
+
+    ThreadPool& PipelineManager::getCompilePool()
+    {
+        // half the cores, a background compile shouldn't push the recording threads off theirs
+        if (!m_compilePool)
+        {
+            m_compilePool = std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency() / 2, 1u) + 1);
+        }
+        return *m_compilePool;
+    }
+
+    PipelineState PipelineManager::makePipelineState(const Builder& builder) const
+    {
+        auto hashPath = [](const std::string& path) -> u64 { return path.empty() ? 0 : HashBytes(path.data(), path.size()); };
+
+        PipelineState state{};
+        state.shaders[0] = hashPath(builder.m_vertShaderPath);
+        state.shaders[1] = hashPath(builder.m_meshShaderPath);
+        state.shaders[2] = hashPath(builder.m_fragShaderPath);
+        state.shaders[3] = hashPath(builder.m_compShaderPath);
+        state.layout = makePipelineLayoutKey(builder.m_descriptorSetLayoutKeys, builder.m_pushConstantStages, builder.m_pushConstantSize);
+        // nothing else goes into a compute pipeline
+        if (!builder.m_compShaderPath.empty())
+        {
+            return state;
+        }
+
+        state.colorFormat = builder.m_colorFormat != vk::Format::eUndefined ? builder.m_colorFormat : _renderer->_swapChainImageFormat;
+        state.depthFormat = builder.m_depthFormat != vk::Format::eUndefined ? builder.m_depthFormat : _renderer->_depthImageFormat;
+        state.samples = vk::SampleCountFlagBits::e1;
+        state.topology = builder.m_topology;
+        state.polygonMode = vk::PolygonMode::eFill;
+        state.cullMode = static_cast<uint32_t>(builder.m_cullMode);
+        state.frontFace = builder.m_frontFace;
+        state.depthTest = builder.m_depthTest;
+        state.depthWrite = builder.m_depthTest;
+        state.depthCompareOp = vk::CompareOp::eLess;
+
+        state.blendEnable = builder.m_blendMode;
+        state.srcColorBlendFactor = builder.m_blendMode ? vk::BlendFactor::eSrcAlpha : vk::BlendFactor::eOne;
+        state.dstColorBlendFactor = builder.m_blendMode ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero;
+        state.colorBlendOp = vk::BlendOp::eAdd;
+        state.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+        state.dstAlphaBlendFactor = builder.m_blendMode ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eZero;
+        state.alphaBlendOp = vk::BlendOp::eAdd;
+
+        if (builder.m_dynamicStates.size() > kMaxPipelineDynamicStates)
+        {
+            printl(Log::LogLevel::Error, "[PIPELINE] {} dynamic states, PipelineState holds {}", builder.m_dynamicStates.size(), kMaxPipelineDynamicStates);
+            throw std::runtime_error("Too many dynamic states");
+        }
+        state.dynamicStateCount = static_cast<uint32_t>(builder.m_dynamicStates.size());
+        std::copy(builder.m_dynamicStates.begin(), builder.m_dynamicStates.end(), state.dynamicStates);
+        return state;
+    }
+
+    void PipelineManager::registerName(const std::string& pipelineKey, u64 pipelineId, const Builder& builder)
+    {
+        auto [it, inserted] = m_pipelineNames.try_emplace(pipelineKey, pipelineId);
+        if (inserted)
+        {
+            m_builtPipelines.push_back(describePipeline(pipelineKey, builder));
+        }
+        else if (it->second != pipelineId)
         {
-            return m_pipelineCache[pipelineKey];
+            printl(Log::LogLevel::Warn, "[PIPELINE] {} now names a different pipeline state", pipelineKey);
+            it->second = pipelineId;
         }
+    }
 
-        vk::PipelineLayout pipelineLayout = createPipelineLayout(builder.m_descriptorSetLayoutKeys);
+    PipelineManager::PipelineStages PipelineManager::resolveStages(const Builder& builder)
+    {
+        PipelineStages stages;
+        stages.layout = createPipelineLayout(builder.m_descriptorSetLayoutKeys, builder.m_pushConstantStages, builder.m_pushConstantSize);
 
+        if (!builder.m_compShaderPath.empty())
+        {
+            stages.compute = _resourceManager->getShaderModule(builder.m_compShaderPath);
+            return stages;
+        }
 #if MESH_SHADING
-        vk::ShaderModule meshShaderModule = _resourceManager->getShaderModule(builder.m_meshShaderPath);
+        stages.mesh = _resourceManager->getShaderModule(builder.m_meshShaderPath);
 #else
-        vk::ShaderModule vertShaderModule = _resourceManager->getShaderModule(builder.m_vertShaderPath);
+        stages.vertex = _resourceManager->getShaderModule(builder.m_vertShaderPath);
 #endif
-        vk::ShaderModule fragShaderModule = _resourceManager->getShaderModule(builder.m_fragShaderPath);
+        stages.fragment = _resourceManager->getShaderModule(builder.m_fragShaderPath);
+        return stages;
+    }
 
+    vk::Pipeline PipelineManager::compileGraphicsPipeline(const std::string& pipelineKey, const PipelineState& state,
+        const PipelineStages& stages) const
+    {
         // Shader stages
         vk::PipelineShaderStageCreateInfo fragShaderStageInfo;
         fragShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
-        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.module = stages.fragment;
         fragShaderStageInfo.pName = "main";
 
 #if MESH_SHADING
         vk::PipelineShaderStageCreateInfo meshShaderStageInfo;
         meshShaderStageInfo.stage = vk::ShaderStageFlagBits::eMeshEXT;
-        meshShaderStageInfo.module = meshShaderModule;
+        meshShaderStageInfo.module = stages.mesh;
         meshShaderStageInfo.pName = "main";
         std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = { meshShaderStageInfo, fragShaderStageInfo };
 #else
         vk::PipelineShaderStageCreateInfo vertexShaderStageInfo;
         vertexShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
-        vertexShaderStageInfo.module = vertShaderModule;
+        vertexShaderStageInfo.module = stages.vertex;
         vertexShaderStageInfo.pName = "main";
         std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = { vertexShaderStageInfo, fragShaderStageInfo };
 
@@ -136,7 +457,7 @@ namespace CV
         vertexInputInfo.pVertexAttributeDescriptions = nullptr;
 
         vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
-        inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+        inputAssembly.topology = state.topology;
         inputAssembly.primitiveRestartEnable = VK_FALSE;
 #endif
 
@@ -153,8 +474,8 @@ namespace CV
         scissor.extent = _renderer->_swapChainExtent;
 
         vk::PipelineDynamicStateCreateInfo dynamicState;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(builder.m_dynamicStates.size());
-        dynamicState.pDynamicStates = builder.m_dynamicStates.data();
+        dynamicState.dynamicStateCount = state.dynamicStateCount;
+        dynamicState.pDynamicStates = state.dynamicStates;
 
         vk::PipelineViewportStateCreateInfo viewportState;
         viewportState.viewportCount = 1;
@@ -165,9 +486,9 @@ namespace CV
         vk::PipelineRasterizationStateCreateInfo rasterizer;
         rasterizer.depthClampEnable = VK_FALSE;
         rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = vk::PolygonMode::eFill;
-        rasterizer.cullMode = vk::CullModeFlagBits::eNone;
-        rasterizer.frontFace = vk::FrontFace::eCounterClockwise;
+        rasterizer.polygonMode = state.polygonMode;
+        rasterizer.cullMode = vk::CullModeFlags(state.cullMode);
+        rasterizer.frontFace = state.frontFace;
         rasterizer.depthBiasEnable = VK_FALSE;
         rasterizer.depthBiasConstantFactor = 0.0f;
         rasterizer.depthBiasClamp = 0.0f;
@@ -175,7 +496,7 @@ namespace CV
         rasterizer.lineWidth = 1.0f;
 
         vk::PipelineMultisampleStateCreateInfo multisampling;
-        multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
+        multisampling.rasterizationSamples = state.samples;
         multisampling.sampleShadingEnable = VK_FALSE;
         multisampling.minSampleShading = 1.0f;
         multisampling.pSampleMask = nullptr;
@@ -183,13 +504,13 @@ namespace CV
         multisampling.alphaToOneEnable = VK_FALSE;
 
         vk::PipelineColorBlendAttachmentState colorBlendAttachment;
-        colorBlendAttachment.blendEnable = builder.m_blendMode;
-        colorBlendAttachment.srcColorBlendFactor = vk::BlendFactor::eOne;
-        colorBlendAttachment.dstColorBlendFactor = vk::BlendFactor::eZero;
-        colorBlendAttachment.colorBlendOp = vk::BlendOp::eAdd;
-        colorBlendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
-        colorBlendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
-        colorBlendAttachment.alphaBlendOp = vk::BlendOp::eAdd;
+        colorBlendAttachment.blendEnable = state.blendEnable;
+        colorBlendAttachment.srcColorBlendFactor = state.srcColorBlendFactor;
+        colorBlendAttachment.dstColorBlendFactor = state.dstColorBlendFactor;
+        colorBlendAttachment.colorBlendOp = state.colorBlendOp;
+        colorBlendAttachment.srcAlphaBlendFactor = state.srcAlphaBlendFactor;
+        colorBlendAttachment.dstAlphaBlendFactor = state.dstAlphaBlendFactor;
+        colorBlendAttachment.alphaBlendOp = state.alphaBlendOp;
         colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
             vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
 
@@ -201,9 +522,9 @@ namespace CV
         colorBlending.blendConstants = { { 0.0f, 0.0f, 0.0f, 0.0f } };
 
         vk::PipelineDepthStencilStateCreateInfo depthInfo;
-        depthInfo.depthTestEnable = VK_TRUE;
-        depthInfo.depthWriteEnable = VK_TRUE;
-        depthInfo.depthCompareOp = vk::CompareOp::eLess;
+        depthInfo.depthTestEnable = state.depthTest;
+        depthInfo.depthWriteEnable = state.depthWrite;
+        depthInfo.depthCompareOp = state.depthCompareOp;
         depthInfo.depthBoundsTestEnable = VK_FALSE;
         depthInfo.stencilTestEnable = VK_FALSE;
         depthInfo.front = vk::StencilOpState{};
@@ -215,8 +536,8 @@ namespace CV
 
         vk::PipelineRenderingCreateInfo pipelineRenderingInfo;
         pipelineRenderingInfo.colorAttachmentCount = 1;
-        pipelineRenderingInfo.pColorAttachmentFormats = &_renderer->_swapChainImageFormat;
-        pipelineRenderingInfo.depthAttachmentFormat = _renderer->_depthImageFormat;
+        pipelineRenderingInfo.pColorAttachmentFormats = &state.colorFormat;
+        pipelineRenderingInfo.depthAttachmentFormat = state.depthFormat;
 
         vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
         pipelineCreateInfo.pNext = &pipelineRenderingInfo;
@@ -232,16 +553,15 @@ namespace CV
         pipelineCreateInfo.pDepthStencilState = &depthInfo;
         pipelineCreateInfo.pColorBlendState = &colorBlending;
         pipelineCreateInfo.pDynamicState = &dynamicState;
-        pipelineCreateInfo.layout = pipelineLayout;
+        pipelineCreateInfo.layout = stages.layout;
         pipelineCreateInfo.renderPass = nullptr;
 
         try
         {
-            auto result = device.createGraphicsPipelines(nullptr, { pipelineCreateInfo });
+            auto result = device.createGraphicsPipelines(m_vkPipelineCache, { pipelineCreateInfo });
             vk::Pipeline graphicsPipeline = result.value[0];
 
-            printl(Log::LogLevel::InfoDebug,"[PIPELINE] Pipeline created with key: ", pipelineKey);
-            m_pipelineCache[pipelineKey] = graphicsPipeline;
+            printl(Log::LogLevel::InfoDebug,"[PIPELINE] Pipeline created with key: {}", pipelineKey);
             return graphicsPipeline;
         }
         catch (vk::SystemError& err)
@@ -251,14 +571,52 @@ namespace CV
         }
     }
 
-    vk::PipelineLayout PipelineManager::createPipelineLayout(const std::vector<std::string>& descLayoutKeys)
+    vk::Pipeline PipelineManager::compileComputePipeline(const std::string& pipelineKey, const PipelineStages& stages) const
+    {
+        vk::ComputePipelineCreateInfo pipelineCreateInfo{};
+        pipelineCreateInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+        pipelineCreateInfo.stage.module = stages.compute;
+        pipelineCreateInfo.stage.pName = "main";
+        pipelineCreateInfo.layout = stages.layout;
+
+        try
+        {
+            auto result = _renderer->_device.createComputePipelines(m_vkPipelineCache, { pipelineCreateInfo });
+            vk::Pipeline computePipeline = result.value[0];
+
+            printl(Log::LogLevel::InfoDebug,"[PIPELINE] Compute pipeline created with key: {}", pipelineKey);
+            return computePipeline;
+        }
+        catch (vk::SystemError& err)
+        {
+            printl(Log::LogLevel::Error,"[VULKAN] Compute pipeline creation Failure : {} ", std::string(err.what()));
+            throw;
+        }
+    }
+
+    u64 PipelineManager::makePipelineLayoutKey(const std::vector<std::string>& descLayoutKeys,
+        vk::ShaderStageFlags pushConstantStages, uint32_t pushConstantSize)
     {
-        std::string pipelineLayoutKey{};
+        u64 pipelineLayoutKey = HashBytes(nullptr, 0);
 
         for (const auto& key : descLayoutKeys)
         {
-            pipelineLayoutKey += key + ";";
+            pipelineLayoutKey = HashBytes(key.data(), key.size(), pipelineLayoutKey);
+            pipelineLayoutKey = HashBytes(";", 1, pipelineLayoutKey);
         }
+        // anything but the default push constants is part of the key
+        if (pushConstantSize != 0)
+        {
+            const uint32_t push[2] = { static_cast<uint32_t>(pushConstantStages), pushConstantSize };
+            pipelineLayoutKey = HashBytes(push, sizeof(push), pipelineLayoutKey);
+        }
+        return pipelineLayoutKey;
+    }
+
+    vk::PipelineLayout PipelineManager::createPipelineLayout(const std::vector<std::string>& descLayoutKeys,
+        vk::ShaderStageFlags pushConstantStages, uint32_t pushConstantSize)
+    {
+        const u64 pipelineLayoutKey = makePipelineLayoutKey(descLayoutKeys, pushConstantStages, pushConstantSize);
 
         if (m_pipelineLayoutCache.contains(pipelineLayoutKey))
         {
@@ -279,6 +637,11 @@ namespace CV
 #endif
         pushConstantRange.offset = 0;
         pushConstantRange.size = sizeof(PushConstants);
+        if (pushConstantSize != 0)
+        {
+            pushConstantRange.stageFlags = pushConstantStages;
+            pushConstantRange.size = pushConstantSize;
+        }
 
         vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
         pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
@@ -299,4 +662,236 @@ namespace CV
             throw;
         }
     }
+
+    void PipelineManager::LoadPipelineCache(const std::string& cachePath, const std::string& manifestPath)
+    {
+        m_pipelineCachePath = cachePath;
+        m_manifestPath = manifestPath;
+
+        std::vector<char> data;
+        {
+            std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+            if (file)
+            {
+                data.resize(static_cast<size_t>(file.tellg()));
+                file.seekg(0);
+                file.read(data.data(), static_cast<std::streamsize>(data.size()));
+                if (!file)
+                    data.clear();
+            }
+        }
+
+        // the driver is supposed to reject foreign data itself, not all of them do. So the header is checked here and a
+        // cache from another device or driver version starts over empty
+        if (!data.empty())
+        {
+            const vk::PhysicalDeviceProperties properties = _renderer->_physicalDevice.getProperties();
+            VkPipelineCacheHeaderVersionOne header{};
+            if (data.size() < sizeof(header))
+            {
+                data.clear();
+            }
+            else
+            {
+                memcpy(&header, data.data(), sizeof(header));
+                if (header.headerSize < sizeof(header) || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+                    header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+                    memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0)
+                {
+                    printl(Log::LogLevel::Info, "[PIPELINE] {} was written by another device or driver, starting empty", cachePath);
+                    data.clear();
+                }
+            }
+        }
+
+        vk::PipelineCacheCreateInfo createInfo{};
+        createInfo.initialDataSize = data.size();
+        createInfo.pInitialData = data.empty() ? nullptr : data.data();
+        m_vkPipelineCache = _renderer->_device.createPipelineCache(createInfo);
+        printl(Log::LogLevel::Info, "[PIPELINE] Pipeline cache loaded with {} bytes", data.size());
+
+        // the manifest is only descriptions, nothing is compiled until WarmUp
+        std::ifstream manifest(manifestPath);
+        std::string line;
+        if (!manifest || !std::getline(manifest, line) || line != std::string(kManifestMagic) + " " + std::to_string(kManifestVersion))
+        {
+            return;
+        }
+        while (std::getline(manifest, line))
+        {
+            if (!line.empty())
+                m_manifest.push_back(line);
+        }
+        printl(Log::LogLevel::Info, "[PIPELINE] {} pipelines in {}", m_manifest.size(), manifestPath);
+    }
+
+    void PipelineManager::finishCompiles()
+    {
+        FinishWarmUp();
+        for (auto& [pipelineId, build] : m_asyncBuilds)
+        {
+            build.pipeline.wait();
+        }
+        Update();
+        // warmed up but never built this run, nothing references them
+        for (auto& [pipelineId, job] : m_warmUpJobs)
+        {
+            if (vk::Pipeline pipeline = job.get())
+                _renderer->_device.destroyPipeline(pipeline);
+        }
+        m_warmUpJobs.clear();
+        m_compilePool.reset();
+    }
+
+    void PipelineManager::SavePipelineCache()
+    {
+        finishCompiles();
+        if (!m_vkPipelineCache)
+        {
+            return;
+        }
+
+        const std::vector<uint8_t> data = _renderer->_device.getPipelineCacheData(m_vkPipelineCache);
+        if (writeFileAtomic(m_pipelineCachePath, data.data(), data.size()))
+        {
+            printl(Log::LogLevel::Info, "[PIPELINE] Wrote {} bytes to {}", data.size(), m_pipelineCachePath);
+        }
+
+        std::string manifest = std::string(kManifestMagic) + " " + std::to_string(kManifestVersion) + "\n";
+        for (const std::string& description : m_builtPipelines)
+        {
+            manifest += description + "\n";
+        }
+        writeFileAtomic(m_manifestPath, manifest.data(), manifest.size());
+
+        _renderer->_device.destroyPipelineCache(m_vkPipelineCache);
+        m_vkPipelineCache = nullptr;
+    }
+
+    void PipelineManager::WarmUp()
+    {
+        if (m_manifest.empty())
+        {
+            return;
+        }
+
+        // the calling thread goes on with the load instead of helping
+        ThreadPool& compilePool = getCompilePool();
+        auto shaderMissing = [](const std::string& path) { return !path.empty() && !std::filesystem::exists(path); };
+
+        for (const std::string& description : m_manifest)
+        {
+            std::string pipelineKey;
+            Builder builder(this);
+            if (!parseDescription(description, pipelineKey, builder))
+            {
+                printl(Log::LogLevel::Warn, "[PIPELINE] Skipping malformed manifest line: {}", description);
+                continue;
+            }
+            // several names of one state are compiled once
+            const PipelineState state = makePipelineState(builder);
+            const u64 pipelineId = HashPipelineState(state);
+            if (m_pipelines.Find(pipelineId) || m_warmUpJobs.contains(pipelineId))
+            {
+                continue;
+            }
+            if (shaderMissing(builder.m_vertShaderPath) || shaderMissing(builder.m_meshShaderPath) ||
+                shaderMissing(builder.m_fragShaderPath) || shaderMissing(builder.m_compShaderPath))
+            {
+                printl(Log::LogLevel::InfoDebug, "[PIPELINE] Shaders of {} are gone, not warming it up", pipelineKey);
+                continue;
+            }
+
+            const PipelineStages stages = resolveStages(builder);
+            const bool compute = !builder.m_compShaderPath.empty();
+            std::future<vk::Pipeline> job = compilePool.Submit([this, pipelineKey, state, stages, compute]() -> vk::Pipeline
+            {
+                try
+                {
+                    return compute ? compileComputePipeline(pipelineKey, stages) : compileGraphicsPipeline(pipelineKey, state, stages);
+                }
+                catch (vk::SystemError&)
+                {
+                    // build() compiles it again and reports the error where it matters
+                    return nullptr;
+                }
+            });
+            m_warmUpJobs.emplace(pipelineId, std::move(job));
+        }
+        m_manifest.clear();
+        printl(Log::LogLevel::Info, "[PIPELINE] Warming up {} pipelines on {} threads", m_warmUpJobs.size(), compilePool.GetWorkerCount());
+    }
+
+    void PipelineManager::FinishWarmUp()
+    {
+        for (auto& [pipelineId, job] : m_warmUpJobs)
+        {
+            job.wait();
+        }
+    }
+
+    std::string PipelineManager::describePipeline(const std::string& pipelineKey, const Builder& builder)
+    {
+        // key|vert|mesh|frag|comp|set layouts|push stages|push size|dynamic states|topology|cull mode|front face|depth test|blend|
+        // color format|depth format
+        std::ostringstream out;
+        out << pipelineKey << '|' << builder.m_vertShaderPath << '|' << builder.m_meshShaderPath << '|' << builder.m_fragShaderPath << '|'
+            << builder.m_compShaderPath << '|';
+        for (size_t i = 0; i < builder.m_descriptorSetLayoutKeys.size(); i++)
+        {
+            out << (i ? "," : "") << builder.m_descriptorSetLayoutKeys[i];
+        }
+        out << '|' << static_cast<uint32_t>(builder.m_pushConstantStages) << '|' << builder.m_pushConstantSize << '|';
+        for (size_t i = 0; i < builder.m_dynamicStates.size(); i++)
+        {
+            out << (i ? "," : "") << static_cast<int32_t>(builder.m_dynamicStates[i]);
+        }
+        out << '|' << static_cast<int32_t>(builder.m_topology) << '|' << static_cast<uint32_t>(builder.m_cullMode) << '|'
+            << static_cast<int32_t>(builder.m_frontFace) << '|' << builder.m_depthTest << '|' << builder.m_blendMode << '|'
+            << static_cast<int32_t>(builder.m_colorFormat) << '|' << static_cast<int32_t>(builder.m_depthFormat);
+        return out.str();
+    }
+
+    bool PipelineManager::parseDescription(const std::string& description, std::string& pipelineKey, Builder& builder)
+    {
+        const std::vector<std::string> fields = splitString(description, '|');
+        if (fields.size() != 16 || fields[0].empty())
+        {
+            return false;
+        }
+
+        try
+        {
+            pipelineKey = fields[0];
+            builder.m_vertShaderPath = fields[1];
+            builder.m_meshShaderPath = fields[2];
+            builder.m_fragShaderPath = fields[3];
+            builder.m_compShaderPath = fields[4];
+            if (!fields[5].empty())
+            {
+                builder.m_descriptorSetLayoutKeys = splitString(fields[5], ',');
+            }
+            builder.m_pushConstantStages = vk::ShaderStageFlags(static_cast<uint32_t>(std::stoul(fields[6])));
+            builder.m_pushConstantSize = static_cast<uint32_t>(std::stoul(fields[7]));
+            if (!fields[8].empty())
+            {
+                for (const std::string& state : splitString(fields[8], ','))
+                {
+                    builder.m_dynamicStates.push_back(static_cast<vk::DynamicState>(std::stoi(state)));
+                }
+            }
+            builder.m_topology = static_cast<vk::PrimitiveTopology>(std::stoi(fields[9]));
+            builder.m_cullMode = vk::CullModeFlags(static_cast<uint32_t>(std::stoul(fields[10])));
+            builder.m_frontFace = static_cast<vk::FrontFace>(std::stoi(fields[11]));
+            builder.m_depthTest = fields[12] == "1";
+            builder.m_blendMode = fields[13] == "1";
+            builder.m_colorFormat = static_cast<vk::Format>(std::stoi(fields[14]));
+            builder.m_depthFormat = static_cast<vk::Format>(std::stoi(fields[15]));
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+        return true;
+    }
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #ifndef PIPELINE_MANAGER_H
 #define PIPELINE_MANAGER_H
+#include <future>
 #include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <vulkan/vulkan.hpp>
 
+#include "PipelineState.h"
+#include "ThreadPool.h"
+
 namespace CV
 {
 	class ResourceManager;
@@ -14,11 +18,22 @@ namespace CV
 	class PipelineManager
 	{
 	public:
-		PipelineManager(ResourceManager* resourceManager, const std::shared_ptr<Renderer>& renderer);
-		~PipelineManager();	// TODO
+		// owned by the resource manager, which also keeps the renderer alive
+		PipelineManager(ResourceManager* resourceManager, Renderer* renderer);
+		// waits for the compile workers, then destroys every pipeline, pipeline layout and the VkPipelineCache if
+		// SavePipelineCache didn't already. The GPU has to be done with them
+		~PipelineManager();
 
+		// a pipeline still compiling in the background hands out its fallback instead. By name, for setup code
 		vk::Pipeline getPipeline(const std::string& pipelineKey);
-		vk::PipelineLayout getPipelineLayout(const std::string& pipelineLayoutKey);
+		// the per frame lookup, a probe of the state hash table without any string hashing
+		vk::Pipeline getPipeline(u64 pipelineId);
+		// the state hash a name was built with. Names built from the same state share the id and the pipeline
+		[[nodiscard]] u64 getPipelineId(const std::string& pipelineKey) const;
+		vk::PipelineLayout getPipelineLayout(u64 pipelineLayoutKey);
+		// the key getPipelineLayout expects for a pipeline built with these set layouts and push constants
+		static u64 makePipelineLayoutKey(const std::vector<std::string>& descLayoutKeys,
+			vk::ShaderStageFlags pushConstantStages = {}, uint32_t pushConstantSize = 0);
 
 		class Builder
 		{
@@ -27,13 +42,25 @@ namespace CV
 			Builder& setVertexShader(const std::string& path);
 			Builder& setMeshShader(const std::string& path);
 			Builder& setFragmentShader(const std::string& path);
-			Builder& setPipelineLayout(vk::PipelineLayout pipelineLayout);
+			// a compute pipeline, everything graphics is ignored
+			Builder& setComputeShader(const std::string& path);
 			Builder& addDescriptorSetLayout(const std::string& key);
+			// defaults to CV::PushConstants for the graphics stages
+			Builder& setPushConstants(vk::ShaderStageFlags stages, uint32_t size);
 			Builder& setDynamicStates(const std::vector<vk::DynamicState>& dynamicStates);
 			Builder& setTopology(vk::PrimitiveTopology topology);
+			// defaults to no culling, counter clockwise front faces
+			Builder& setCullMode(vk::CullModeFlags cullMode, vk::FrontFace frontFace = vk::FrontFace::eCounterClockwise);
+			// depth test and write, closer passes
 			Builder& setDepthTest(bool enable);
+			// alpha blending, source over destination by source alpha
 			Builder& setBlendMode(bool enable);
+			// defaults to the swapchain and depth buffer formats
+			Builder& setAttachmentFormats(vk::Format colorFormat, vk::Format depthFormat);
 			vk::Pipeline build(const std::string& pipelineKey);
+			// returns right away and compiles on the compile workers. Until the pipeline lands (PipelineManager::Update)
+			// getPipeline(pipelineKey) returns the already built fallbackKey, and keeps doing so if the compile fails
+			std::shared_future<vk::Pipeline> buildAsync(const std::string& pipelineKey, const std::string& fallbackKey);
 
 			friend class PipelineManager;
 
@@ -42,22 +69,95 @@ namespace CV
 			std::string m_vertShaderPath;
 			std::string m_meshShaderPath;
 			std::string m_fragShaderPath;
+			std::string m_compShaderPath;
 			std::vector<vk::DynamicState> m_dynamicStates;
 			std::vector<std::string> m_descriptorSetLayoutKeys;
-			vk::PipelineLayout m_pipelineLayout;
-			vk::PrimitiveTopology m_topology;
-			bool m_depthTest;
-			bool m_blendMode;
+			vk::ShaderStageFlags m_pushConstantStages{};
+			uint32_t m_pushConstantSize = 0;
+			vk::PrimitiveTopology m_topology = vk::PrimitiveTopology::eTriangleList;
+			vk::CullModeFlags m_cullMode = vk::CullModeFlagBits::eNone;
+			vk::FrontFace m_frontFace = vk::FrontFace::eCounterClockwise;
+			bool m_depthTest = false;
+			bool m_blendMode = false;
+			vk::Format m_colorFormat = vk::Format::eUndefined;
+			vk::Format m_depthFormat = vk::Format::eUndefined;
 		};
 
+		// every pipeline is created through one VkPipelineCache, loaded from cachePath once the device exists. A file written
+		// by another GPU or driver (vendor id, device id and cache UUID in its header) is dropped and the cache starts empty.
+		// manifestPath lists the pipelines the last run built, WarmUp compiles them ahead of their build()
+		void LoadPipelineCache(const std::string& cachePath, const std::string& manifestPath);
+		// at shutdown: writes the cache and a manifest of the pipelines built this run, then destroys the cache
+		void SavePipelineCache();
+		// starts compiling the manifest's pipelines on the compile workers, the set layouts they use have to exist already.
+		// build() of a warmed up pipeline waits for its job instead of compiling it again
+		void WarmUp();
+		// waits for whatever warm-up is still compiling
+		void FinishWarmUp();
+
+		// once per frame: moves the finished background compiles into the cache. Never waits on one
+		void Update();
+
+		struct CompileStats
+		{
+			uint32_t pending;	// buildAsync calls still compiling
+			uint32_t compiled;	// landed by Update
+			uint32_t failed;	// stuck on their fallback
+		};
+		[[nodiscard]] CompileStats getCompileStats() const;
+
 	private:
+		// layout and shader modules of a pipeline. Resolved on the calling thread, they come out of caches that aren't thread safe
+		struct PipelineStages
+		{
+			vk::PipelineLayout layout;
+			vk::ShaderModule vertex;
+			vk::ShaderModule mesh;
+			vk::ShaderModule fragment;
+			vk::ShaderModule compute;
+		};
+
+		struct AsyncBuild
+		{
+			std::string pipelineKey;	// for the log, the build is keyed on its state hash
+			std::shared_future<vk::Pipeline> pipeline;
+		};
+
 		ResourceManager* _resourceManager;
-		std::shared_ptr<Renderer> _renderer;
-		std::unordered_map<std::string, vk::Pipeline> m_pipelineCache;
-		std::unordered_map<std::string, vk::PipelineLayout> m_pipelineLayoutCache;
+		Renderer* _renderer;
+		PipelineTable m_pipelines;
+		std::unordered_map<std::string, u64> m_pipelineNames;	// name -> state hash, setup code only
+		std::unordered_map<u64, vk::PipelineLayout> m_pipelineLayoutCache;
+
+		vk::PipelineCache m_vkPipelineCache;
+		std::string m_pipelineCachePath;
+		std::string m_manifestPath;
+		std::vector<std::string> m_manifest;		// loaded descriptions, one per pipeline
+		std::vector<std::string> m_builtPipelines;	// descriptions of this run, written back at shutdown
+		std::unique_ptr<ThreadPool> m_compilePool;	// warm-up and buildAsync, created on first use
+		std::unordered_map<u64, std::future<vk::Pipeline>> m_warmUpJobs;	// by state hash, not in m_pipelines until built
+		std::unordered_map<u64, AsyncBuild> m_asyncBuilds;
+		uint32_t m_compiledCount = 0;
+		uint32_t m_failedCount = 0;
 
 		vk::Pipeline createPipeline(const std::string& pipelineKey, const Builder& builder);
-		vk::PipelineLayout createPipelineLayout(const std::vector<std::string>& descLayoutKeys);
+		std::shared_future<vk::Pipeline> createPipelineAsync(const std::string& pipelineKey, const std::string& fallbackKey,
+			const Builder& builder);
+		ThreadPool& getCompilePool();
+		// lands every background compile and drops the warm-ups nobody built, then stops the compile workers
+		void finishCompiles();
+		PipelineState makePipelineState(const Builder& builder) const;
+		// a name seen for the first time goes to the manifest
+		void registerName(const std::string& pipelineKey, u64 pipelineId, const Builder& builder);
+		PipelineStages resolveStages(const Builder& builder);
+		// only touch the device and the VkPipelineCache, so they run on the compile workers too
+		vk::Pipeline compileGraphicsPipeline(const std::string& pipelineKey, const PipelineState& state, const PipelineStages& stages) const;
+		vk::Pipeline compileComputePipeline(const std::string& pipelineKey, const PipelineStages& stages) const;
+		// one manifest line: the key and everything build() needs to create the pipeline again
+		static std::string describePipeline(const std::string& pipelineKey, const Builder& builder);
+		static bool parseDescription(const std::string& description, std::string& pipelineKey, Builder& builder);
+		vk::PipelineLayout createPipelineLayout(const std::vector<std::string>& descLayoutKeys, vk::ShaderStageFlags pushConstantStages = {},
+			uint32_t pushConstantSize = 0);
 	};
 }
 
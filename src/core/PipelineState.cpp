@@ -0,0 +1,94 @@
+#include <pch.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "PipelineState.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		void CheckState(const PipelineTable::Entry& entry, const PipelineState& state)
+		{
+			if (memcmp(&entry.state, &state, sizeof(state)) != 0)
+			{
+				printl(Log::LogLevel::Error, "[PIPELINE] Two pipeline states hash to {:016x}", entry.hash);
+				throw std::runtime_error("Pipeline state hash collision");
+			}
+		}
+	}
+
+	PipelineTable::Entry* PipelineTable::Find(u64 hash)
+	{
+		return const_cast<Entry*>(std::as_const(*this).Find(hash));
+	}
+
+	const PipelineTable::Entry* PipelineTable::Find(u64 hash) const
+	{
+		if (m_entries.empty())
+			return nullptr;
+
+		const size_t mask = m_entries.size() - 1;
+		for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+		{
+			const Entry& entry = m_entries[slot];
+			if (entry.hash == hash)
+				return &entry;
+			if (entry.hash == 0)
+				return nullptr;
+		}
+	}
+
+	const PipelineTable::Entry* PipelineTable::Find(u64 hash, const PipelineState& state) const
+	{
+		const Entry* entry = Find(hash);
+		if (entry)
+			CheckState(*entry, state);
+		return entry;
+	}
+
+	PipelineTable::Entry& PipelineTable::Insert(u64 hash, const PipelineState& state)
+	{
+		// at most 3/4 full, so probes stay short and always end on an empty slot
+		if ((m_count + 1) * 4 > m_entries.size() * 3)
+			Grow();
+
+		const size_t mask = m_entries.size() - 1;
+		for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+		{
+			Entry& entry = m_entries[slot];
+			if (entry.hash == hash)
+			{
+				CheckState(entry, state);
+				return entry;
+			}
+			if (entry.hash == 0)
+			{
+				entry.hash = hash;
+				entry.state = state;
+				m_count++;
+				return entry;
+			}
+		}
+	}
+
+	void PipelineTable::Grow()
+	{
+		std::vector<Entry> old = std::move(m_entries);
+		m_entries.assign(old.empty() ? 64 : old.size() * 2, Entry{});
+
+		const size_t mask = m_entries.size() - 1;
+		for (Entry& entry : old)
+		{
+			if (entry.hash == 0)
+				continue;
+			size_t slot = entry.hash & mask;
+			while (m_entries[slot].hash != 0)
+				slot = (slot + 1) & mask;
+			m_entries[slot] = entry;
+		}
+	}
+}
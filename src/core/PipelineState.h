@@ -0,0 +1,96 @@
+#ifndef PIPELINE_STATE_H
+#define PIPELINE_STATE_H
+
+#include <span>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+
+// everything a pipeline is compiled from, as plain data. Two builds with the same state are the same pipeline whatever
+// they are called, so PipelineManager keys its pipelines on HashPipelineState and names are only an alias for the hash.
+// The struct is hashed byte for byte: bools are whole words and there is no padding, the static_assert keeps it that way.
+
+namespace CV
+{
+	inline constexpr u32 kMaxPipelineDynamicStates = 4;
+
+	struct PipelineState
+	{
+		u64 shaders[4];						// FNV-1a of the spv paths: vertex, mesh, fragment, compute. 0 when unused
+		u64 layout;							// PipelineManager::makePipelineLayoutKey
+		vk::Format colorFormat;
+		vk::Format depthFormat;
+		vk::SampleCountFlagBits samples;
+		vk::PrimitiveTopology topology;
+		vk::PolygonMode polygonMode;
+		u32 cullMode;						// vk::CullModeFlags
+		vk::FrontFace frontFace;
+		u32 depthTest;
+		u32 depthWrite;
+		vk::CompareOp depthCompareOp;
+		u32 blendEnable;
+		vk::BlendFactor srcColorBlendFactor;
+		vk::BlendFactor dstColorBlendFactor;
+		vk::BlendOp colorBlendOp;
+		vk::BlendFactor srcAlphaBlendFactor;
+		vk::BlendFactor dstAlphaBlendFactor;
+		vk::BlendOp alphaBlendOp;
+		u32 dynamicStateCount;
+		vk::DynamicState dynamicStates[kMaxPipelineDynamicStates];
+	};
+	static_assert(std::has_unique_object_representations_v<PipelineState>, "PipelineState is hashed as bytes, it can't have padding");
+
+	[[nodiscard]] inline u64 HashBytes(const void* data, size_t size, u64 hash = 0xcbf29ce484222325ull)
+	{
+		const u8* bytes = static_cast<const u8*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// never 0, the table uses that for empty slots
+	[[nodiscard]] inline u64 HashPipelineState(const PipelineState& state)
+	{
+		const u64 hash = HashBytes(&state, sizeof(state));
+		return hash ? hash : 1;
+	}
+
+	// open addressing with linear probing, keyed on the state hash. Lookups are a few compares of u64s in one array,
+	// nothing is ever removed. Entries move when the table grows, so don't hold on to the pointers Find returns
+	class PipelineTable
+	{
+	public:
+		struct Entry
+		{
+			u64 hash = 0;
+			PipelineState state{};
+			vk::Pipeline pipeline;	// null while it compiles in the background
+			u64 fallback = 0;		// hash of the pipeline handed out until then
+		};
+
+		[[nodiscard]] Entry* Find(u64 hash);
+		[[nodiscard]] const Entry* Find(u64 hash) const;
+		// the same, but throws if the entry was inserted with another state. Two states with one hash would otherwise
+		// share a pipeline, and the second would silently draw with the first one's
+		[[nodiscard]] const Entry* Find(u64 hash, const PipelineState& state) const;
+		// the entry of hash, a new one if there is none. Throws on a collision, like Find above
+		Entry& Insert(u64 hash, const PipelineState& state);
+
+		[[nodiscard]] u32 GetCount() const { return m_count; }
+		// every slot, the empty ones have hash 0. For teardown
+		[[nodiscard]] std::span<const Entry> GetSlots() const { return m_entries; }
+
+	private:
+		void Grow();
+
+		std::vector<Entry> m_entries;	// power of two
+		u32 m_count = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <bit>
+
+#include "RenderQueue.h"
+
+namespace CV
+{
+	u64 MakeSortKey(u32 pipeline, u32 indexRegion, u32 material, float viewDistance, bool blended, u32 mesh)
+	{
+		// a non negative float's bits compare like the float itself, the low mantissa bits are dropped
+		u32 depth = std::bit_cast<u32>(std::max(viewDistance, 0.0f)) >> 8;
+		if (blended)
+			depth = ~depth & 0xffffffu;
+
+		return (u64(pipeline & 0xffu) << 56) | (u64(indexRegion & 0x1u) << 55) | (u64(material & 0x7fffu) << 40) |
+			(u64(depth) << 16) | u64(mesh & 0xffffu);
+	}
+
+	void RenderQueue::Clear()
+	{
+		m_keys.clear();
+		m_payloads.clear();
+	}
+
+	void RenderQueue::Push(u64 key, u32 payload)
+	{
+		m_keys.push_back(key);
+		m_payloads.push_back(payload);
+	}
+
+	void RenderQueue::Sort()
+	{
+		const size_t count = m_keys.size();
+		if (count < 2)
+			return;
+
+		m_scratchKeys.resize(count);
+		m_scratchPayloads.resize(count);
+
+		// all 8 byte histograms in one read over the keys
+		u32 histograms[8][256] = {};
+		for (u64 key : m_keys)
+		{
+			for (u32 pass = 0; pass < 8; pass++)
+				histograms[pass][(key >> (pass * 8)) & 0xff]++;
+		}
+
+		for (u32 pass = 0; pass < 8; pass++)
+		{
+			u32* histogram = histograms[pass];
+			const u32 shift = pass * 8;
+			// every key has the same byte here (the unused fields usually do), the pass would only copy
+			if (histogram[(m_keys[0] >> shift) & 0xff] == count)
+				continue;
+
+			u32 offset = 0;
+			for (u32 digit = 0; digit < 256; digit++)
+			{
+				const u32 digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const u32 slot = histogram[(m_keys[i] >> shift) & 0xff]++;
+				m_scratchKeys[slot] = m_keys[i];
+				m_scratchPayloads[slot] = m_payloads[i];
+			}
+			m_keys.swap(m_scratchKeys);
+			m_payloads.swap(m_scratchPayloads);
+		}
+	}
+}
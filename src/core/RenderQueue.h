@@ -0,0 +1,44 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <span>
+#include <vector>
+
+#include "StandardTypes.h"
+
+// draw ordering for the CPU recorded path. Every draw, an already merged instanced run, is pushed with a 64 bit key and a
+// payload (what to draw), Sort() orders them by key with an LSD radix sort, and recording walks the payloads in that
+// order. Key layout, most significant first, so the expensive state changes happen least often:
+//   63..56  pipeline
+//   55      index buffer (DRAW_REGION_*)
+//   54..40  material
+//   39..16  view distance of the run's nearest instance, the top 24 bits of the float. Front to back for opaque draws,
+//           back to front for blended ones
+//   15..0   mesh, keeps draws of the same geometry together on ties
+
+namespace CV
+{
+	[[nodiscard]] u64 MakeSortKey(u32 pipeline, u32 indexRegion, u32 material, float viewDistance, bool blended, u32 mesh);
+
+	class RenderQueue
+	{
+	public:
+		void Clear();
+		void Push(u64 key, u32 payload);
+		// stable, ascending by key
+		void Sort();
+
+		[[nodiscard]] std::span<const u64> GetKeys() const { return m_keys; }
+		[[nodiscard]] std::span<const u32> GetPayloads() const { return m_payloads; }
+		[[nodiscard]] u32 GetCount() const { return static_cast<u32>(m_keys.size()); }
+
+	private:
+		std::vector<u64> m_keys;
+		std::vector<u32> m_payloads;
+		// ping pong targets of the sort passes, kept to avoid reallocating every frame
+		std::vector<u64> m_scratchKeys;
+		std::vector<u32> m_scratchPayloads;
+	};
+}
+
+#endif
@@ -6,20 +6,50 @@
 #include "Log.h"
 #include "renderer.h"
 #include "vk_utils.h"
+#include "DeletionQueue.h"
 
 
 namespace CV
 {
 	ResourceManager::ResourceManager(const std::shared_ptr<Renderer>& renderer) : _renderer(renderer), m_descriptorPool(VK_NULL_HANDLE)
 	{
-		pipelineManager = new PipelineManager(this, _renderer);
+		pipelineManager = std::make_unique<PipelineManager>(this, _renderer.get());
 	}
 
 	ResourceManager::~ResourceManager()
 	{
 		if (m_descriptorPool != VK_NULL_HANDLE)
 		{
-			vkDestroyDescriptorPool(_renderer->_device, m_descriptorPool, nullptr);
+			_renderer->_deletionQueue->Enqueue(m_descriptorPool);
+		}
+
+		// the allocator goes with this manager, so whatever it handed out has to be released now rather than deferred
+		const vk::Device device = getDevice();
+		device.waitIdle();
+		_renderer->_deletionQueue->Flush();
+		// pipelines and their layouts before the shader modules and set layouts they were made from
+		pipelineManager.reset();
+		for (auto& [shaderPath, shaderModule] : m_shaderModuleCache)
+			device.destroyShaderModule(shaderModule);
+		for (auto& [layoutKey, layout] : m_descriptorSetLayoutCache)
+			device.destroyDescriptorSetLayout(layout);
+		for (u32 i = 0; i < m_buffers.handles.GetCapacity(); i++)
+		{
+			if (m_buffers.buffers[i])
+				device.destroyBuffer(m_buffers.buffers[i]);
+			if (m_buffers.memory[i])
+				getAllocator().free(m_buffers.memory[i]);
+		}
+		for (u32 i = 0; i < m_textures.handles.GetCapacity(); i++)
+		{
+			if (m_textures.samplers[i])
+				device.destroySampler(m_textures.samplers[i]);
+			if (m_textures.views[i])
+				device.destroyImageView(m_textures.views[i]);
+			if (m_textures.images[i])
+				device.destroyImage(m_textures.images[i]);
+			if (m_textures.memory[i])
+				getAllocator().free(m_textures.memory[i]);
 		}
 	}
 
@@ -33,17 +63,122 @@ namespace CV
 		return _renderer->_physicalDevice;
 	}
 
+	MemoryAllocator& ResourceManager::getAllocator() const
+	{
+		if (!m_allocator)
+			m_allocator = std::make_unique<MemoryAllocator>(_renderer->_device, _renderer->_physicalDevice);
+		return *m_allocator;
+	}
+
 	BufferBuilder ResourceManager::CreateBufferBuilder()
 	{
 		return BufferBuilder(*this);
 	}
 
+	BufferHandle ResourceManager::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties)
+	{
+		Allocation memory;
+		const vk::Buffer buffer = CreateBufferBuilder()
+			.setSize(size)
+			.setUsage(usage)
+			.setMemoryProperties(properties)
+			.build(memory);
+
+		const BufferHandle handle = m_buffers.handles.Allocate();
+		const u32 index = handle.Index();
+		if (index >= m_buffers.buffers.size())
+		{
+			m_buffers.buffers.resize(index + 1);
+			m_buffers.memory.resize(index + 1);
+			m_buffers.sizes.resize(index + 1);
+			m_buffers.addresses.resize(index + 1);
+		}
+		m_buffers.buffers[index] = buffer;
+		m_buffers.memory[index] = memory;
+		m_buffers.sizes[index] = size;
+		m_buffers.addresses[index] = usage & vk::BufferUsageFlagBits::eShaderDeviceAddress
+			? getDevice().getBufferAddress(vk::BufferDeviceAddressInfo{ buffer }) : 0;
+		return handle;
+	}
+
+	void ResourceManager::DestroyBuffer(BufferHandle handle)
+	{
+		if (!handle)
+			return;
+		assert(m_buffers.handles.IsValid(handle) && "stale buffer handle");
+
+		const u32 index = handle.Index();
+		_renderer->_deletionQueue->Enqueue(m_buffers.buffers[index], &getAllocator(), m_buffers.memory[index]);
+		m_buffers.buffers[index] = VK_NULL_HANDLE;
+		m_buffers.memory[index] = {};
+		m_buffers.sizes[index] = 0;
+		m_buffers.addresses[index] = 0;
+		m_buffers.handles.Free(handle);
+	}
+
+	TextureHandle ResourceManager::ReserveTexture()
+	{
+		const TextureHandle handle = m_textures.handles.Allocate();
+		const u32 index = handle.Index();
+		if (index >= m_textures.images.size())
+		{
+			m_textures.images.resize(index + 1);
+			m_textures.memory.resize(index + 1);
+			m_textures.views.resize(index + 1);
+			m_textures.samplers.resize(index + 1);
+			m_textures.resident.resize(index + 1);
+		}
+		return handle;
+	}
+
+	void ResourceManager::SetTexture(TextureHandle handle, const Texture& texture)
+	{
+		assert(m_textures.handles.IsValid(handle) && "stale texture handle");
+		assert(!m_textures.images[handle.Index()] && "texture slot already filled");
+
+		const u32 index = handle.Index();
+		m_textures.images[index] = texture.m_texImage;
+		m_textures.memory[index] = texture.m_texImageMemory;
+		m_textures.views[index] = texture.m_texImageView;
+		m_textures.samplers[index] = texture.m_texSampler;
+		m_textures.resident[index] = false;
+	}
+
+	void ResourceManager::SetTextureResident(TextureHandle handle)
+	{
+		assert(m_textures.handles.IsValid(handle) && "stale texture handle");
+		assert(m_textures.views[handle.Index()] && m_textures.samplers[handle.Index()]);
+		m_textures.resident[handle.Index()] = true;
+	}
+
+	void ResourceManager::DestroyTexture(TextureHandle handle)
+	{
+		if (!handle)
+			return;
+		assert(m_textures.handles.IsValid(handle) && "stale texture handle");
+
+		const u32 index = handle.Index();
+		DeletionQueue& deletionQueue = *_renderer->_deletionQueue;
+		deletionQueue.Enqueue(m_textures.samplers[index]);
+		deletionQueue.Enqueue(m_textures.views[index]);
+		deletionQueue.Enqueue(m_textures.images[index], &getAllocator(), m_textures.memory[index]);
+		m_textures.images[index] = VK_NULL_HANDLE;
+		m_textures.memory[index] = {};
+		m_textures.views[index] = VK_NULL_HANDLE;
+		m_textures.samplers[index] = VK_NULL_HANDLE;
+		m_textures.resident[index] = false;
+		m_textures.handles.Free(handle);
+		if (handle == m_fallbackTexture)
+			m_fallbackTexture = {};
+	}
+
 
 	void ResourceManager::ConfigureDescriptorPoolSizes(const std::vector<vk::DescriptorPoolSize>& poolSizes, uint32_t maxSets)
 	{
+		// sets allocated from the old pool may still be bound by a frame in flight
 		if (m_descriptorPool)
 		{
-			vkDestroyDescriptorPool(_renderer->_device, m_descriptorPool, nullptr);
+			_renderer->_deletionQueue->Enqueue(m_descriptorPool);
 		}
 
 		vk::DescriptorPoolCreateInfo poolCI{};
@@ -69,10 +204,26 @@ namespace CV
 		return CreateDescriptorBuilder()
 			.allocateDescriptorSet(layout);
 	}
-	vk::DescriptorSet ResourceManager::UpdateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize size, const std::optional<std::vector<CV::Texture>>& textures)
+	vk::DescriptorSet ResourceManager::UpdateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize size, std::span<const vk::DescriptorImageInfo> images)
 	{
 		return CreateDescriptorBuilder()
-			.updateDescriptorSet(set, binding, type, buffer, size, textures);
+			.updateDescriptorSet(set, binding, type, buffer, size, images);
+	}
+
+	void ResourceManager::WriteTextureDescriptors(vk::DescriptorSet set, uint32_t binding)
+	{
+		assert(m_textures.handles.IsValid(m_fallbackTexture) && m_textures.resident[m_fallbackTexture.Index()]);
+		const u32 fallback = m_fallbackTexture.Index();
+
+		m_imageInfos.resize(m_textures.handles.GetCapacity());
+		for (u32 i = 0; i < m_imageInfos.size(); i++)
+		{
+			const u32 slot = m_textures.resident[i] ? i : fallback;
+			m_imageInfos[i] = vk::DescriptorImageInfo{ m_textures.samplers[slot], m_textures.views[slot], vk::ImageLayout::eShaderReadOnlyOptimal };
+		}
+
+		vk::Buffer buffer{};
+		UpdateDescriptorSet(set, binding, vk::DescriptorType::eCombinedImageSampler, buffer, 0, m_imageInfos);
 	}
 
 	vk::ShaderModule ResourceManager::getShaderModule(const std::string& shaderPath)
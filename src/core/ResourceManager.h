@@ -3,11 +3,15 @@
 
 #include "common.h"
 #include "BufferBuilder.h"
+#include "MemoryAllocator.h"
 #include "DescriptorBuilder.h"
+#include "Handle.h"
 #include "Texture.h"
 #include "PipelineManager.h"
 
+#include <cassert>
 #include <memory>
+#include <span>
 #include <vector>
 #include <string>
 
@@ -23,8 +27,54 @@ namespace CV
 		vk::Device getDevice() const;
 		vk::PhysicalDevice getPhysicalDevice() const;
 		[[nodiscard]] vk::DescriptorPool getDescriptorPool() const { return m_descriptorPool; }
+		// device memory, every buffer/image this manager hands out is sub-allocated from here.
+		// Created on first use, the manager itself may exist before the device does
+		[[nodiscard]] MemoryAllocator& getAllocator() const;
 		// buffer
 		BufferBuilder CreateBufferBuilder();
+		// pooled, the handle is what gets passed around. Device address only with eShaderDeviceAddress usage
+		BufferHandle CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
+		// released through the renderer's deletion queue, the handle goes stale right away. Null handles are ignored
+		void DestroyBuffer(BufferHandle handle);
+		[[nodiscard]] vk::Buffer getBuffer(BufferHandle handle) const
+		{
+			assert(m_buffers.handles.IsValid(handle) && "stale buffer handle");
+			return m_buffers.buffers[handle.Index()];
+		}
+		[[nodiscard]] vk::DeviceAddress getBufferAddress(BufferHandle handle) const
+		{
+			assert(m_buffers.handles.IsValid(handle) && "stale buffer handle");
+			return m_buffers.addresses[handle.Index()];
+		}
+		[[nodiscard]] vk::DeviceSize getBufferSize(BufferHandle handle) const
+		{
+			assert(m_buffers.handles.IsValid(handle) && "stale buffer handle");
+			return m_buffers.sizes[handle.Index()];
+		}
+
+		// texture. The handle's index is the bindless slot, reserved up front so it can be baked into materials while the
+		// texture itself is still decoding
+		TextureHandle ReserveTexture();
+		// takes over the image, view, sampler and memory of an uploaded texture
+		void SetTexture(TextureHandle handle, const Texture& texture);
+		// once the upload has completed on the GPU, until then the slot is written with the fallback
+		void SetTextureResident(TextureHandle handle);
+		void DestroyTexture(TextureHandle handle);
+		// bound in every slot whose texture isn't resident (or was destroyed), has to be resident itself
+		void setFallbackTexture(TextureHandle handle) { m_fallbackTexture = handle; }
+		[[nodiscard]] TextureHandle getFallbackTexture() const { return m_fallbackTexture; }
+		[[nodiscard]] vk::ImageView getTextureView(TextureHandle handle) const
+		{
+			assert(m_textures.handles.IsValid(handle) && "stale texture handle");
+			return m_textures.views[handle.Index()];
+		}
+		[[nodiscard]] bool isTextureResident(TextureHandle handle) const
+		{
+			assert(m_textures.handles.IsValid(handle) && "stale texture handle");
+			return m_textures.resident[handle.Index()];
+		}
+		// highest bindless slot + 1
+		[[nodiscard]] u32 getTextureSlotCount() const { return m_textures.handles.GetCapacity(); }
 		// image
 		// TODO
 		// ImageBuilder CreateImageBuilder();
@@ -33,24 +83,50 @@ namespace CV
 		void ConfigureDescriptorPoolSizes(const std::vector<vk::DescriptorPoolSize>& poolSizes, uint32_t maxSets);
 		DescriptorBuilder CreateDescriptorBuilder();
 		vk::DescriptorSet CreateDescriptorSet(vk::DescriptorSetLayout layout);
-		vk::DescriptorSet UpdateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize size, const std::optional<std::vector<CV::Texture>>& textures);
+		vk::DescriptorSet UpdateDescriptorSet(vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::Buffer& buffer, vk::DeviceSize size, std::span<const vk::DescriptorImageInfo> images = {});
+		// every texture slot into the (bindless) binding, straight from the pool
+		void WriteTextureDescriptors(vk::DescriptorSet set, uint32_t binding);
 
 		vk::ShaderModule getShaderModule(const std::string& shaderPath);
 		vk::DescriptorSetLayout getDescriptorSetLayout(const std::string& layoutKey);
 
-		[[nodiscard]] PipelineManager* getPipelineManager() const { return pipelineManager; }
+		[[nodiscard]] PipelineManager* getPipelineManager() const { return pipelineManager.get(); }
 
 		// for imgui
 		vk::DescriptorPool _imguiDescriptorPool;
 	private:
-		PipelineManager* pipelineManager;
+		// SoA, indexed by handle index
+		struct BufferPool
+		{
+			HandlePool<BufferTag> handles;
+			std::vector<vk::Buffer> buffers;
+			std::vector<Allocation> memory;
+			std::vector<vk::DeviceSize> sizes;
+			std::vector<vk::DeviceAddress> addresses;
+		};
+
+		struct TexturePool
+		{
+			HandlePool<TextureTag> handles;
+			std::vector<vk::Image> images;
+			std::vector<Allocation> memory;
+			std::vector<vk::ImageView> views;
+			std::vector<vk::Sampler> samplers;
+			std::vector<u8> resident;
+		};
+
+		std::unique_ptr<PipelineManager> pipelineManager;
 		std::shared_ptr<Renderer> _renderer;
 		vk::DescriptorPool m_descriptorPool;
+		mutable std::unique_ptr<MemoryAllocator> m_allocator;
 
 		vk::ShaderModule createShaderModule(const std::string& shaderPath);
 		vk::DescriptorSetLayout createDescriptorSetLayout(const std::string& layoutKey);
 
-		std::unordered_map<std::string, Texture> m_textureCache;
+		BufferPool m_buffers;
+		TexturePool m_textures;
+		TextureHandle m_fallbackTexture;
+		std::vector<vk::DescriptorImageInfo> m_imageInfos;	// scratch for WriteTextureDescriptors
 		std::unordered_map<std::string, vk::DescriptorSetLayout> m_descriptorSetLayoutCache;
 		std::unordered_map<std::string, vk::ShaderModule> m_shaderModuleCache;
 	};
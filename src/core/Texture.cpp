@@ -1,6 +1,11 @@
 #include <pch.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "Texture.h"
+#include "TextureCompress.h"
+#include "TextureCooker.h"
 #include "renderer.h"
 #include "Log.h"
 #include <vk_utils.h>
@@ -14,68 +19,198 @@
 
 namespace CV
 {
-    void Texture::LoadTexture(const std::shared_ptr<Renderer>& renderer, const char *filename)
+    void TextureData::PixelDeleter::operator()(u8* pixels) const
     {
-        _renderer = renderer;
+        stbi_image_free(pixels);
+    }
+
+    void Texture::LoadTexture(const std::shared_ptr<Renderer>& renderer, MemoryAllocator& allocator, const char *filename)
+    {
+        UploadBatch batch(renderer->_device, allocator, UploadQueue{ renderer->_graphicsQueue, renderer->_commandPool, renderer->_queueFamily });
+        Upload(renderer, batch, Decode(filename));
+        batch.Flush();
+    }
+
+    TextureData Texture::Decode(const std::string& filename)
+    {
+        TextureData textureData;
+        textureData.source = filename;
+        // cooked levels are uploaded as they are, the read is the only cost
+        if (IsCookedTextureCurrent(filename) && ReadKtx2(GetCookedTexturePath(filename), textureData.cooked))
+            return textureData;
+        return DecodeSource(filename);
+    }
+
+    TextureData Texture::DecodeSource(const std::string& filename)
+    {
+        TextureData textureData;
+        textureData.source = filename;
+
         // Load the image using stb_image
-        int width, height, channels;
+        int channels;
         //stbi_set_flip_vertically_on_load(true); // Flip the image vertically for DirectX
-        unsigned char *imgData = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
+        textureData.pixels.reset(stbi_load(filename.c_str(), &textureData.width, &textureData.height, &channels, STBI_rgb_alpha));
+
+        if (!textureData.pixels)
+        {
+            printl(Log::LogLevel::Error,"[STB] Failed to load texture {}", filename);
+        }
+        return textureData;
+    }
+
+    vk::DeviceSize Texture::GetStagingSize(const TextureData& textureData)
+    {
+        // a full RGBA8 chain built on the CPU stays below 4/3 of level 0. Cooked files go up whole, but may fall back to
+        // the source image, which is assumed to be as large as the cooked level 0
+        const bool cooked = !textureData.cooked.Empty();
+        const vk::DeviceSize width = cooked ? textureData.cooked.width : static_cast<u32>(textureData.width);
+        const vk::DeviceSize height = cooked ? textureData.cooked.height : static_cast<u32>(textureData.height);
+        const vk::DeviceSize rgba = width * height * 4 * 4 / 3;
+        return std::max<vk::DeviceSize>(rgba, textureData.cooked.data.size()) + 16;
+    }
+
+    void Texture::Upload(const std::shared_ptr<Renderer>& renderer, UploadBatch& batch, const TextureData& textureData)
+    {
+        _renderer = renderer;
+
+        if (!textureData.cooked.Empty())
+        {
+            if (UploadCooked(renderer, batch, textureData.cooked))
+                return;
+            // the cooked file can't be used here, the source pixels weren't read because of it
+            if (!textureData.pixels)
+            {
+                Upload(renderer, batch, DecodeSource(textureData.source));
+                return;
+            }
+        }
+
+        static constexpr u8 kFallbackPixel[4] = { 255, 255, 255, 255 };
+        const u8* pixels = textureData.pixels ? textureData.pixels.get() : kFallbackPixel;
+        const u32 width = textureData.pixels ? static_cast<u32>(textureData.width) : 1;
+        const u32 height = textureData.pixels ? static_cast<u32>(textureData.height) : 1;
 
-        if (!imgData)
+        constexpr vk::Format format = vk::Format::eR8G8B8A8Srgb;
+        m_format = format;
+        m_swizzle = vk::ComponentMapping{};
+        m_mipLevels = MipLevelCount(width, height);
+
+        // blit the chain on the GPU when the format allows it, otherwise build every level on the CPU and copy them all
+        const bool gpuMips = SupportsLinearBlit(renderer->_physicalDevice, format);
+
+        std::vector<vk::DeviceSize> levelOffsets(m_mipLevels, 0);
+        vk::DeviceSize imageSize = vk::DeviceSize(width) * height * 4;
+        if (!gpuMips)
         {
-            printl(Log::LogLevel::Error,"[STB] Failed to load texture");
-            return;
+            imageSize = 0;
+            for (u32 level = 0; level < m_mipLevels; level++)
+            {
+                levelOffsets[level] = imageSize;
+                imageSize += vk::DeviceSize(MipExtent(width, level)) * MipExtent(height, level) * 4;
+            }
+        }
+
+        // straight into the batch's staging arena, the copies below read from there
+        const UploadBatch::Staging staging = batch.Stage(imageSize);
+        u8* data = staging.data;
+        if (gpuMips)
+        {
+            memcpy(data, pixels, static_cast<size_t>(imageSize));
         }
         else
         {
-            vk::DeviceSize imageSize = width * height * 4;
-
-            vk::Buffer stagingBuffer{};
-            vk::DeviceMemory stagingBufferMemory{};
-
-            CreateBuffer(renderer->_device, renderer->_physicalDevice, imageSize, vk::BufferUsageFlagBits::eTransferSrc,
-                         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                         stagingBuffer, stagingBufferMemory);
-
-            void *data;
-            vkMapMemory(renderer->_device, stagingBufferMemory, 0, imageSize, 0, &data);
-            memcpy(data, imgData, static_cast<size_t>(imageSize));
-            vkUnmapMemory(renderer->_device, stagingBufferMemory);
-            stbi_image_free(imgData);
-
-            // allocate memory inside device (gpu) to upload the texture, bind it to the image memory handle
-            // (watch Tu Wien lecture for more info. TLDR; Vulkan can allocate the memory anywhere inside the hw optimally,
-            // and the image memory handle is whats used to access it)
-            CreateImage(renderer->_physicalDevice, renderer->_device, width, height, vk::Format::eR8G8B8A8Srgb,
-                        vk::ImageTiling::eOptimal,
-                        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                        vk::MemoryPropertyFlagBits::eDeviceLocal, m_texImage, m_texImageMemory);
-
-            /* remember: The actual uploading of texture from storage to VRAM occurs here.
-             * The command buffers do the work related to it. So its important to target
-             * this place when I implement a proper texture streaming
-			*/
-            vk::CommandBuffer tempCmdBuffer = BeginSingleTimeCommands(renderer->_device, renderer->_commandPool);
-
-            TransitionImage(tempCmdBuffer, m_texImage, {}, vk::ImageLayout::eTransferDstOptimal);
-            CopyBufferToImage(tempCmdBuffer, m_texImage, stagingBuffer, width, height);
-            TransitionImage(tempCmdBuffer, m_texImage, vk::ImageLayout::eTransferDstOptimal,
-                            vk::ImageLayout::eShaderReadOnlyOptimal);
-
-            EndSingleTimeCommands(renderer->_device, renderer->_graphicsQueue, renderer->_commandPool, tempCmdBuffer);
-
-            vkDestroyBuffer(renderer->_device, stagingBuffer, nullptr);
-            vkFreeMemory(renderer->_device, stagingBufferMemory, nullptr);
-
-            CreateTextureImageView();
-            CreateTextureSampler();
+            // build in cached memory, the staging mapping is write combined and slow to read back from
+            std::vector<u8> levels(imageSize);
+            memcpy(levels.data(), pixels, size_t(width) * height * 4);
+            for (u32 level = 1; level < m_mipLevels; level++)
+            {
+                DownsampleRGBA8(levels.data() + levelOffsets[level - 1], MipExtent(width, level - 1), MipExtent(height, level - 1),
+                                levels.data() + levelOffsets[level], true);
+            }
+            memcpy(data, levels.data(), levels.size());
+        }
+
+        // allocate memory inside device (gpu) to upload the texture, bind it to the image memory handle
+        // (watch Tu Wien lecture for more info. TLDR; Vulkan can allocate the memory anywhere inside the hw optimally,
+        // and the image memory handle is whats used to access it)
+        CreateImage(renderer->_device, batch.GetAllocator(), width, height, format,
+                    vk::ImageTiling::eOptimal,
+                    vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                    vk::MemoryPropertyFlagBits::eDeviceLocal, m_texImage, m_texImageMemory, m_mipLevels);
+
+        /* remember: The actual uploading of texture from storage to VRAM occurs here.
+         * The command buffers do the work related to it. So its important to target
+         * this place when I implement a proper texture streaming
+		*/
+        vk::CommandBuffer tempCmdBuffer = batch.GetCommandBuffer();
+        vk::Buffer stagingBuffer = batch.GetStagingBuffer();
+
+        TransitionImage(tempCmdBuffer, m_texImage, {}, vk::ImageLayout::eTransferDstOptimal, 0, m_mipLevels);
+        if (gpuMips)
+        {
+            // blits need a graphics queue, the copy can go anywhere
+            CopyBufferToImage(tempCmdBuffer, m_texImage, stagingBuffer, width, height, 0, staging.offset);
+            batch.ReleaseImage(m_texImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferDstOptimal, 0, m_mipLevels);
+            GenerateMipmaps(batch.GetGraphicsCommandBuffer(), m_texImage, width, height, m_mipLevels);
+        }
+        else
+        {
+            for (u32 level = 0; level < m_mipLevels; level++)
+            {
+                CopyBufferToImage(tempCmdBuffer, m_texImage, stagingBuffer, MipExtent(width, level), MipExtent(height, level),
+                                  level, staging.offset + levelOffsets[level]);
+            }
+            batch.ReleaseImage(m_texImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 0, m_mipLevels);
+        }
+
+        CreateTextureImageView();
+        CreateTextureSampler();
+    }
+    bool Texture::UploadCooked(const std::shared_ptr<Renderer>& renderer, UploadBatch& batch, const Ktx2Image& image)
+    {
+        // BC needs textureCompressionBC, anything else the file might carry needs to be sampleable as is
+        if (!(renderer->_physicalDevice.getFormatProperties(image.format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage))
+        {
+            printl(Log::LogLevel::Warn, "[TEXTURE] Cooked format {} is not supported on this device, using the source image", vk::to_string(image.format));
+            return false;
         }
+
+        m_format = image.format;
+        m_swizzle = Ktx2Swizzle(image.swizzle);
+        m_mipLevels = static_cast<u32>(image.levels.size());
+
+        // the level table points into the file, so the whole file goes up and the copies pick the levels out of it
+        const vk::DeviceSize imageSize = image.data.size();
+
+        // 16 keeps every level offset block aligned, they are already aligned within the file
+        const UploadBatch::Staging staging = batch.Stage(imageSize, 16);
+        memcpy(staging.data, image.data.data(), static_cast<size_t>(imageSize));
+
+        CreateImage(renderer->_device, batch.GetAllocator(), image.width, image.height, m_format,
+                    vk::ImageTiling::eOptimal,
+                    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                    vk::MemoryPropertyFlagBits::eDeviceLocal, m_texImage, m_texImageMemory, m_mipLevels);
+
+        vk::CommandBuffer tempCmdBuffer = batch.GetCommandBuffer();
+        vk::Buffer stagingBuffer = batch.GetStagingBuffer();
+
+        TransitionImage(tempCmdBuffer, m_texImage, {}, vk::ImageLayout::eTransferDstOptimal, 0, m_mipLevels);
+        for (u32 level = 0; level < m_mipLevels; level++)
+        {
+            CopyBufferToImage(tempCmdBuffer, m_texImage, stagingBuffer, MipExtent(image.width, level), MipExtent(image.height, level),
+                              level, staging.offset + image.levels[level].offset);
+        }
+        batch.ReleaseImage(m_texImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 0, m_mipLevels);
+
+        CreateTextureImageView();
+        CreateTextureSampler();
+        return true;
     }
+
     void Texture::CreateTextureImageView()
     {
-        m_texImageView = CreateImageView(_renderer->_device, m_texImage, vk::Format::eR8G8B8A8Srgb,
-                                         vk::ImageAspectFlagBits::eColor);
+        m_texImageView = CreateImageView(_renderer->_device, m_texImage, m_format,
+                                         vk::ImageAspectFlagBits::eColor, m_mipLevels, m_swizzle);
     }
     void Texture::CreateTextureSampler()
     {
@@ -98,7 +233,7 @@ namespace CV
         samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
         samplerInfo.mipLodBias = 0.0f;
         samplerInfo.minLod = 0.0f;
-        samplerInfo.maxLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(m_mipLevels);
 
         try
         {
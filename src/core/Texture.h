@@ -2,8 +2,13 @@
 #define TEXTURE_H
 
 #include <memory>
+#include <string>
 #include <vulkan/vulkan.hpp>
 
+#include "StandardTypes.h"
+#include "Ktx2.h"
+#include "UploadBatch.h"
+
 namespace CV
 {
     class Renderer;
@@ -11,19 +16,52 @@ namespace CV
 
 namespace CV
 {
+    // decoded RGBA8 pixels, or the cooked .ktx2 levels as they are on disk. CPU only, so it can be produced on any
+    // thread and uploaded later
+    struct TextureData
+    {
+        struct PixelDeleter { void operator()(u8* pixels) const; };
+
+        std::unique_ptr<u8, PixelDeleter> pixels;
+        int width = 0;
+        int height = 0;
+        Ktx2Image cooked;
+        std::string source;     // decoded again by Upload if the device can't sample the cooked format
+    };
+
+    // creates and uploads one image. The result is handed over to ResourceManager::SetTexture, which owns it from there
+    // and is what everything else refers to (by TextureHandle)
     class Texture
     {
     public:
         Texture() = default;
-        void LoadTexture(const std::shared_ptr<Renderer>& renderer, const char *filename);
+        // Decode + Upload in one go, with its own batch that is waited on before returning
+        void LoadTexture(const std::shared_ptr<Renderer>& renderer, MemoryAllocator& allocator, const char *filename);
+        // thread safe, touches no Vulkan state. Prefers an up to date cooked .ktx2 next to the file (see TextureCooker.h)
+        static TextureData Decode(const std::string& filename);
+        // stb only, ignores any cooked file
+        static TextureData DecodeSource(const std::string& filename);
+        // upper bound of what Upload stages for it, mip chain and alignment included
+        static vk::DeviceSize GetStagingSize(const TextureData& textureData);
+        // render thread only. Records into the batch, the texture is usable once the batch has been submitted and waited on.
+        // A cooked format the device can't sample falls back to the source image, decoded there and then.
+        // A failed decode uploads a 1x1 white texture so the bindless slot stays valid
+        void Upload(const std::shared_ptr<Renderer>& renderer, UploadBatch& batch, const TextureData& textureData);
         void CreateTextureImageView();
         void CreateTextureSampler();
 
     public:
         vk::Image m_texImage = VK_NULL_HANDLE;
-        vk::DeviceMemory m_texImageMemory = VK_NULL_HANDLE;
+        Allocation m_texImageMemory;
         vk::ImageView m_texImageView = VK_NULL_HANDLE;
         vk::Sampler m_texSampler = VK_NULL_HANDLE;
+        u32 m_mipLevels = 1;
+        vk::Format m_format = vk::Format::eR8G8B8A8Srgb;
+        vk::ComponentMapping m_swizzle{};
+
+    private:
+        // block compressed levels straight into the image, no CPU decode or mip generation
+        bool UploadCooked(const std::shared_ptr<Renderer>& renderer, UploadBatch& batch, const Ktx2Image& image);
         std::shared_ptr<Renderer> _renderer;
     };
 }
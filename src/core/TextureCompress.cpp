@@ -0,0 +1,283 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CV_TEXTURE_SSE2 1
+#endif
+
+#include "TextureCompress.h"
+
+namespace CV
+{
+	namespace
+	{
+		// sRGB <-> linear lookup, so averaging happens in linear space like the hardware blit does
+		struct SrgbTables
+		{
+			float toLinear[256];
+			u8 toSrgb[4096];
+		};
+
+		const SrgbTables& GetSrgbTables()
+		{
+			static const SrgbTables tables = []
+			{
+				SrgbTables t{};
+				for (u32 i = 0; i < 256; i++)
+				{
+					const float c = i / 255.f;
+					t.toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				}
+				for (u32 i = 0; i < 4096; i++)
+				{
+					const float l = i / 4095.f;
+					const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+					t.toSrgb[i] = static_cast<u8>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+				}
+				return t;
+			}();
+			return tables;
+		}
+
+		u16 PackRGB565(const float rgb[3])
+		{
+			auto quantize = [](float value, u32 maxValue)
+			{
+				return static_cast<u32>(std::clamp(value / 255.f * maxValue + 0.5f, 0.f, static_cast<float>(maxValue)));
+			};
+			return static_cast<u16>((quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) | quantize(rgb[2], 31));
+		}
+
+		// bit replication, matches what the decoder does
+		void UnpackRGB565(u16 color, i32 rgb[3])
+		{
+			const u32 r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+			rgb[0] = static_cast<i32>((r << 3) | (r >> 2));
+			rgb[1] = static_cast<i32>((g << 2) | (g >> 4));
+			rgb[2] = static_cast<i32>((b << 3) | (b >> 2));
+		}
+
+		// always the 4 colour mode (c0 > c1), so the block decodes the same inside BC1 and BC3
+		void EncodeColorBlock(const u8 texels[64], u8 block[8])
+		{
+			float mean[3] = {};
+			for (u32 i = 0; i < 16; i++)
+				for (u32 c = 0; c < 3; c++)
+					mean[c] += texels[i * 4 + c];
+			for (float& m : mean)
+				m /= 16.f;
+
+			float cov[6] = {};	// xx xy xz yy yz zz
+			for (u32 i = 0; i < 16; i++)
+			{
+				const float d[3] = { texels[i * 4] - mean[0], texels[i * 4 + 1] - mean[1], texels[i * 4 + 2] - mean[2] };
+				cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+				cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+			}
+
+			// principal axis by power iteration, a handful of steps is plenty for a 3x3
+			float axis[3] = { 1.f, 1.f, 1.f };
+			for (u32 iteration = 0; iteration < 8; iteration++)
+			{
+				const float next[3] = {
+					cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+					cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+					cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+				const float length = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) });
+				if (length < 1e-6f)
+					break;
+				for (u32 c = 0; c < 3; c++)
+					axis[c] = next[c] / length;
+			}
+			const float axisLengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+			float minProj = 0.f, maxProj = 0.f;
+			for (u32 i = 0; i < 16; i++)
+			{
+				const float proj = ((texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] +
+					(texels[i * 4 + 2] - mean[2]) * axis[2]) / axisLengthSq;
+				minProj = std::min(minProj, proj);
+				maxProj = std::max(maxProj, proj);
+			}
+			// pull the endpoints in by half an interpolation step, the extremes are rarely the best fit
+			const float inset = (maxProj - minProj) / 16.f;
+			minProj += inset;
+			maxProj -= inset;
+
+			float endpoint0[3], endpoint1[3];
+			for (u32 c = 0; c < 3; c++)
+			{
+				endpoint0[c] = mean[c] + axis[c] * maxProj;
+				endpoint1[c] = mean[c] + axis[c] * minProj;
+			}
+			u16 color0 = PackRGB565(endpoint0);
+			u16 color1 = PackRGB565(endpoint1);
+			if (color0 < color1)
+				std::swap(color0, color1);
+
+			u32 indices = 0;
+			if (color0 != color1)
+			{
+				i32 palette[4][3];
+				UnpackRGB565(color0, palette[0]);
+				UnpackRGB565(color1, palette[1]);
+				for (u32 c = 0; c < 3; c++)
+				{
+					palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+				}
+
+				for (u32 i = 0; i < 16; i++)
+				{
+					u32 best = 0;
+					i32 bestError = INT32_MAX;
+					for (u32 p = 0; p < 4; p++)
+					{
+						i32 error = 0;
+						for (u32 c = 0; c < 3; c++)
+						{
+							const i32 d = static_cast<i32>(texels[i * 4 + c]) - palette[p][c];
+							error += d * d;
+						}
+						if (error < bestError)
+						{
+							bestError = error;
+							best = p;
+						}
+					}
+					indices |= best << (i * 2);
+				}
+			}
+
+			memcpy(block, &color0, sizeof(u16));
+			memcpy(block + 2, &color1, sizeof(u16));
+			memcpy(block + 4, &indices, sizeof(u32));
+		}
+	}
+
+	void DownsampleRGBA8(const u8* src, u32 width, u32 height, u8* dst, bool srgb)
+	{
+		const SrgbTables& t = GetSrgbTables();
+		const u32 dstWidth = MipExtent(width, 1);
+		const u32 dstHeight = MipExtent(height, 1);
+
+		for (u32 y = 0; y < dstHeight; y++)
+		{
+			const u8* row0 = src + size_t(std::min(y * 2, height - 1)) * width * 4;
+			const u8* row1 = src + size_t(std::min(y * 2 + 1, height - 1)) * width * 4;
+			for (u32 x = 0; x < dstWidth; x++)
+			{
+				const u32 x0 = std::min(x * 2, width - 1) * 4;
+				const u32 x1 = std::min(x * 2 + 1, width - 1) * 4;
+				const u8* p[4] = { row0 + x0, row0 + x1, row1 + x0, row1 + x1 };
+
+				alignas(16) float avg[4];
+#ifdef CV_TEXTURE_SSE2
+				__m128 sum = _mm_setzero_ps();
+				for (const u8* texel : p)
+				{
+					const __m128 value = srgb ?
+						_mm_set_ps(texel[3] / 255.f, t.toLinear[texel[2]], t.toLinear[texel[1]], t.toLinear[texel[0]]) :
+						_mm_mul_ps(_mm_set_ps(texel[3], texel[2], texel[1], texel[0]), _mm_set1_ps(1.f / 255.f));
+					sum = _mm_add_ps(sum, value);
+				}
+				_mm_store_ps(avg, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+				avg[0] = avg[1] = avg[2] = avg[3] = 0.f;
+				for (const u8* texel : p)
+				{
+					for (u32 c = 0; c < 3; c++)
+						avg[c] += srgb ? t.toLinear[texel[c]] : texel[c] / 255.f;
+					avg[3] += texel[3] / 255.f;
+				}
+				for (float& v : avg)
+					v *= 0.25f;
+#endif
+				u8* out = dst + (size_t(y) * dstWidth + x) * 4;
+				for (u32 c = 0; c < 3; c++)
+					out[c] = srgb ? t.toSrgb[static_cast<u32>(avg[c] * 4095.f + 0.5f)] : static_cast<u8>(avg[c] * 255.f + 0.5f);
+				out[3] = static_cast<u8>(avg[3] * 255.f + 0.5f);
+			}
+		}
+	}
+
+	void FetchBlock(const u8* rgba, u32 width, u32 height, u32 blockX, u32 blockY, u8 texels[64])
+	{
+		for (u32 y = 0; y < kBlockDim; y++)
+		{
+			const u32 srcY = std::min(blockY * kBlockDim + y, height - 1);
+			for (u32 x = 0; x < kBlockDim; x++)
+			{
+				const u32 srcX = std::min(blockX * kBlockDim + x, width - 1);
+				memcpy(texels + (y * kBlockDim + x) * 4, rgba + (size_t(srcY) * width + srcX) * 4, 4);
+			}
+		}
+	}
+
+	void EncodeBC1(const u8 texels[64], u8 block[8])
+	{
+		EncodeColorBlock(texels, block);
+	}
+
+	void EncodeBC3(const u8 texels[64], u8 block[16])
+	{
+		u8 alpha[16];
+		for (u32 i = 0; i < 16; i++)
+			alpha[i] = texels[i * 4 + 3];
+		EncodeBC4(alpha, block);
+		EncodeColorBlock(texels, block + 8);
+	}
+
+	void EncodeBC4(const u8 values[16], u8 block[8])
+	{
+		const auto [minIt, maxIt] = std::minmax_element(values, values + 16);
+		const i32 a0 = *maxIt, a1 = *minIt;
+
+		// a0 > a1 selects the 8 value ramp. A flat block leaves every index on a0
+		u64 indices = 0;
+		if (a0 != a1)
+		{
+			i32 palette[8] = { a0, a1 };
+			for (i32 i = 2; i < 8; i++)
+				palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+
+			for (u32 i = 0; i < 16; i++)
+			{
+				u64 best = 0;
+				i32 bestError = INT32_MAX;
+				for (u32 p = 0; p < 8; p++)
+				{
+					const i32 error = std::abs(static_cast<i32>(values[i]) - palette[p]);
+					if (error < bestError)
+					{
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= best << (i * 3);
+			}
+		}
+
+		block[0] = static_cast<u8>(a0);
+		block[1] = static_cast<u8>(a1);
+		for (u32 i = 0; i < 6; i++)
+			block[2 + i] = static_cast<u8>(indices >> (i * 8));
+	}
+
+	void EncodeBC5(const u8 texels[64], u8 block[16])
+	{
+		u8 red[16], green[16];
+		for (u32 i = 0; i < 16; i++)
+		{
+			red[i] = texels[i * 4];
+			green[i] = texels[i * 4 + 1];
+		}
+		EncodeBC4(red, block);
+		EncodeBC4(green, block + 8);
+	}
+}
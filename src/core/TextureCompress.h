@@ -0,0 +1,34 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include "StandardTypes.h"
+
+// CPU side texel work shared by the runtime mip fallback and the texture cooker: RGBA8 2x2 downsampling and
+// BC1/BC3/BC4/BC5 block encoding. The encoders fit endpoints along the principal axis (colour) or to the min/max
+// (single channel), which is far from what a BC7 encoder produces but good enough for an offline pass that runs once.
+
+namespace CV
+{
+	constexpr u32 kBlockDim = 4;
+
+	inline u32 MipExtent(u32 extent, u32 level) { return extent >> level ? extent >> level : 1; }
+	inline u32 BlockCount(u32 extent) { return (extent + kBlockDim - 1) / kBlockDim; }
+
+	// 2x2 box filter of an RGBA8 level into the next (MipExtent(width, 1) x MipExtent(height, 1)). Odd edges clamp.
+	// srgb averages the colour channels in linear space, alpha is always treated as linear
+	void DownsampleRGBA8(const u8* src, u32 width, u32 height, u8* dst, bool srgb);
+
+	// 4x4 RGBA8 texels in, one compressed block out
+	void EncodeBC1(const u8 texels[64], u8 block[8]);
+	void EncodeBC3(const u8 texels[64], u8 block[16]);
+
+	// 16 single channel values in, one block out
+	void EncodeBC4(const u8 values[16], u8 block[8]);
+	// red and green channels of 4x4 RGBA8 texels
+	void EncodeBC5(const u8 texels[64], u8 block[16]);
+
+	// copies the 4x4 block at (blockX, blockY) out of an RGBA8 image, clamping at the edges
+	void FetchBlock(const u8* rgba, u32 width, u32 height, u32 blockX, u32 blockY, u8 texels[64]);
+}
+
+#endif
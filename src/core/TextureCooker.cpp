@@ -0,0 +1,219 @@
+#include <pch.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+#include <cgltf.h>
+#include <includes/stb_image.h>
+
+#include "TextureCooker.h"
+#include "TextureCompress.h"
+#include "Ktx2.h"
+#include "ThreadPool.h"
+#include "vk_utils.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		// keeps the normals unit length after the box filter shortened them
+		void RenormalizeRGBA8(u8* rgba, size_t texelCount)
+		{
+			for (size_t i = 0; i < texelCount; i++)
+			{
+				u8* texel = rgba + i * 4;
+				float n[3] = { texel[0] / 127.5f - 1.f, texel[1] / 127.5f - 1.f, texel[2] / 127.5f - 1.f };
+				const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length < 1e-6f)
+					continue;
+				for (u32 c = 0; c < 3; c++)
+					texel[c] = static_cast<u8>(std::clamp((n[c] / length * 0.5f + 0.5f) * 255.f + 0.5f, 0.f, 255.f));
+			}
+		}
+
+		// BC3/BC5 blocks are 16 bytes, BC1 8
+		using BlockEncoder = void (*)(const u8* texels, u8* block);
+	}
+
+	std::string GetCookedTexturePath(const std::string& sourcePath)
+	{
+		return std::filesystem::path(sourcePath).replace_extension(".ktx2").string();
+	}
+
+	bool IsCookedTextureCurrent(const std::string& sourcePath)
+	{
+		std::error_code ec;
+		const auto cookedTime = std::filesystem::last_write_time(GetCookedTexturePath(sourcePath), ec);
+		if (ec)
+			return false;
+		// a missing source is fine, the cooked file can ship on its own
+		const auto sourceTime = std::filesystem::last_write_time(sourcePath, ec);
+		return ec || cookedTime >= sourceTime;
+	}
+
+	bool CookTexture(const std::string& sourcePath, TextureUsage usage)
+	{
+		int width, height, channels;
+		u8* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			printl(Log::LogLevel::Error, "[COOKER] Failed to load {}", sourcePath);
+			return false;
+		}
+
+		const u32 w = static_cast<u32>(width);
+		const u32 h = static_cast<u32>(height);
+		const u32 levelCount = MipLevelCount(w, h);
+
+		// the whole RGBA8 chain first, then compress level by level
+		std::vector<size_t> rgbaOffsets(levelCount, 0);
+		size_t rgbaSize = 0;
+		for (u32 level = 0; level < levelCount; level++)
+		{
+			rgbaOffsets[level] = rgbaSize;
+			rgbaSize += size_t(MipExtent(w, level)) * MipExtent(h, level) * 4;
+		}
+		std::vector<u8> rgba(rgbaSize);
+		memcpy(rgba.data(), pixels, size_t(w) * h * 4);
+		stbi_image_free(pixels);
+
+		const bool srgb = usage == TextureUsage::Color;
+		for (u32 level = 1; level < levelCount; level++)
+		{
+			DownsampleRGBA8(rgba.data() + rgbaOffsets[level - 1], MipExtent(w, level - 1), MipExtent(h, level - 1), rgba.data() + rgbaOffsets[level], srgb);
+			if (usage == TextureUsage::Normal)
+				RenormalizeRGBA8(rgba.data() + rgbaOffsets[level], size_t(MipExtent(w, level)) * MipExtent(h, level));
+		}
+
+		Ktx2Image image;
+		image.width = w;
+		image.height = h;
+		BlockEncoder encode = EncodeBC5;
+		u32 blockBytes = 16;
+		switch (usage)
+		{
+		case TextureUsage::Color:
+		{
+			bool hasAlpha = false;
+			for (size_t i = 3; i < size_t(w) * h * 4 && !hasAlpha; i += 4)
+				hasAlpha = rgba[i] != 255;
+			image.format = hasAlpha ? vk::Format::eBc3SrgbBlock : vk::Format::eBc1RgbSrgbBlock;
+			image.swizzle = hasAlpha ? "rgba" : "rgb1";
+			encode = hasAlpha ? EncodeBC3 : EncodeBC1;
+			blockBytes = hasAlpha ? 16 : 8;
+			break;
+		}
+		case TextureUsage::Normal:
+			// no swizzle, b reads 0 and the shader rebuilds z from x and y
+			image.format = vk::Format::eBc5UnormBlock;
+			image.swizzle = "rgba";
+			break;
+		case TextureUsage::MetallicRoughness:
+			// roughness/metallic move down into r/g before encoding, the swizzle puts them back on g/b
+			for (size_t i = 0; i < rgba.size(); i += 4)
+			{
+				rgba[i] = rgba[i + 1];
+				rgba[i + 1] = rgba[i + 2];
+			}
+			image.format = vk::Format::eBc5UnormBlock;
+			image.swizzle = "0rg1";
+			break;
+		}
+
+		image.levels.resize(levelCount);
+		u64 dataSize = 0;
+		for (u32 level = 0; level < levelCount; level++)
+		{
+			const u64 size = u64(BlockCount(MipExtent(w, level))) * BlockCount(MipExtent(h, level)) * blockBytes;
+			image.levels[level] = { dataSize, size };
+			dataSize += size;
+		}
+		image.data.resize(dataSize);
+
+		for (u32 level = 0; level < levelCount; level++)
+		{
+			const u32 levelWidth = MipExtent(w, level);
+			const u32 levelHeight = MipExtent(h, level);
+			const u8* src = rgba.data() + rgbaOffsets[level];
+			u8* dst = image.data.data() + image.levels[level].offset;
+			for (u32 by = 0; by < BlockCount(levelHeight); by++)
+			{
+				for (u32 bx = 0; bx < BlockCount(levelWidth); bx++)
+				{
+					u8 texels[64];
+					FetchBlock(src, levelWidth, levelHeight, bx, by, texels);
+					encode(texels, dst);
+					dst += blockBytes;
+				}
+			}
+		}
+
+		const std::string cookedPath = GetCookedTexturePath(sourcePath);
+		if (!WriteKtx2(cookedPath, image, srgb))
+			return false;
+
+		printl(Log::LogLevel::Info, "[COOKER] {} -> {} ({}, {} levels, {:.1f}x smaller)", sourcePath, cookedPath, vk::to_string(image.format),
+			levelCount, double(rgbaSize) / double(dataSize));
+		return true;
+	}
+
+	u32 CookModelTextures(const std::string& gltfPath, bool force)
+	{
+		cgltf_options options = {};
+		cgltf_data* data = nullptr;
+		if (cgltf_parse_file(&options, gltfPath.c_str(), &data) != cgltf_result_success)
+		{
+			printl(Log::LogLevel::Error, "[COOKER] Failed to parse {}", gltfPath);
+			return 0;
+		}
+
+		const std::string dirPath = gltfPath.substr(0, gltfPath.find_last_of("/"));
+
+		// one usage per image. An image shared between slots keeps the first one it was seen with
+		std::map<std::string, TextureUsage> images;
+		auto addImage = [&](const cgltf_texture_view& view, TextureUsage usage)
+		{
+			if (view.texture && view.texture->image && view.texture->image->uri)
+				images.emplace(dirPath + "/" + view.texture->image->uri, usage);
+		};
+		for (size_t i = 0; i < data->materials_count; i++)
+		{
+			const cgltf_material& material = data->materials[i];
+			if (material.has_pbr_metallic_roughness)
+			{
+				addImage(material.pbr_metallic_roughness.base_color_texture, TextureUsage::Color);
+				addImage(material.pbr_metallic_roughness.metallic_roughness_texture, TextureUsage::MetallicRoughness);
+			}
+			addImage(material.normal_texture, TextureUsage::Normal);
+			addImage(material.emissive_texture, TextureUsage::Color);
+		}
+		cgltf_free(data);
+
+		std::vector<std::pair<std::string, TextureUsage>> jobs;
+		for (const auto& [path, usage] : images)
+		{
+			if (force || !IsCookedTextureCurrent(path))
+				jobs.emplace_back(path, usage);
+		}
+
+		using Clock = std::chrono::high_resolution_clock;
+		const auto start = Clock::now();
+		std::atomic<u32> cooked = 0;
+		ThreadPool pool;
+		pool.ParallelFor(jobs.size(), [&](size_t i)
+		{
+			if (CookTexture(jobs[i].first, jobs[i].second))
+				cooked++;
+		});
+
+		printl(Log::LogLevel::Info, "[COOKER] {}: cooked {} of {} textures ({} up to date) in {:.2f} ms", gltfPath, cooked.load(), jobs.size(),
+			images.size() - jobs.size(), std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		return cooked;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <string>
+
+#include "StandardTypes.h"
+
+// offline texture cooking: source image (png/jpg, anything stb_image reads) -> .ktx2 next to it, block compressed
+// with a full mip chain. The runtime (Texture::Decode) picks the .ktx2 up whenever it is at least as new as the source.
+//
+//   Color              albedo/emissive, sRGB. BC1, or BC3 if any texel has alpha
+//   Normal             BC5 (x, y). z has to be rebuilt in the shader as sqrt(1 - x^2 - y^2)
+//   MetallicRoughness  BC5 of glTF's (roughness, metallic) = (g, b), swizzled back so the shader still reads .g/.b
+
+namespace CV
+{
+	enum class TextureUsage
+	{
+		Color,
+		Normal,
+		MetallicRoughness
+	};
+
+	// foo/bar.png -> foo/bar.ktx2
+	std::string GetCookedTexturePath(const std::string& sourcePath);
+
+	// true if the cooked file exists and is not older than the source
+	bool IsCookedTextureCurrent(const std::string& sourcePath);
+
+	bool CookTexture(const std::string& sourcePath, TextureUsage usage);
+
+	// cooks every image a glTF's materials reference, the usage comes from the material slot.
+	// Up to date textures are skipped unless force is set. Returns the number of textures written
+	u32 CookModelTextures(const std::string& gltfPath, bool force = false);
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include <pch.h>
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+namespace CV
+{
+	ThreadPool::ThreadPool(u32 threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+		// the calling thread counts as one of them
+		u32 workerCount = threadCount - 1;
+		m_workers.reserve(workerCount);
+		for (u32 i = 0; i < workerCount; i++)
+		{
+			m_workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			if (worker.joinable())
+				worker.join();
+		}
+	}
+
+	void ThreadPool::Enqueue(std::function<void()> task)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_tasks.push_back(std::move(task));
+		}
+		m_cv.notify_one();
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock lock(m_mutex);
+				m_cv.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+				if (m_stop && m_tasks.empty())
+					return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+	{
+		if (count == 0)
+			return;
+
+		if (m_workers.empty() || count == 1)
+		{
+			for (size_t i = 0; i < count; i++)
+				func(i);
+			return;
+		}
+
+		// shared state lives on the heap: helpers queued behind other work might only start after
+		// the loop is already done, they then just see next >= count and leave
+		struct ForState
+		{
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			size_t count = 0;
+			std::function<void(size_t)> func;
+			std::mutex mutex;
+			std::condition_variable cv;
+		};
+		auto state = std::make_shared<ForState>();
+		state->count = count;
+		state->func = func;
+
+		auto drain = [](ForState& s)
+		{
+			size_t i;
+			while ((i = s.next.fetch_add(1, std::memory_order_relaxed)) < s.count)
+			{
+				s.func(i);
+				if (s.done.fetch_add(1, std::memory_order_acq_rel) + 1 == s.count)
+				{
+					std::lock_guard lock(s.mutex);
+					s.cv.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min(m_workers.size(), count - 1);
+		for (size_t i = 0; i < helpers; i++)
+		{
+			Enqueue([state, drain]() { drain(*state); });
+		}
+
+		drain(*state);
+
+		std::unique_lock lock(state->mutex);
+		state->cv.wait(lock, [&]() { return state->done.load(std::memory_order_acquire) == state->count; });
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "StandardTypes.h"
+
+namespace CV
+{
+	// small fixed size worker pool. Used for the load time work (mesh import, texture decode etc.) and per frame command recording
+	// the calling thread always helps out in ParallelFor, so a pool with 0 workers just runs everything inline
+	class ThreadPool
+	{
+	public:
+		// threadCount includes the calling thread, 0 picks hardware_concurrency
+		explicit ThreadPool(u32 threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		[[nodiscard]] u32 GetWorkerCount() const { return static_cast<u32>(m_workers.size()); }
+
+		template<typename F>
+		auto Submit(F&& func) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+		{
+			using Result = std::invoke_result_t<std::decay_t<F>>;
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+			std::future<Result> future = task->get_future();
+
+			if (m_workers.empty())
+			{
+				(*task)();
+				return future;
+			}
+			Enqueue([task]() { (*task)(); });
+			return future;
+		}
+
+		// runs func(i) for every i in [0, count) and returns once all of them are done
+		void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	private:
+		void Enqueue(std::function<void()> task);
+		void WorkerLoop();
+
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_stop = false;
+	};
+}
+
+#endif
@@ -0,0 +1,330 @@
+#include <pch.h>
+
+#include <cstring>
+
+#include "UploadBatch.h"
+#include "common.h"
+#include "vk_utils.h"
+#include "Log.h"
+
+namespace CV
+{
+	namespace
+	{
+		// where the graphics queue picks an uploaded image up
+		void DstScope(vk::ImageLayout layout, vk::PipelineStageFlags2& stage, vk::AccessFlags2& access)
+		{
+			switch (layout)
+			{
+			case vk::ImageLayout::eShaderReadOnlyOptimal:
+				stage = vk::PipelineStageFlagBits2::eFragmentShader;
+				access = vk::AccessFlagBits2::eShaderRead;
+				break;
+			case vk::ImageLayout::eTransferDstOptimal:
+				// mip generation reads and writes it next
+				stage = vk::PipelineStageFlagBits2::eTransfer;
+				access = vk::AccessFlagBits2::eTransferRead | vk::AccessFlagBits2::eTransferWrite;
+				break;
+			default:
+				stage = vk::PipelineStageFlagBits2::eAllCommands;
+				access = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite;
+				break;
+			}
+		}
+
+		vk::CommandBuffer AllocateCommandBuffer(vk::Device device, vk::CommandPool commandPool)
+		{
+			vk::CommandBufferAllocateInfo allocInfo{};
+			allocInfo.level = vk::CommandBufferLevel::ePrimary;
+			allocInfo.commandPool = commandPool;
+			allocInfo.commandBufferCount = 1;
+			return device.allocateCommandBuffers(allocInfo)[0];
+		}
+	}
+
+	UploadBatch::UploadBatch(vk::Device device, MemoryAllocator& allocator, const UploadQueue& queue, vk::DeviceSize arenaSize)
+		: UploadBatch(device, allocator, queue, queue, arenaSize)
+	{
+	}
+
+	UploadBatch::UploadBatch(vk::Device device, MemoryAllocator& allocator, const UploadQueue& transfer, const UploadQueue& graphics,
+		vk::DeviceSize arenaSize)
+		: m_device(device), m_allocator(allocator), m_transfer(transfer), m_graphics(graphics)
+	{
+		m_split = m_transfer.queue != m_graphics.queue;
+		m_ownershipTransfer = m_split && m_transfer.family != m_graphics.family;
+
+		m_commandBuffer = AllocateCommandBuffer(m_device, m_transfer.commandPool);
+		if (m_split)
+		{
+			m_graphicsCommandBuffer = AllocateCommandBuffer(m_device, m_graphics.commandPool);
+			m_transferDone = m_device.createSemaphore(vk::SemaphoreCreateInfo{});
+		}
+
+		m_fence = m_device.createFence(vk::FenceCreateInfo{});
+		CreateArena(arenaSize);
+	}
+
+	UploadBatch::~UploadBatch()
+	{
+		// anything recorded but never submitted still has to land, the caller owns the destination resources
+		Flush();
+		DestroyArena();
+		m_device.destroyFence(m_fence);
+		m_device.freeCommandBuffers(m_transfer.commandPool, 1, &m_commandBuffer);
+		if (m_split)
+		{
+			m_device.destroySemaphore(m_transferDone);
+			m_device.freeCommandBuffers(m_graphics.commandPool, 1, &m_graphicsCommandBuffer);
+		}
+	}
+
+	UploadBatch::Staging UploadBatch::Stage(vk::DeviceSize size, vk::DeviceSize alignment)
+	{
+		// the arena is only rewound once the previous submit has been consumed
+		if (m_inFlight)
+			Wait();
+
+		vk::DeviceSize offset = (m_arenaHead + alignment - 1) / alignment * alignment;
+		if (offset + size > m_arenaSize)
+		{
+			// out of space: send what we have and start over. Anything bigger than the whole arena gets an arena of its own size
+			printl(Log::LogLevel::InfoDebug, "[UPLOAD] Staging arena full ({} KB), flushing early", m_arenaSize / 1024);
+			Flush();
+			if (size > m_arenaSize)
+			{
+				DestroyArena();
+				CreateArena(size);
+			}
+			offset = 0;
+		}
+
+		m_arenaHead = offset + size;
+		m_stagedBytes += size;
+		return { m_stagingMemory.mapped + offset, offset };
+	}
+
+	void UploadBatch::UploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset)
+	{
+		if (size == 0)
+			return;
+
+		const Staging staging = Stage(size);
+		memcpy(staging.data, data, static_cast<size_t>(size));
+
+		vk::BufferCopy copyRegion{};
+		copyRegion.srcOffset = staging.offset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		GetCommandBuffer().copyBuffer(m_stagingBuffer, dst, 1, &copyRegion);
+
+		if (m_ownershipTransfer)
+			m_releasedBuffers.push_back(dst);
+	}
+
+	vk::CommandBuffer UploadBatch::GetCommandBuffer()
+	{
+		Begin();
+		return m_commandBuffer;
+	}
+
+	vk::CommandBuffer UploadBatch::GetGraphicsCommandBuffer()
+	{
+		Begin();
+		return m_split ? m_graphicsCommandBuffer : m_commandBuffer;
+	}
+
+	void UploadBatch::ReleaseImage(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, u32 baseMip, u32 levelCount)
+	{
+		vk::ImageMemoryBarrier2 barrier{};
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.image = image;
+		barrier.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, baseMip, levelCount, 0, 1 };
+		barrier.srcQueueFamilyIndex = m_ownershipTransfer ? m_transfer.family : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = m_ownershipTransfer ? m_graphics.family : VK_QUEUE_FAMILY_IGNORED;
+
+		vk::DependencyInfo depInfo{};
+		depInfo.imageMemoryBarrierCount = 1;
+		depInfo.pImageMemoryBarriers = &barrier;
+
+		if (!m_split)
+		{
+			// one queue, a plain transition
+			barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+			barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+			DstScope(newLayout, barrier.dstStageMask, barrier.dstAccessMask);
+			GetCommandBuffer().pipelineBarrier2(depInfo);
+			return;
+		}
+
+		if (m_ownershipTransfer)
+		{
+			// release half: the transfer queue only has to finish its writes, the layout change happens in both halves
+			barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+			barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+			barrier.dstStageMask = vk::PipelineStageFlagBits2::eNone;
+			barrier.dstAccessMask = {};
+			GetCommandBuffer().pipelineBarrier2(depInfo);
+		}
+
+		// acquire half (or just the transition on a second queue of the same family), after the semaphore wait
+		barrier.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+		barrier.srcAccessMask = {};
+		DstScope(newLayout, barrier.dstStageMask, barrier.dstAccessMask);
+		GetGraphicsCommandBuffer().pipelineBarrier2(depInfo);
+	}
+
+	void UploadBatch::Begin()
+	{
+		if (m_recording)
+			return;
+
+		// one set of command buffers, so the last submit has to be done with them before they can be recorded again
+		if (m_inFlight)
+			Wait();
+
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		m_commandBuffer.begin(beginInfo);
+		if (m_split)
+			m_graphicsCommandBuffer.begin(beginInfo);
+		m_recording = true;
+	}
+
+	void UploadBatch::Submit()
+	{
+		if (!m_recording)
+			return;
+
+		if (!m_split)
+		{
+			// the copies have to be visible to whatever reads the data next (vertex fetch, index fetch, BDA loads).
+			// Images carry their own layout transitions, this covers the buffers
+			vk::MemoryBarrier2 memoryBarrier{};
+			memoryBarrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+			memoryBarrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+			memoryBarrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+			memoryBarrier.dstAccessMask = vk::AccessFlagBits2::eMemoryRead;
+
+			vk::DependencyInfo depInfo{};
+			depInfo.memoryBarrierCount = 1;
+			depInfo.pMemoryBarriers = &memoryBarrier;
+			m_commandBuffer.pipelineBarrier2(depInfo);
+
+			m_commandBuffer.end();
+			m_recording = false;
+
+			vk::SubmitInfo submitInfo{};
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &m_commandBuffer;
+			VK_ASSERT(m_graphics.queue.submit(1, &submitInfo, m_fence));
+
+			m_inFlight = true;
+			m_submitCount++;
+			return;
+		}
+
+		// the semaphore already orders and makes visible everything, only a family change needs per buffer barriers
+		if (!m_releasedBuffers.empty())
+		{
+			std::vector<vk::BufferMemoryBarrier2> releases(m_releasedBuffers.size());
+			std::vector<vk::BufferMemoryBarrier2> acquires(m_releasedBuffers.size());
+			for (size_t i = 0; i < m_releasedBuffers.size(); i++)
+			{
+				vk::BufferMemoryBarrier2& release = releases[i];
+				release.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+				release.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+				release.srcQueueFamilyIndex = m_transfer.family;
+				release.dstQueueFamilyIndex = m_graphics.family;
+				release.buffer = m_releasedBuffers[i];
+				release.offset = 0;
+				release.size = VK_WHOLE_SIZE;
+
+				vk::BufferMemoryBarrier2& acquire = acquires[i];
+				acquire = release;
+				acquire.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+				acquire.srcAccessMask = {};
+				acquire.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+				acquire.dstAccessMask = vk::AccessFlagBits2::eMemoryRead;
+				release.dstStageMask = vk::PipelineStageFlagBits2::eNone;
+				release.dstAccessMask = {};
+			}
+
+			vk::DependencyInfo releaseInfo{};
+			releaseInfo.bufferMemoryBarrierCount = static_cast<u32>(releases.size());
+			releaseInfo.pBufferMemoryBarriers = releases.data();
+			m_commandBuffer.pipelineBarrier2(releaseInfo);
+
+			vk::DependencyInfo acquireInfo{};
+			acquireInfo.bufferMemoryBarrierCount = static_cast<u32>(acquires.size());
+			acquireInfo.pBufferMemoryBarriers = acquires.data();
+			m_graphicsCommandBuffer.pipelineBarrier2(acquireInfo);
+			m_releasedBuffers.clear();
+		}
+
+		m_commandBuffer.end();
+		m_graphicsCommandBuffer.end();
+		m_recording = false;
+
+		vk::SubmitInfo transferSubmit{};
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &m_commandBuffer;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &m_transferDone;
+		VK_ASSERT(m_transfer.queue.submit(1, &transferSubmit, nullptr));
+
+		const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+		vk::SubmitInfo graphicsSubmit{};
+		graphicsSubmit.waitSemaphoreCount = 1;
+		graphicsSubmit.pWaitSemaphores = &m_transferDone;
+		graphicsSubmit.pWaitDstStageMask = &waitStage;
+		graphicsSubmit.commandBufferCount = 1;
+		graphicsSubmit.pCommandBuffers = &m_graphicsCommandBuffer;
+		VK_ASSERT(m_graphics.queue.submit(1, &graphicsSubmit, m_fence));
+
+		m_inFlight = true;
+		m_submitCount++;
+	}
+
+	void UploadBatch::Wait()
+	{
+		if (!m_inFlight)
+			return;
+
+		VK_ASSERT(m_device.waitForFences(1u, &m_fence, VK_TRUE, UINT64_MAX));
+		VK_ASSERT(m_device.resetFences(1u, &m_fence));
+		m_inFlight = false;
+		m_arenaHead = 0;
+	}
+
+	void UploadBatch::Flush()
+	{
+		Submit();
+		Wait();
+	}
+
+	bool UploadBatch::IsComplete() const
+	{
+		return !m_recording && (!m_inFlight || m_device.getFenceStatus(m_fence) == vk::Result::eSuccess);
+	}
+
+	void UploadBatch::CreateArena(vk::DeviceSize size)
+	{
+		CreateBuffer(m_device, m_allocator, size, vk::BufferUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			m_stagingBuffer, m_stagingMemory);
+		m_arenaSize = size;
+		m_arenaHead = 0;
+	}
+
+	void UploadBatch::DestroyArena()
+	{
+		if (m_stagingBuffer)
+			m_device.destroyBuffer(m_stagingBuffer);
+		m_allocator.free(m_stagingMemory);
+		m_stagingBuffer = VK_NULL_HANDLE;
+		m_arenaSize = 0;
+		m_arenaHead = 0;
+	}
+}
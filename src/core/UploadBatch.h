@@ -0,0 +1,113 @@
+#ifndef UPLOAD_BATCH_H
+#define UPLOAD_BATCH_H
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "MemoryAllocator.h"
+
+// collects uploads into one command buffer. Source data is copied into a persistently mapped staging arena,
+// the copies (and whatever barriers/blits the caller adds) are recorded as they come in and go to the queue in a single
+// submit that signals a fence. Only when the arena runs out does a batch go out early (submit + wait, then the arena is
+// reused), so a whole model normally costs one GPU round trip instead of one per buffer/texture.
+//
+// With a transfer queue that isn't the graphics queue the copies run there and a second command buffer on the graphics
+// queue (GetGraphicsCommandBuffer, for blits and anything else transfer queues can't do) waits for them on a semaphore.
+// Resources of exclusive sharing mode change queue family through Release*: a release barrier on the transfer side and
+// the matching acquire on the graphics side. On a single queue both are one plain barrier.
+//
+//   UploadBatch batch(...);
+//   batch.UploadBuffer(data, size, buffer);
+//   auto staging = batch.Stage(size, 16);  memcpy(staging.data, ...);  record from staging.offset into batch.GetCommandBuffer()
+//   batch.ReleaseImage(image, ...);
+//   batch.Submit();  ...  batch.Wait();
+
+namespace CV
+{
+	struct UploadQueue
+	{
+		vk::Queue queue = VK_NULL_HANDLE;
+		vk::CommandPool commandPool = VK_NULL_HANDLE;	// has to be of family
+		u32 family = 0;
+	};
+
+	class UploadBatch
+	{
+	public:
+		struct Staging
+		{
+			u8* data = nullptr;
+			vk::DeviceSize offset = 0;	// into GetStagingBuffer()
+		};
+
+		// everything on one queue
+		UploadBatch(vk::Device device, MemoryAllocator& allocator, const UploadQueue& queue, vk::DeviceSize arenaSize = 64ull << 20);
+		// copies on transfer, the resources end up owned by graphics
+		UploadBatch(vk::Device device, MemoryAllocator& allocator, const UploadQueue& transfer, const UploadQueue& graphics,
+			vk::DeviceSize arenaSize = 64ull << 20);
+		// waits for anything still in flight
+		~UploadBatch();
+		UploadBatch(const UploadBatch&) = delete;
+		UploadBatch& operator=(const UploadBatch&) = delete;
+
+		// reserves staging space. May flush the commands recorded so far, so fetch GetCommandBuffer() after staging
+		Staging Stage(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+		// stage + record the copy into dst, the buffer is released to the graphics queue on submit
+		void UploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset = 0);
+
+		// transfer command buffer (copies only), begun on first use
+		vk::CommandBuffer GetCommandBuffer();
+		// graphics command buffer, runs after everything recorded into GetCommandBuffer(). Same one on a single queue
+		vk::CommandBuffer GetGraphicsCommandBuffer();
+		// hands mips [baseMip, baseMip + levelCount) over to the graphics queue once the copies into them are recorded,
+		// moving them from oldLayout (what the copies left) to newLayout
+		void ReleaseImage(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, u32 baseMip = 0, u32 levelCount = 1);
+
+		[[nodiscard]] vk::Buffer GetStagingBuffer() const { return m_stagingBuffer; }
+		[[nodiscard]] MemoryAllocator& GetAllocator() const { return m_allocator; }
+		[[nodiscard]] bool IsAsync() const { return m_split; }
+
+		// ends recording and submits, the fence signals when it is done. No-op if nothing was recorded
+		void Submit();
+		// blocks on the fence of the last submit, after this the staging arena is free again
+		void Wait();
+		// Submit + Wait
+		void Flush();
+		// nothing recorded and the last submit (if any) has finished
+		[[nodiscard]] bool IsComplete() const;
+
+		[[nodiscard]] u32 GetSubmitCount() const { return m_submitCount; }
+		[[nodiscard]] vk::DeviceSize GetStagedBytes() const { return m_stagedBytes; }
+
+	private:
+		void Begin();
+		void CreateArena(vk::DeviceSize size);
+		void DestroyArena();
+
+		vk::Device m_device;
+		MemoryAllocator& m_allocator;
+		UploadQueue m_transfer;
+		UploadQueue m_graphics;
+		bool m_split = false;			// transfer and graphics are different queues
+		bool m_ownershipTransfer = false;	// ... of different families
+
+		vk::Buffer m_stagingBuffer = VK_NULL_HANDLE;
+		Allocation m_stagingMemory;
+		vk::DeviceSize m_arenaSize = 0;
+		vk::DeviceSize m_arenaHead = 0;
+
+		vk::CommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+		vk::CommandBuffer m_graphicsCommandBuffer = VK_NULL_HANDLE;		// split only
+		vk::Semaphore m_transferDone = VK_NULL_HANDLE;					// split only
+		vk::Fence m_fence = VK_NULL_HANDLE;
+		bool m_recording = false;
+		bool m_inFlight = false;
+		std::vector<vk::Buffer> m_releasedBuffers;	// release/acquire barriers go out together on submit
+
+		u32 m_submitCount = 0;
+		vk::DeviceSize m_stagedBytes = 0;
+	};
+}
+
+#endif
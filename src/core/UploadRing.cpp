@@ -0,0 +1,50 @@
+#include <pch.h>
+
+#include "UploadRing.h"
+#include "vk_utils.h"
+#include "Log.h"
+
+namespace CV
+{
+	UploadRing::UploadRing(vk::Device device, MemoryAllocator& allocator, u32 frameCount, vk::DeviceSize frameSize)
+		: m_device(device), m_allocator(allocator), m_frameSize(frameSize), m_frameCount(frameCount)
+	{
+		// whatever the frame data ends up being read as
+		const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer |
+			vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+
+		CreateBuffer(m_device, m_allocator, m_frameSize * m_frameCount, usage,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_buffer, m_memory);
+		m_baseAddress = m_device.getBufferAddress(vk::BufferDeviceAddressInfo{ m_buffer });
+
+		printl(Log::LogLevel::Info, "[RING] {} frames x {} KB of transient upload space", m_frameCount, m_frameSize / 1024);
+	}
+
+	UploadRing::~UploadRing()
+	{
+		m_device.destroyBuffer(m_buffer);
+		m_allocator.free(m_memory);
+	}
+
+	void UploadRing::BeginFrame(u32 frameIndex)
+	{
+		m_frameStart = m_frameSize * (frameIndex % m_frameCount);
+		m_head = m_frameStart;
+		m_overflowLogged = false;
+	}
+
+	TransientAllocation UploadRing::Allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+	{
+		const vk::DeviceSize offset = (m_head + alignment - 1) / alignment * alignment;
+		if (offset + size > m_frameStart + m_frameSize)
+		{
+			if (!m_overflowLogged)
+				printl(Log::LogLevel::Error, "[RING] Frame region full ({} KB), {} bytes dropped", m_frameSize / 1024, size);
+			m_overflowLogged = true;
+			return {};
+		}
+
+		m_head = offset + size;
+		return { m_memory.mapped + offset, m_buffer, offset, m_baseAddress + offset };
+	}
+}
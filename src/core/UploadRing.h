@@ -0,0 +1,70 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <cstring>
+#include <vulkan/vulkan.hpp>
+
+#include "StandardTypes.h"
+#include "MemoryAllocator.h"
+
+// transient per frame data (view constants, per draw transforms, culling inputs ...). One persistently mapped, host
+// visible buffer split into a region per frame in flight; allocating is a bump of the region's head and BeginFrame
+// rewinds it, which is only safe once that frame's in flight fence has signalled. Nothing is freed one by one.
+// Everything handed out can be read through its device address or bound as buffer + offset.
+
+namespace CV
+{
+	struct TransientAllocation
+	{
+		u8* data = nullptr;
+		vk::Buffer buffer = VK_NULL_HANDLE;
+		vk::DeviceSize offset = 0;
+		vk::DeviceAddress address = 0;
+
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	class UploadRing
+	{
+	public:
+		UploadRing(vk::Device device, MemoryAllocator& allocator, u32 frameCount, vk::DeviceSize frameSize = 4ull << 20);
+		~UploadRing();
+		UploadRing(const UploadRing&) = delete;
+		UploadRing& operator=(const UploadRing&) = delete;
+
+		// after waiting on the frame's fence, before anything of that frame is allocated
+		void BeginFrame(u32 frameIndex);
+
+		// empty (and logged) if the frame's region is full
+		TransientAllocation Allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+		template<typename T>
+		TransientAllocation Push(const T& value, vk::DeviceSize alignment = alignof(T) < 16 ? 16 : alignof(T))
+		{
+			TransientAllocation allocation = Allocate(sizeof(T), alignment);
+			if (allocation)
+				memcpy(allocation.data, &value, sizeof(T));
+			return allocation;
+		}
+
+		[[nodiscard]] vk::Buffer GetBuffer() const { return m_buffer; }
+		[[nodiscard]] vk::DeviceSize GetFrameSize() const { return m_frameSize; }
+		// bytes handed out in the current frame, for the UI
+		[[nodiscard]] vk::DeviceSize GetFrameUsage() const { return m_head - m_frameStart; }
+
+	private:
+		vk::Device m_device;
+		MemoryAllocator& m_allocator;
+		vk::Buffer m_buffer = VK_NULL_HANDLE;
+		Allocation m_memory;
+		vk::DeviceAddress m_baseAddress = 0;
+		vk::DeviceSize m_frameSize = 0;
+		u32 m_frameCount = 0;
+
+		vk::DeviceSize m_frameStart = 0;
+		vk::DeviceSize m_head = 0;
+		bool m_overflowLogged = false;
+	};
+}
+
+#endif
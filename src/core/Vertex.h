@@ -13,19 +13,88 @@ namespace SM = DirectX::SimpleMath;
 
 namespace  CV
 {
+    // per frame, written to the upload ring once and read through PushConstants::frameConstantsAddress
+    struct FrameConstants
+    {
+        glm::mat4 viewProj;
+        glm::mat3 viewNormalMatrix;     // transpose(inverse(view)), times InstanceData::normalMatrix gives the old per object normal matrix
+        glm::vec3 cameraPosition;       // world space, for the meshlet cone test and LOD distance
+        glm::vec4 frustumPlanes[6];     // world space, not normalised (getFrustumPlanes)
+        float lodScale;                 // pixels one world unit covers at distance 1
+        float lodErrorPixels;           // coarsest LOD whose projected error stays below this
+    };
+
+    // pushed once per frame, mirrored in the shaders. Everything per object comes from the instance table: a raster draw
+    // finds its InstanceData at firstInstance + SV_InstanceID, so nothing is pushed per draw
     struct PushConstants
     {
-        glm::mat4 mvp;
+        vk::DeviceAddress frameConstantsAddress;
         vk::DeviceAddress vertexBufferAddress;
+        vk::DeviceAddress instanceBufferAddress;
+        vk::DeviceAddress materialBufferAddress;
 #if MESH_SHADING
-        VkDeviceAddress meshletBufferAddress;
+        // per draw, mesh tasks have no firstInstance
+        u32 instanceOffset;             // first InstanceData of this draw, the workgroup row is added on top
+        u32 meshletOffset;
+        vk::DeviceAddress meshletBufferAddress;
+        vk::DeviceAddress meshletVertexAddress;
+        vk::DeviceAddress meshletTriangleAddress;
 #endif
-        glm::mat3 normalMatrix;
+    };
+
+    // GPU side MeshInstance, one per drawn instance. Uploaded once with the model, the instances are static
+    struct InstanceData
+    {
+        glm::mat4 world;            // with COMPACT_VERTICES this includes MeshInfo::PositionDecode
+        glm::mat3 normalMatrix;     // transpose(inverse(world)), without the decode
+        u32 materialIndex;          // into the material table
+        u32 padding[2];
+    };
+    static_assert(sizeof(InstanceData) == 112);
+
+    // GPU side Material, bindless texture slots (-1 = none)
+    struct MaterialData
+    {
         u32 albedoIndex;
         u32 normalIndex;
         u32 metallicIndex;
         u32 emissiveIndex;
-        float padding;
+    };
+    static_assert(sizeof(MaterialData) == 16);
+
+    // GPU side draw candidate, one per instance. The culling pass (cull.comp.slang) tests it against the frustum, picks its
+    // LOD and appends a vk::DrawIndexedIndirectCommand to the region of its index buffer
+    struct DrawRecord
+    {
+        glm::vec3 boundsMin;            // world space box
+        u32 instanceIndex;              // into the instance buffer, becomes firstInstance
+        glm::vec3 boundsMax;
+        i32 vertexOffset;
+        glm::vec3 sphereCenter;         // world space, for the LOD distance
+        float sphereRadius;
+        u32 firstIndex[MAX_LODS];       // into the index buffer of the record's region
+        u32 indexCount[MAX_LODS];
+        float lodError[MAX_LODS];       // in world units, i.e. already scaled by the instance
+        u32 lodCount;
+        u32 region;                     // DRAW_REGION_*
+        u32 padding[2];
+    };
+    static_assert(sizeof(DrawRecord) == 112);
+
+    // one indirect draw list (commands + count) per index buffer
+    constexpr u32 DRAW_REGION_INDEX32 = 0;
+    constexpr u32 DRAW_REGION_INDEX16 = 1;     // COMPACT_VERTICES only
+    constexpr u32 DRAW_REGION_COUNT = 2;
+
+    // push constants of the culling pass
+    struct CullConstants
+    {
+        vk::DeviceAddress frameConstantsAddress;
+        vk::DeviceAddress drawRecordAddress;
+        vk::DeviceAddress commandAddress;   // vk::DrawIndexedIndirectCommand per record, a region starts at regionOffset[region]
+        vk::DeviceAddress countAddress;     // one u32 draw count per region
+        u32 recordCount;
+        u32 regionOffset[DRAW_REGION_COUNT];
     };
 
     struct Vertex
@@ -36,13 +105,39 @@ namespace  CV
         glm::vec4 tangent;
     };
 
+    // GPU side vertex when COMPACT_VERTICES is on, decoded in mesh.vert.slang
+    // position is unorm16 inside the mesh bounds (MeshInfo::boundsMin/Max), uv is half float,
+    // normal and tangent are octahedral snorm8 with the tangent handedness kept in the spare position slot
+    struct PackedVertex
+    {
+        u16 pos[3];
+        u16 tangentSign;    // 1 when tangent.w < 0
+        u16 texCoord[2];
+        i8 normal[2];
+        i8 tangent[2];
+    };
+    static_assert(sizeof(PackedVertex) == 16);
+
+    constexpr u32 MESHLET_MAX_VERTICES = 64;
+    constexpr u32 MESHLET_MAX_TRIANGLES = 124;
+    constexpr float MESHLET_CONE_WEIGHT = 0.25f;
+
+    // one meshopt meshlet plus its culling data, mirrored in meshlet.mesh.slang
+    // vertices/triangles live in Model::_meshletVertices (absolute vertex indices) and Model::_meshletTriangles (u8 triples)
     struct Meshlet
     {
-        u32 vertices[64];
-        u8 indices[126];
-        u8 triangleCount;
-        u8 vertexCount;
+        glm::vec3 center;       // object space bounding sphere
+        float radius;
+        glm::vec3 coneApex;     // the whole meshlet faces away from the camera when
+        float coneCutoff;       // dot(normalize(coneApex - camera), coneAxis) >= coneCutoff
+        glm::vec3 coneAxis;
+        u32 vertexOffset;
+        u32 triangleOffset;     // in bytes, always 4 aligned
+        u32 vertexCount;
+        u32 triangleCount;
+        u32 padding;
     };
+    static_assert(sizeof(Meshlet) == 64);
 }
 #endif
 
@@ -5,11 +5,21 @@
 
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 inline u32 MAX_TEXTURES = 256;
+// simplified index ranges per mesh (MeshInfo::lods), mirrored in cull.comp.slang
+constexpr u32 MAX_LODS = 4;
 #define EXTREME 0
 
 // meshInfo shading pipeline
 #define MESH_SHADING 0
 
+// 16 byte PackedVertex + 16 bit indices instead of the 48 byte Vertex, keep in sync with mesh.vert.slang
+#define COMPACT_VERTICES 0
+
+#if MESH_SHADING && COMPACT_VERTICES
+// meshlet culling works on object space bounds, the compact path folds the quantisation box into the mvp
+#error "COMPACT_VERTICES is not supported with MESH_SHADING"
+#endif
+
 // array size
 template <typename T, size_t N>
 constexpr size_t ArraySize(T(&)[N]) { return N; }
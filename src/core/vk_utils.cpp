@@ -113,6 +113,29 @@ namespace CV
             i++;
         }
 
+        // uploads go on their own queue so they can run while the graphics queue renders
+        for (u32 family = 0; family < queueFamilies.size(); family++)
+        {
+            const vk::QueueFlags flags = queueFamilies[family].queueFlags;
+            if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+            {
+                indices._transferFamily = family;
+                break;
+            }
+        }
+        for (u32 family = 0; family < queueFamilies.size() && !indices._transferFamily; family++)
+        {
+            // every graphics or compute family supports transfer, even if it doesn't say so
+            const vk::QueueFlags flags = queueFamilies[family].queueFlags;
+            if (!(flags & vk::QueueFlagBits::eGraphics) && (flags & vk::QueueFlagBits::eCompute))
+                indices._transferFamily = family;
+        }
+        if (!indices._transferFamily && indices._graphicsFamily)
+        {
+            indices._transferFamily = indices._graphicsFamily;
+            indices._transferQueueIndex = queueFamilies[*indices._graphicsFamily].queueCount > 1 ? 1 : 0;
+        }
+
         return indices;
     }
 
@@ -189,7 +212,7 @@ namespace CV
         return std::nullopt;
     }
 
-    void TransitionImage(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout currentLayout, vk::ImageLayout newLayout)
+    void TransitionImage(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout currentLayout, vk::ImageLayout newLayout, u32 baseMip, u32 levelCount)
     {
         vk::ImageAspectFlags aspectMask{ 0 };
 	    vk::PipelineStageFlags2 srcStageMask{};
@@ -224,8 +247,8 @@ namespace CV
 
         vk::ImageSubresourceRange subresourceRange{};
         subresourceRange.aspectMask = aspectMask;
-        subresourceRange.baseMipLevel = 0;
-        subresourceRange.levelCount = 1; // not using mipmaps
+        subresourceRange.baseMipLevel = baseMip;
+        subresourceRange.levelCount = levelCount;
         subresourceRange.baseArrayLayer = 0;
         subresourceRange.layerCount = 1; // For a standard 2D image
 
@@ -258,6 +281,22 @@ namespace CV
             imageBarrier.dstAccessMask = vk::AccessFlagBits2::eShaderRead;             // enable access of shader for read
             imageBarrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;  // after the barrier finishes start the ops (transition here) at the fragment stage in pipeline
         }
+        // mip chain: the level just written becomes the blit source of the next one
+        else if (currentLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eTransferSrcOptimal)
+        {
+            imageBarrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+            imageBarrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+            imageBarrier.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
+            imageBarrier.dstStageMask = vk::PipelineStageFlagBits2::eTransfer;
+        }
+        // mip chain: the source level is done being read by the blit
+        else if (currentLayout == vk::ImageLayout::eTransferSrcOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal)
+        {
+            imageBarrier.srcAccessMask = {};                                             // read -> read, only the layout change needs ordering
+            imageBarrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+            imageBarrier.dstAccessMask = vk::AccessFlagBits2::eShaderRead;
+            imageBarrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+        }
         else if (currentLayout == vk::ImageLayout::eColorAttachmentOptimal && newLayout == vk::ImageLayout::ePresentSrcKHR)
         {
             imageBarrier.srcAccessMask = vk::AccessFlagBits2::eColorAttachmentWrite;
@@ -287,16 +326,10 @@ namespace CV
 
         commandBuffer.pipelineBarrier2(depInfo);
     }
-    // redundant
-    void CreateBuffer(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize size,
+    void CreateBuffer(vk::Device device, MemoryAllocator& allocator, vk::DeviceSize size,
         vk::BufferUsageFlags usage, vk::MemoryPropertyFlags propertyFlags,
-        vk::Buffer& buffer, vk::DeviceMemory& bufferMemory)
+        vk::Buffer& buffer, Allocation& bufferMemory)
     {
-        // what's happening here is simple af. Create a bufferCI with appropriate size , then create a buffer.
-        // Then make memrequirements struct, to store the memrequirements, supplied with the buffer.
-        // Then allocate memory using the memrequirements, and store it in memory.
-        // Then bind the memory, map it to cpu accessible buffer
-
         vk::BufferCreateInfo bufferCI{};
         bufferCI.size = size;
         bufferCI.usage = usage;
@@ -305,43 +338,15 @@ namespace CV
         try
         {
             buffer = device.createBuffer(bufferCI);
-            //printl(Log::LogLevel::Info,"[VULKAN] Vertex Buffer creation Success");
-        }
-        catch (vk::SystemError& err)
-        {
-            printl(Log::LogLevel::Error, "[VULKAN] Vertex Buffer creation Failure: {}", std::string(err.what()));
-            return;
-        }
-
-        vk::MemoryRequirements memRequirements = device.getBufferMemoryRequirements(buffer);
-        auto memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, propertyFlags);
-
-        vk::MemoryAllocateInfo allocInfo{};
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = 0;  // Will be set below
-
-        if (memoryTypeIndex.has_value())
-        {
-            allocInfo.memoryTypeIndex = memoryTypeIndex.value();
-        }
-        else
-        {
-            printl(Log::LogLevel::Error, "[VULKAN] No memory type found");
-            return;
-        }
-
-        try
-        {
-            bufferMemory = device.allocateMemory(allocInfo);
-            //printl(Log::LogLevel::Info, "[VULKAN] Allocation of Vertex Buffer Memory Success");
         }
         catch (vk::SystemError& err)
         {
-            printl(Log::LogLevel::Error, "[VULKAN] Allocation of Vertex Buffer Memory Failed: {}", std::string(err.what()));
+            printl(Log::LogLevel::Error, "[VULKAN] Buffer creation Failure: {}", std::string(err.what()));
             return;
         }
 
-        device.bindBufferMemory(buffer, bufferMemory, 0);
+        // sub-allocated + bound, host visible memory comes back already mapped
+        bufferMemory = allocator.allocateForBuffer(buffer, propertyFlags);
     }
     void CopyBuffer(vk::Device device, vk::CommandPool commandPool, vk::Queue queue, vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
     {
@@ -395,12 +400,40 @@ namespace CV
         device.freeCommandBuffers(commandPool, 1, &commandBuffer);
     }
 
-    void CreateImage(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, vk::DeviceMemory& imageMemory)
+    void CreateImage(vk::Device device, MemoryAllocator& allocator, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, Allocation& imageMemory, u32 mipLevels)
     {
         vk::ImageCreateInfo imageCI{};
         imageCI.sType = vk::StructureType::eImageCreateInfo;
         imageCI.imageType = vk::ImageType::e2D;
-        imageCI.mipLevels = 1;
+        imageCI.mipLevels = mipLevels;
+        imageCI.arrayLayers = 1;
+        imageCI.extent = vk::Extent3D{ width, height, 1 };
+        imageCI.format = format;
+        imageCI.tiling = tiling;
+        imageCI.initialLayout = vk::ImageLayout::eUndefined;
+        imageCI.usage = usage;
+        imageCI.sharingMode = vk::SharingMode::eExclusive;
+        imageCI.samples = vk::SampleCountFlagBits::e1;
+
+        if (device.createImage(&imageCI, nullptr, &image) != vk::Result::eSuccess)
+        {
+            printl(Log::LogLevel::Error,"[VULKAN] Failed to Create Image");
+            return;
+        }
+
+        imageMemory = allocator.allocateForImage(image, properties);
+        if (!imageMemory)
+        {
+            printl(Log::LogLevel::Error,"[TEXTURE] Failed to allocate texture memory");
+        }
+    }
+
+    void CreateImage(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, vk::DeviceMemory& imageMemory, u32 mipLevels)
+    {
+        vk::ImageCreateInfo imageCI{};
+        imageCI.sType = vk::StructureType::eImageCreateInfo;
+        imageCI.imageType = vk::ImageType::e2D;
+        imageCI.mipLevels = mipLevels;
         imageCI.arrayLayers = 1;
         imageCI.extent.width = static_cast<uint32_t>(width);
         imageCI.extent.height = static_cast<uint32_t>(height);
@@ -446,15 +479,15 @@ namespace CV
     }
 
 
-    void CopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Image& image, vk::Buffer& buffer, uint32_t width, uint32_t height)
+    void CopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Image& image, vk::Buffer& buffer, uint32_t width, uint32_t height, u32 mipLevel, vk::DeviceSize bufferOffset)
     {
         vk::BufferImageCopy2 region{};
         region.sType = vk::StructureType::eBufferImageCopy2;
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
         region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.mipLevel = mipLevel;
         region.imageSubresource.baseArrayLayer = 0;
         region.imageSubresource.layerCount = 1;
         region.imageOffset = vk::Offset3D{ 0, 0, 0 };
@@ -471,12 +504,12 @@ namespace CV
         commandBuffer.copyBufferToImage2(&bufferCI);
     }
 
-    vk::ImageView CreateImageView(vk::Device device, vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags)
+    vk::ImageView CreateImageView(vk::Device device, vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags, u32 mipLevels, vk::ComponentMapping components)
     {
         vk::ImageSubresourceRange range{};
         range.aspectMask = aspectFlags;
         range.baseMipLevel = 0;
-        range.levelCount = 1;
+        range.levelCount = mipLevels;
         range.baseArrayLayer = 0;
         range.layerCount = 1;
 
@@ -485,6 +518,7 @@ namespace CV
         imageViewCI.image = image;
         imageViewCI.viewType = vk::ImageViewType::e2D;
         imageViewCI.format = format;
+        imageViewCI.components = components;
         imageViewCI.subresourceRange = range;
 
         vk::ImageView imageView;
@@ -501,6 +535,62 @@ namespace CV
         return imageView;
     }
 
+    u32 MipLevelCount(u32 width, u32 height)
+    {
+        u32 levels = 1;
+        for (u32 size = std::max(width, height); size > 1; size >>= 1)
+            levels++;
+        return levels;
+    }
+
+    bool SupportsLinearBlit(vk::PhysicalDevice physicalDevice, vk::Format format)
+    {
+        constexpr vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+            vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        return (physicalDevice.getFormatProperties(format).optimalTilingFeatures & required) == required;
+    }
+
+    void GenerateMipmaps(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t width, uint32_t height, u32 mipLevels)
+    {
+        i32 mipWidth = static_cast<i32>(width);
+        i32 mipHeight = static_cast<i32>(height);
+
+        for (u32 level = 1; level < mipLevels; level++)
+        {
+            const i32 nextWidth = std::max(mipWidth / 2, 1);
+            const i32 nextHeight = std::max(mipHeight / 2, 1);
+
+            TransitionImage(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, level - 1, 1);
+
+            vk::ImageBlit2 blit{};
+            blit.sType = vk::StructureType::eImageBlit2;
+            blit.srcSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - 1, 0, 1 };
+            blit.srcOffsets[1] = vk::Offset3D{ mipWidth, mipHeight, 1 };
+            blit.dstSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, 0, 1 };
+            blit.dstOffsets[1] = vk::Offset3D{ nextWidth, nextHeight, 1 };
+
+            vk::BlitImageInfo2 blitInfo{};
+            blitInfo.sType = vk::StructureType::eBlitImageInfo2;
+            blitInfo.srcImage = image;
+            blitInfo.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal;
+            blitInfo.dstImage = image;
+            blitInfo.dstImageLayout = vk::ImageLayout::eTransferDstOptimal;
+            blitInfo.regionCount = 1;
+            blitInfo.pRegions = &blit;
+            blitInfo.filter = vk::Filter::eLinear;     // sRGB formats are filtered in linear space
+
+            commandBuffer.blitImage2(&blitInfo);
+
+            TransitionImage(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, level - 1, 1);
+
+            mipWidth = nextWidth;
+            mipHeight = nextHeight;
+        }
+
+        // the last level was only ever written
+        TransitionImage(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, mipLevels - 1, 1);
+    }
+
     vk::Format FindSupportedFormat(vk::PhysicalDevice physicalDevice, const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags flags)
     {
         for (vk::Format format : candidates)
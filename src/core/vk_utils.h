@@ -8,6 +8,7 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.hpp>
 #include "StandardTypes.h"
+#include "MemoryAllocator.h"
 
 namespace CV
 {
@@ -18,7 +19,7 @@ namespace CV
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 		VK_KHR_SHADER_RELAXED_EXTENDED_INSTRUCTION_EXTENSION_NAME,
 #if MESH_SHADING
-		VK_NV_MESH_SHADER_EXTENSION_NAME
+		VK_EXT_MESH_SHADER_EXTENSION_NAME
 #endif
 	};
 
@@ -32,6 +33,10 @@ namespace CV
 	{
 		std::optional<uint32_t> _graphicsFamily;
 		std::optional<uint32_t> _presentFamily;
+		// transfer-only family if the device has one, then any non graphics family that can copy, then the graphics family.
+		// _transferQueueIndex is 1 when a second queue of the graphics family is available, 0 means the graphics queue itself
+		std::optional<uint32_t> _transferFamily;
+		uint32_t _transferQueueIndex = 0;
 
 		bool IsComplete() const {
 			return _graphicsFamily.has_value() && _presentFamily.has_value();
@@ -56,17 +61,25 @@ namespace CV
 	vk::PresentModeKHR ChooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes);
 	vk::Extent2D ChooseSwapExtent(GLFWwindow* window, const vk::SurfaceCapabilitiesKHR& capabilities);
 	std::optional<uint32_t> FindMemoryType(vk::PhysicalDevice physicalDevice, uint32_t typeFilter, vk::MemoryPropertyFlags properties);
-	// Transition image layout for rendering/presenting, etc
-	void TransitionImage(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout currentLayout, vk::ImageLayout newLayout);
-	void CreateBuffer(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags propertyFlags, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory);
+	// Transition image layout for rendering/presenting, etc. Only the mips [baseMip, baseMip + levelCount) are touched
+	void TransitionImage(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout currentLayout, vk::ImageLayout newLayout, u32 baseMip = 0, u32 levelCount = 1);
+	void CreateBuffer(vk::Device device, MemoryAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags propertyFlags, vk::Buffer& buffer, Allocation& bufferMemory);
 	void CopyBuffer(vk::Device device, vk::CommandPool commandPool, vk::Queue queue, vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
 	vk::CommandBuffer BeginSingleTimeCommands(vk::Device device, vk::CommandPool commandPool);
 	void EndSingleTimeCommands(vk::Device device, vk::Queue queue, vk::CommandPool commandPool, vk::CommandBuffer commandBuffer);
 
 	// Image handling
-	void CreateImage(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, vk::DeviceMemory& memory);
-	void CopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Image& image, vk::Buffer& buffer, uint32_t width, uint32_t height);
-	vk::ImageView CreateImageView(vk::Device device, vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags);
+	void CreateImage(vk::Device device, MemoryAllocator& allocator, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, Allocation& memory, u32 mipLevels = 1);
+	// own vkAllocateMemory, for the swapchain sized attachments the renderer creates before any allocator exists
+	void CreateImage(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Image& image, vk::DeviceMemory& memory, u32 mipLevels = 1);
+	void CopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Image& image, vk::Buffer& buffer, uint32_t width, uint32_t height, u32 mipLevel = 0, vk::DeviceSize bufferOffset = 0);
+	vk::ImageView CreateImageView(vk::Device device, vk::Image& image, vk::Format format, vk::ImageAspectFlags aspectFlags, u32 mipLevels = 1, vk::ComponentMapping components = {});
+	// floor(log2(max(width, height))) + 1
+	u32 MipLevelCount(u32 width, u32 height);
+	// true if the format can be downsampled with linear vkCmdBlitImage (optimal tiling)
+	bool SupportsLinearBlit(vk::PhysicalDevice physicalDevice, vk::Format format);
+	// blits mip 0 down the whole chain. Expects every level in TransferDstOptimal, leaves every level in ShaderReadOnlyOptimal
+	void GenerateMipmaps(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t width, uint32_t height, u32 mipLevels);
 
 	// Depth and stencil image ops
 	vk::Format FindSupportedFormat(vk::PhysicalDevice physicalDevice, const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags flags);
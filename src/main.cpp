@@ -1,11 +1,19 @@
 #include <pch.h>
 #define GLM_ENABLE_EXPERIMENTAL
 
+#include <algorithm>
+
 #include "common.h"
 #include "renderer.h"
 #include "Camera.h"
 #include "ImguiRenderer.h"
 #include "Model.h"
+#include "ParallelRecorder.h"
+#include "RenderQueue.h"
+#include "DeletionQueue.h"
+#include "FrameContext.h"
+#include "GpuCulling.h"
+#include "GpuTimer.h"
 #include "Vertex.h"
 #include "vk_utils.h"
 
@@ -24,8 +32,8 @@ namespace
 
 	struct CameraPlex
 	{
-		mat4 mvp;
-		mat3 normalMatrix;
+		mat4 viewProj;
+		mat3 viewNormalMatrix;
 	};
 
 	struct MouseState {
@@ -41,6 +49,43 @@ namespace
 
 	bool _showDemoWindow = true;
 
+	// LOD switches once the simplification error would cover less than this many pixels on screen
+	float _lodErrorPixels = 1.0f;
+
+	// raster path: frustum culling and LOD selection in cull.comp.slang, drawn with one indirect call per index buffer.
+	// Off = CullBoxes on the CPU and a draw per run of instances
+	bool _gpuCulling = true;
+
+	// CPU path: record in sort key order (RenderQueue.h) instead of mesh order
+	bool _sortDraws = true;
+
+	// sort key pipeline field, there is only the one raster pipeline so far
+	constexpr u32 kMeshRasterPipelineId = 0;
+
+	// what the CPU path recorded last frame, next to the GPU time to compare draw orders
+	struct DrawStats
+	{
+		u32 draws = 0;
+		u32 indexBufferBinds = 0;
+		u32 materialChanges = 0;
+	} _drawStats;
+
+	// consecutive instances of one mesh and LOD, one instanced draw
+	struct DrawRun
+	{
+		u32 mesh;
+		u32 lod;
+		u32 firstInstance;
+		u32 instanceCount;
+		// of the nearest instance, what the run is sorted by
+		float distance;
+	};
+
+	// CPU path: split the draws across secondary command buffers recorded on all cores
+	bool _parallelRecording = true;
+	// below this many runs per chunk the secondaries cost more than they save
+	constexpr size_t kMinRunsPerChunk = 128;
+
 	vec4 _clearColor = { 0.45f, 0.55f, 0.60f, 1.00f };
 }
 
@@ -61,7 +106,9 @@ int main()
 
 	// setup resource creation objects/pointers
 	const std::shared_ptr<CV::Renderer> renderer = std::make_shared<CV::Renderer>();
-	CV::ResourceManager* _resourceManager = new CV::ResourceManager(renderer);
+	// declared before everything that uses it, so it is destroyed last: its destructor flushes the deletion queue and
+	// releases the pooled buffers and textures once the model and frame contexts have queued theirs
+	const std::unique_ptr<CV::ResourceManager> _resourceManager = std::make_unique<CV::ResourceManager>(renderer);
 	CV::PipelineManager* _pipelineManager = _resourceManager->getPipelineManager();
 	renderer->InitVulkan();
 
@@ -72,12 +119,8 @@ int main()
 	else printl(Log::LogLevel::Info, "[VULKAN] GLFW window surface");
 	vk::SurfaceKHR _surface = vk::SurfaceKHR{ ret };
 
-	// globally valid handles
-	std::vector<vk::CommandBuffer> _cmdBuffers{ VK_NULL_HANDLE };
-	// sync primitives
-	std::vector<vk::Semaphore> _imageAvailableSemaphore{ VK_NULL_HANDLE };
+	// sync primitives, per swapchain image. Everything per frame in flight lives in its FrameContext
 	std::vector<vk::Semaphore> _renderFinishedSemaphore{ VK_NULL_HANDLE };
-	std::vector<vk::Fence> _inFlightFence{ VK_NULL_HANDLE };
 	int _currentFrame{0};
 
 	// post surface stuff
@@ -86,6 +129,8 @@ int main()
 	renderer->CreateSwapChain(_surface, _window);
 	renderer->CreateDepthResources();
 	renderer->CreateCommandPool(_surface);
+	// driver pipeline cache and the list of pipelines the last run built, both saved again at shutdown
+	_pipelineManager->LoadPipelineCache("pipeline_cache.bin", "pipelines.manifest");
 
 	// glfw callback stuff
 	glfwSetInputMode(_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -132,29 +177,27 @@ int main()
 		});
 	// set resources
 	Model mod1;
-	//mod1.LoadModel(renderer,"../../../../assets/models/suzanne/Suzanne.gltf");
-	//mod1.LoadModel(renderer,"../../../../assets/models/flighthelmet/FlightHelmet.gltf");
-	mod1.LoadModel(renderer, "../../../../assets/models/sponza2/sponza2.gltf");
-	//mod1.LoadModel(renderer, "../../../../assets/models/bistro2/bistro2.gltf");
-	//mod1.LoadModel(renderer,"../../../../assets/models/Cube/cube.gltf");
-
+	mod1.SetImportThreadCount(0);	// 0 = all hardware threads, 1 = serial import
+	//mod1.LoadModel(renderer, *_resourceManager, "../../../../assets/models/suzanne/Suzanne.gltf");
+	//mod1.LoadModel(renderer, *_resourceManager, "../../../../assets/models/flighthelmet/FlightHelmet.gltf");
+	mod1.LoadModel(renderer, *_resourceManager, "../../../../assets/models/sponza2/sponza2.gltf");
+	//mod1.LoadModel(renderer, *_resourceManager, "../../../../assets/models/bistro2/bistro2.gltf");
+	//mod1.LoadModel(renderer, *_resourceManager, "../../../../assets/models/Cube/cube.gltf");
+
+	// bda + pvp, the addresses are kept in the buffer pool
+	vk::DeviceAddress vertexBDA = _resourceManager->getBufferAddress(mod1._vertexBuffer);
+	vk::DeviceAddress instanceBDA = _resourceManager->getBufferAddress(mod1._instanceBuffer);
+	vk::DeviceAddress materialBDA = mod1._materialBuffer ? _resourceManager->getBufferAddress(mod1._materialBuffer) : 0;
 #if MESH_SHADING
-// bda + pvp for meshlet buffer address
-	vk::DeviceAddress meshBDA;
-	vk::BufferDeviceAddressInfo meshletBufferAddressInfo{};
-	meshletBufferAddressInfo.buffer = mod1._meshletBuffer;
-	meshBDA = renderer->_device.getBufferAddress(&meshletBufferAddressInfo);
-#else
-		// bda + pvp get vertex buffer address
-	vk::BufferDeviceAddressInfo vertexBufferAddressInfo{};
-	vertexBufferAddressInfo.buffer = mod1._vertexBuffer;
-	vk::DeviceAddress vertexBDA = renderer->_device.getBufferAddress(&vertexBufferAddressInfo);
+	vk::DeviceAddress meshletBDA = _resourceManager->getBufferAddress(mod1._meshletBuffer);
+	vk::DeviceAddress meshletVertexBDA = _resourceManager->getBufferAddress(mod1._meshletVertexBuffer);
+	vk::DeviceAddress meshletTriangleBDA = _resourceManager->getBufferAddress(mod1._meshletTriangleBuffer);
 #endif
 
 	std::vector<vk::DescriptorPoolSize> poolSizes;
 
 
-	MAX_TEXTURES = static_cast<uint32_t>(mod1.modelTextures.size()) * MAX_FRAMES_IN_FLIGHT * 2;	// kept it as large as possible cuz lazy
+	MAX_TEXTURES = _resourceManager->getTextureSlotCount() * MAX_FRAMES_IN_FLIGHT * 2;	// kept it as large as possible cuz lazy
 
 	poolSizes.push_back({vk::DescriptorType::eCombinedImageSampler, MAX_FRAMES_IN_FLIGHT * MAX_TEXTURES});
 
@@ -162,22 +205,27 @@ int main()
 	std::vector<vk::DescriptorSetLayout> descLayout;
 	descLayout.resize(1);
 	descLayout[0] = _resourceManager->getDescriptorSetLayout("textures");
+	// the texture layout is sized by the model, so the last run's pipelines only start compiling now. They run on workers
+	// while the frames, culling and gui are set up, each build() below just picks its pipeline up
+	_pipelineManager->WarmUp();
 
-	std::array<std::vector<vk::DescriptorSet>, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+	// command pools, sync objects, texture set and transient upload space of every frame in flight. A frame's texture set
+	// is only rewritten once its fence says the GPU is done with it
+	std::array<std::unique_ptr<CV::FrameContext>, MAX_FRAMES_IN_FLIGHT> _frames;
+	// the recording threads, each frame gets a secondary command pool per thread
+	CV::ParallelRecorder recorder;
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		descriptorSets[i].resize(1);
-		descriptorSets[i][0] = _resourceManager->CreateDescriptorSet(descLayout[0]);
-		// texture descriptor
-		vk::Buffer buffer{};
-		descriptorSets[i][0] = _resourceManager->UpdateDescriptorSet(
-			descriptorSets[i][0], 0, vk::DescriptorType::eCombinedImageSampler, buffer, static_cast<uint64_t>(0),
-			mod1.modelTextures);
+		_frames[i] = std::make_unique<CV::FrameContext>(renderer->_device, renderer->_queueFamily, _resourceManager->getAllocator(), i,
+		                                                recorder.GetMaxChunkCount());
+		_frames[i]->SetTextureSet(_resourceManager->CreateDescriptorSet(descLayout[0]));
+		// texture descriptor. Textures stream in after the load, every slot points at the fallback until its texture is resident
+		_resourceManager->WriteTextureDescriptors(_frames[i]->GetTextureSet(), 0);
 	}
 	// manage pipelines
 #if MESH_SHADING
-	CV::PipelineManager::Builder(pipelineManager)
+	CV::PipelineManager::Builder(_pipelineManager)
 		.setMeshShader("shaders/meshlet.mesh.spv")
 		.setFragmentShader("shaders/mesh.frag.spv")
 		.addDescriptorSetLayout("textures")
@@ -186,6 +234,7 @@ int main()
 		.setDepthTest(true)
 		.setBlendMode(false)
 		.build("meshlet_raster");
+	const u64 rasterPipelineId = _pipelineManager->getPipelineId("meshlet_raster");
 #else
 	// raster graphics pipeline
 	CV::PipelineManager::Builder(_pipelineManager)
@@ -197,35 +246,72 @@ int main()
 		.setDepthTest(true)
 		.setBlendMode(false)
 		.build("mesh_raster");
+	const u64 rasterPipelineId = _pipelineManager->getPipelineId("mesh_raster");
+
+	CV::GpuCulling gpuCulling(*_resourceManager, mod1._drawRegionOffset, mod1._drawRegionCount);
+	const vk::DeviceAddress drawRecordBDA = mod1._drawRecordBuffer ? _resourceManager->getBufferAddress(mod1._drawRecordBuffer) : 0;
 #endif
-	// cmd buffer and sync objects
-	renderer->CreateCommandBuffer(_cmdBuffers, 2);
-	renderer->CreateSynObjects(_imageAvailableSemaphore, _renderFinishedSemaphore, _inFlightFence);
+	// the names and layout keys are hashed once here, the frame only probes the tables
+	const u64 texturesLayoutKey = CV::PipelineManager::makePipelineLayoutKey({ "textures" });
+	// sync objects
+	renderer->CreateSynObjects(_renderFinishedSemaphore);
 
 	//imgui init
 	CV::ImguiRenderer gui = {};
 	gui.InitImgui(renderer, _window);
+	_pipelineManager->FinishWarmUp();
 
-	auto _cameraUpdate = [&](const MeshInfo& meshInfo) -> CameraPlex
+	// per frame camera constants, the per object part comes from the instance buffer
+	auto _cameraUpdate = [&]() -> CameraPlex
 	{
 		mat4 viewMatrix = positioner.getViewMatrix();
 		mat4 projectionMatrix = camera.getProjMatrix();
-		mat4 worldMatrix = meshInfo.transform.Matrix;
-		mat4 modelView = viewMatrix * worldMatrix;
-		//mat4 worldViewProjMatrix = worldMatrix * viewMatrix * projectionMatrix;
-		mat4 worldViewProjMatrix = projectionMatrix * viewMatrix * worldMatrix;
 
 		CameraPlex camMat;
-		camMat.mvp = worldViewProjMatrix;
-		camMat.normalMatrix = glm::transpose(glm::inverse(modelView));
+		camMat.viewProj = projectionMatrix * viewMatrix;
+		// transpose(inverse(view * world)) = viewNormalMatrix * the instance's transpose(inverse(world))
+		camMat.viewNormalMatrix = glm::transpose(glm::inverse(mat3(viewMatrix)));
 		return camMat;
 	};
 
+	// per instance, filled by the culling pass at the start of every recording
+	std::vector<u8> _instanceVisible(mod1._instanceBounds.GetPaddedCount());
+	u32 _visibleInstances = 0;
+	CV::RenderQueue _renderQueue;
+	std::vector<DrawRun> _drawRuns;
+	std::vector<DrawRun> _meshOrderRuns;
+
+	CV::GpuTimer gpuTimer(renderer->_device, renderer->_physicalDevice, renderer->_queueFamily, MAX_FRAMES_IN_FLIGHT);
+
+	// picks the coarsest LOD whose error, projected at the distance of the bounding sphere, stays under _lodErrorPixels
+	auto _selectLod = [&](const MeshInfo& meshInfo, u32 instance, const vec3& cameraPos) -> u32
+	{
+		const CV::CullBounds& bounds = mod1._instanceBounds;
+		const vec3 center = bounds.GetCenter(instance);
+		const float maxScale = bounds.scale[instance];
+		const float radius = bounds.radius[instance];
+
+		// distance to the sphere surface, the camera being inside means full detail
+		const float distance = glm::length(center - cameraPos) - radius;
+		if (distance <= 0.0f)
+			return 0;
+
+		// proj[1][1] = cot(fov/2), so this is how many pixels one world unit covers at that distance
+		const float pixelsPerUnit = glm::abs(camera.getProjMatrix()[1][1]) * 0.5f * static_cast<float>(renderer->_swapChainExtent.height) / distance;
+
+		for (u32 lod = meshInfo.lodCount - 1; lod > 0; lod--)
+		{
+			if (meshInfo.lods[lod].error * maxScale * pixelsPerUnit <= _lodErrorPixels)
+				return lod;
+		}
+		return 0;
+	};
+
 	// lambda for record command buffer
 	auto _recordCommandBuffer = [&](vk::CommandBuffer commandBuffer, uint32_t imageIndex)
 		{
 			CV::PipelineManager* pipelineManager = _resourceManager->getPipelineManager();
-			vk::PipelineLayout pipelineLayout = pipelineManager->getPipelineLayout("textures;");
+			vk::PipelineLayout pipelineLayout = pipelineManager->getPipelineLayout(texturesLayoutKey);
 
 			vk::CommandBufferBeginInfo beginInfo{};
 			beginInfo.flags = {};
@@ -236,6 +322,7 @@ int main()
 			// -> do the remaining stuff like transition -> end command buffer
 
 			VK_ASSERT((commandBuffer.begin(&beginInfo)));
+			gpuTimer.Begin(commandBuffer, _currentFrame);
 			// transition color image from undefined to optimal for rendering
 			CV::TransitionImage(commandBuffer, renderer->_swapChainImages[imageIndex], vk::ImageLayout::eUndefined,
 			                    vk::ImageLayout::eColorAttachmentOptimal);
@@ -275,69 +362,235 @@ int main()
 			renderingInfo.colorAttachmentCount = 1;
 			renderingInfo.pColorAttachments = &colorAttachmentInfo;
 			renderingInfo.pDepthAttachment = &depthAttachmentInfo;
-#if MESH_SHADING
-			auto meshPipeline = pipelineManager->getPipeline("meshlet_raster");
-			commandBuffer.beginRendering(&renderingInfo);
-			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, meshPipeline);
-#else
-			auto graphicsPipeline = pipelineManager->getPipeline("mesh_raster");
 
-			commandBuffer.beginRendering(&renderingInfo);
-			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
-
-			vk::Buffer vertexBuffers[] = { mod1._vertexBuffer };
-			vk::DeviceSize offsets[] = { 0 };
-			commandBuffer.bindVertexBuffers(0u, 1u, vertexBuffers, offsets);
-			commandBuffer.bindIndexBuffer(mod1._indexBuffer, 0u, vk::IndexType::eUint32);
+			auto [viewProj, viewNormalMatrix] = _cameraUpdate();
+			const vec3 cameraPos = positioner.getPosition();
+			vec4 frustumPlanes[6];
+			getFrustumPlanes(viewProj, frustumPlanes);
+
+			CV::FrameConstants frameConstants{};
+			frameConstants.viewProj = viewProj;
+			frameConstants.viewNormalMatrix = viewNormalMatrix;
+			frameConstants.cameraPosition = cameraPos;
+			std::copy(std::begin(frustumPlanes), std::end(frustumPlanes), frameConstants.frustumPlanes);
+			// proj[1][1] = cot(fov/2), as in _selectLod
+			frameConstants.lodScale = glm::abs(camera.getProjMatrix()[1][1]) * 0.5f * static_cast<float>(renderer->_swapChainExtent.height);
+			frameConstants.lodErrorPixels = _lodErrorPixels;
+			const vk::DeviceAddress frameConstantsBDA = _frames[_currentFrame]->GetUploadRing().Push(frameConstants).address;
+
+#if !MESH_SHADING
+			// writes this frame's indirect draws, a dispatch can't go inside the rendering scope
+			if (_gpuCulling)
+				gpuCulling.Dispatch(commandBuffer, frameConstantsBDA, drawRecordBDA);
 #endif
 
-			vk::Viewport viewport{};
-			viewport.x = 0.0f;
-			viewport.y = 0.0f;
-			viewport.width = static_cast<float>(renderer->_swapChainExtent.width);
-			viewport.height = static_cast<float>(renderer->_swapChainExtent.height);
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
-			commandBuffer.setViewport(0u, 1u, &viewport);
-
-			vk::Rect2D scissor{};
-			scissor.offset = vk::Offset2D{ 0, 0 };
-			scissor.extent = renderer->_swapChainExtent;
-			commandBuffer.setScissor(0u, 1u, &scissor);
-
-			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0u, 1u,
-			                                 descriptorSets[_currentFrame].data(), 0u, nullptr);
+			// CPU frustum culling, only visible instances are recorded. The GPU culled path doesn't need it
+			if (MESH_SHADING || !_gpuCulling)
+				_visibleInstances = CV::CullBoxes(mod1._instanceBounds, frustumPlanes, _instanceVisible.data());
 
 			CV::PushConstants pushConstants{};
-
+			pushConstants.frameConstantsAddress = frameConstantsBDA;
 			pushConstants.vertexBufferAddress = vertexBDA;
+			pushConstants.instanceBufferAddress = instanceBDA;
+			pushConstants.materialBufferAddress = materialBDA;
 #if MESH_SHADING
-			pushConstants.meshletBufferAddress = m_meshletBufferAddress;
+			pushConstants.meshletBufferAddress = meshletBDA;
+			pushConstants.meshletVertexAddress = meshletVertexBDA;
+			pushConstants.meshletTriangleAddress = meshletTriangleBDA;
+			const vk::Pipeline pipeline = pipelineManager->getPipeline(rasterPipelineId);
+#else
+			const vk::Pipeline pipeline = pipelineManager->getPipeline(rasterPipelineId);
+			constexpr vk::ShaderStageFlags pushStages = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
 #endif
 
-			for (const auto& meshInfo : mod1._meshes) {
-				const auto& material = mod1._materials[meshInfo.materialIndex];
+			// everything the draws need bound. Secondaries inherit none of it, so this runs once per command buffer
+			auto bindDrawState = [&](vk::CommandBuffer cmd)
+			{
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+#if !MESH_SHADING
+				vk::Buffer vertexBuffers[] = { _resourceManager->getBuffer(mod1._vertexBuffer) };
+				vk::DeviceSize offsets[] = { 0 };
+				cmd.bindVertexBuffers(0u, 1u, vertexBuffers, offsets);
+#endif
 
-				auto [mvp, normalMatrix] = _cameraUpdate(meshInfo);
+				vk::Viewport viewport{};
+				viewport.x = 0.0f;
+				viewport.y = 0.0f;
+				viewport.width = static_cast<float>(renderer->_swapChainExtent.width);
+				viewport.height = static_cast<float>(renderer->_swapChainExtent.height);
+				viewport.minDepth = 0.0f;
+				viewport.maxDepth = 1.0f;
+				cmd.setViewport(0u, 1u, &viewport);
+
+				vk::Rect2D scissor{};
+				scissor.offset = vk::Offset2D{ 0, 0 };
+				scissor.extent = renderer->_swapChainExtent;
+				cmd.setScissor(0u, 1u, &scissor);
+
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0u, 1u,
+				                       &_frames[_currentFrame]->GetTextureSet(), 0u, nullptr);
+#if !MESH_SHADING
+				// once per command buffer, the draws only differ in their instance range (firstInstance)
+				cmd.pushConstants(pipelineLayout, pushStages, 0, sizeof(CV::PushConstants), &pushConstants);
+#endif
+			};
 
-				pushConstants.mvp = mvp;
-				pushConstants.normalMatrix = normalMatrix;
-				pushConstants.albedoIndex = material.albedoIndex;
-				pushConstants.normalIndex = material.normalIndex;
-				pushConstants.emissiveIndex = material.emmisiveIndex;
 #if MESH_SHADING
-				commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eMeshNV | vk::ShaderStageFlagBits::eFragment,
-					0, sizeof(PushConstants), &pushConstants);
-				//vkCmdDrawMeshTasksEXT(commandBuffer, 32, 1, 1);
-				commandBuffer.drawMeshTasksNV(models[0].m_meshlets.size(), 0);
-#else
-				commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+			commandBuffer.beginRendering(&renderingInfo);
+			bindDrawState(commandBuffer);
+
+			for (const auto& meshInfo : mod1._meshes) {
+				// a row of workgroups per instance in the mesh's range, so only meshes without any visible instance are skipped
+				const auto firstInstance = _instanceVisible.begin() + meshInfo.instanceOffset;
+				if (std::find(firstInstance, firstInstance + meshInfo.instanceCount, u8(1)) == firstInstance + meshInfo.instanceCount)
+					continue;
+
+				// meshlets only exist for LOD 0, culling happens per meshlet in the mesh shader instead.
+				// one row of workgroups per instance
+				pushConstants.instanceOffset = meshInfo.instanceOffset;
+				pushConstants.meshletOffset = meshInfo.meshletOffset;
+				commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eMeshEXT | vk::ShaderStageFlagBits::eFragment,
 					0, sizeof(CV::PushConstants), &pushConstants);
+				commandBuffer.drawMeshTasksEXT(meshInfo.meshletCount, meshInfo.instanceCount, 1u);
+			}
+#else
+			// CPU path: the draw list is built before rendering begins, whether it is recorded inline or split across
+			// secondaries decides how the rendering scope is begun
+			u32 chunkCount = 0;
+			if (!_gpuCulling)
+			{
+				// consecutive visible instances of one mesh that picked the same LOD go out as one instanced draw. The runs
+				// are built in mesh order first, sorting single instances would interleave them by distance and split the runs
+				_meshOrderRuns.clear();
+				for (u32 meshIndex = 0; meshIndex < mod1._meshes.size(); meshIndex++)
+				{
+					const MeshInfo& meshInfo = mod1._meshes[meshIndex];
+					for (u32 instance = meshInfo.instanceOffset; instance < meshInfo.instanceOffset + meshInfo.instanceCount; instance++)
+					{
+						if (!_instanceVisible[instance])
+							continue;
+						const u32 lodIndex = _selectLod(meshInfo, instance, cameraPos);
+						const float distance = glm::length(mod1._instanceBounds.GetCenter(instance) - cameraPos);
+						if (!_meshOrderRuns.empty())
+						{
+							DrawRun& run = _meshOrderRuns.back();
+							if (run.mesh == meshIndex && run.lod == lodIndex && run.firstInstance + run.instanceCount == instance)
+							{
+								run.instanceCount++;
+								run.distance = std::min(run.distance, distance);
+								continue;
+							}
+						}
+						_meshOrderRuns.push_back({ meshIndex, lodIndex, instance, 1, distance });
+					}
+				}
+
+				// the runs go through the render queue, sorted by state and distance or left in mesh order
+				_renderQueue.Clear();
+				for (u32 runIndex = 0; runIndex < _meshOrderRuns.size(); runIndex++)
+				{
+					const DrawRun& run = _meshOrderRuns[runIndex];
+					const u32 indexRegion = mod1._meshes[run.mesh].shortIndices ? CV::DRAW_REGION_INDEX16 : CV::DRAW_REGION_INDEX32;
+					_renderQueue.Push(CV::MakeSortKey(kMeshRasterPipelineId, indexRegion, mod1._instances[run.firstInstance].materialIndex,
+					                                  run.distance, false, run.mesh), runIndex);
+				}
+				if (_sortDraws)
+					_renderQueue.Sort();
+
+				_drawRuns.clear();
+				for (u32 runIndex : _renderQueue.GetPayloads())
+					_drawRuns.push_back(_meshOrderRuns[runIndex]);
+
+				if (_parallelRecording)
+					chunkCount = std::min(recorder.GetMaxChunkCount(), static_cast<u32>((_drawRuns.size() + kMinRunsPerChunk - 1) / kMinRunsPerChunk));
+				if (chunkCount < 2)
+					chunkCount = 0;
+			}
 
-				commandBuffer.drawIndexed(meshInfo.indexCount, 1u, meshInfo.startIndex,
-				                          static_cast<int32_t>(meshInfo.startVertex), 0u);
-#endif
+			// with COMPACT_VERTICES small meshes sit in the 16 bit index buffer, rebind only when that changes
+			auto recordRuns = [&](vk::CommandBuffer cmd, std::span<const DrawRun> runs, DrawStats& stats)
+			{
+				CV::BufferHandle boundIndexBuffer{};
+				u32 lastMaterial = ~0u;
+				for (const DrawRun& run : runs)
+				{
+					const MeshInfo& meshInfo = mod1._meshes[run.mesh];
+					const CV::BufferHandle indexBuffer = meshInfo.shortIndices ? mod1._indexBuffer16 : mod1._indexBuffer;
+					if (indexBuffer != boundIndexBuffer)
+					{
+						cmd.bindIndexBuffer(_resourceManager->getBuffer(indexBuffer), 0u, meshInfo.shortIndices ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+						boundIndexBuffer = indexBuffer;
+						stats.indexBufferBinds++;
+					}
+					const u32 material = mod1._instances[run.firstInstance].materialIndex;
+					stats.materialChanges += material != lastMaterial ? 1 : 0;
+					lastMaterial = material;
+
+					const MeshLod& lod = meshInfo.lods[run.lod];
+					cmd.drawIndexed(lod.indexCount, run.instanceCount, lod.startIndex - meshInfo.startIndex + meshInfo.gpuIndexBase,
+					                static_cast<int32_t>(meshInfo.startVertex), run.firstInstance);
+					stats.draws++;
+				}
+			};
+
+			if (chunkCount > 0)
+				renderingInfo.flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+			commandBuffer.beginRendering(&renderingInfo);
+
+			if (chunkCount > 0)
+			{
+				// contiguous slices of the sorted runs, so the order on the GPU stays the sorted one
+				vk::CommandBufferInheritanceRenderingInfo inheritanceInfo{};
+				inheritanceInfo.colorAttachmentCount = 1;
+				inheritanceInfo.pColorAttachmentFormats = &renderer->_swapChainImageFormat;
+				inheritanceInfo.depthAttachmentFormat = renderer->_depthImageFormat;
+				inheritanceInfo.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+				const size_t runsPerChunk = (_drawRuns.size() + chunkCount - 1) / chunkCount;
+				std::vector<DrawStats> chunkStats(chunkCount);
+				const std::span<const vk::CommandBuffer> secondaries = recorder.Record(_frames[_currentFrame]->GetSecondaryCommandBuffers(), chunkCount, inheritanceInfo,
+					[&](u32 chunk, vk::CommandBuffer cmd)
+					{
+						const size_t first = std::min(chunk * runsPerChunk, _drawRuns.size());
+						const size_t last = std::min(first + runsPerChunk, _drawRuns.size());
+						bindDrawState(cmd);
+						recordRuns(cmd, std::span<const DrawRun>(_drawRuns).subspan(first, last - first), chunkStats[chunk]);
+					});
+				commandBuffer.executeCommands(static_cast<u32>(secondaries.size()), secondaries.data());
+
+				_drawStats = {};
+				for (const DrawStats& stats : chunkStats)
+				{
+					_drawStats.draws += stats.draws;
+					_drawStats.indexBufferBinds += stats.indexBufferBinds;
+					_drawStats.materialChanges += stats.materialChanges;
+				}
 			}
+			else
+			{
+				bindDrawState(commandBuffer);
+
+				if (_gpuCulling)
+				{
+					// one indirect draw per index buffer, each command carries its instance as firstInstance
+					for (u32 region = 0; region < CV::DRAW_REGION_COUNT; region++)
+					{
+						if (mod1._drawRegionCount[region] == 0)
+							continue;
+
+						const bool shortIndices = region == CV::DRAW_REGION_INDEX16;
+						commandBuffer.bindIndexBuffer(_resourceManager->getBuffer(shortIndices ? mod1._indexBuffer16 : mod1._indexBuffer), 0u,
+						                              shortIndices ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+						gpuCulling.Draw(commandBuffer, region);
+					}
+				}
+				else
+				{
+					_drawStats = {};
+					recordRuns(commandBuffer, _drawRuns, _drawStats);
+				}
+			}
+#endif
 
 			vkCmdEndRendering(commandBuffer);
 			// transition color image to present mode. No need for depth image, it is used directly for depth purposes,
@@ -345,6 +598,7 @@ int main()
 			CV::TransitionImage(commandBuffer, renderer->_swapChainImages[imageIndex],
 			                    vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR);
 
+			gpuTimer.End(commandBuffer, _currentFrame);
 			commandBuffer.end();
 		};
 
@@ -378,6 +632,25 @@ int main()
 			ImGui::Checkbox("Demo Window", &_showDemoWindow);      // Edit bools storing our window open/close state
 
 			ImGui::SliderFloat("float", &f, 0.0f, 1.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
+			ImGui::SliderFloat("LOD error (px)", &_lodErrorPixels, 0.0f, 16.0f);
+#if !MESH_SHADING
+			ImGui::Checkbox("GPU culling", &_gpuCulling);
+#endif
+			if (MESH_SHADING || !_gpuCulling)
+				ImGui::Text("Instances: %u visible, %u culled", _visibleInstances, mod1._instanceBounds.count - _visibleInstances);
+			ImGui::Text("GPU time: %.3f ms", gpuTimer.GetMilliseconds());
+			const CV::PipelineManager::CompileStats compileStats = _pipelineManager->getCompileStats();
+			ImGui::Text("Pipelines: %u compiling, %u compiled in the background, %u failed", compileStats.pending, compileStats.compiled,
+			            compileStats.failed);
+#if !MESH_SHADING
+			if (!_gpuCulling)
+			{
+				ImGui::Checkbox("Sort draws", &_sortDraws);
+				ImGui::Checkbox("Parallel recording", &_parallelRecording);
+				ImGui::Text("Draws: %u, index buffer binds: %u, material changes: %u", _drawStats.draws, _drawStats.indexBufferBinds,
+				            _drawStats.materialChanges);
+			}
+#endif
 			ImGui::ColorEdit3("clear color", reinterpret_cast<float*>(&_clearColor)); // Edit 3 floats representing a color
 
 			if (ImGui::Button("Button"))                            // Buttons return true when clicked (most widgets return true when edited/activated)
@@ -389,20 +662,33 @@ int main()
 			ImGui::End();
 		}
 
-		VK_ASSERT(renderer->_device.waitForFences(1u, &_inFlightFence[_currentFrame], VK_TRUE, UINT64_MAX));
-		VK_ASSERT(renderer->_device.resetFences(1u, &_inFlightFence[_currentFrame]));
+		// waits on the frame's fence and resets its command pools and upload ring in one go
+		CV::FrameContext& frame = *_frames[_currentFrame];
+		frame.Begin();
+		gpuTimer.Resolve(_currentFrame);
+		renderer->_deletionQueue->BeginFrame();
+
+		// texture streaming: the transfer queue keeps uploading while we render
+		if (mod1.UpdateStreaming())
+		{
+			for (const auto& frameContext : _frames)
+				frameContext->MarkTextureSetDirty();
+		}
+		if (frame.ConsumeTextureSetDirty())
+			_resourceManager->WriteTextureDescriptors(frame.GetTextureSet(), 0);
+		// background pipeline compiles that finished, draws switch over from their fallback from this frame on
+		_pipelineManager->Update();
 
 		uint32_t imageIndex{};
 		VK_ASSERT(
-			renderer->_device.acquireNextImageKHR(renderer->_swapChain, UINT64_MAX, _imageAvailableSemaphore[
-				_currentFrame], VK_NULL_HANDLE, &imageIndex));
-
-		_cmdBuffers[_currentFrame].reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+			renderer->_device.acquireNextImageKHR(renderer->_swapChain, UINT64_MAX, frame.GetImageAvailableSemaphore(),
+				VK_NULL_HANDLE, &imageIndex));
 
-		_recordCommandBuffer(_cmdBuffers[_currentFrame], imageIndex);
+		const vk::CommandBuffer commandBuffer = frame.GetCommandBuffer();
+		_recordCommandBuffer(commandBuffer, imageIndex);
 
 		vk::SubmitInfo submitInfo{};
-		vk::Semaphore waitSemaphores[] = { _imageAvailableSemaphore[_currentFrame] };
+		vk::Semaphore waitSemaphores[] = { frame.GetImageAvailableSemaphore() };
 		vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
 		// after the fragment stage cuz the actual shading occurs after.
 		// fragment stage only computes the color, doesn't actually render to the frame
@@ -411,13 +697,13 @@ int main()
 		submitInfo.pWaitDstStageMask = waitStages;
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &_cmdBuffers[_currentFrame];
+		submitInfo.pCommandBuffers = &commandBuffer;
 
 		vk::Semaphore signalSemaphore[] = { _renderFinishedSemaphore[imageIndex] };
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphore;
 
-		VK_ASSERT(renderer->_graphicsQueue.submit(1, &submitInfo, _inFlightFence[_currentFrame]));
+		VK_ASSERT(renderer->_graphicsQueue.submit(1, &submitInfo, frame.GetFence()));
 
 		vk::PresentInfoKHR presentInfo{};
 		presentInfo.waitSemaphoreCount = 1;
@@ -431,7 +717,16 @@ int main()
 
 		_currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 		char newTitle[256];
-		snprintf(newTitle, sizeof(newTitle), "CV --- CPU time: %.2fms", frameDelta * 1000);
+		if (MESH_SHADING || !_gpuCulling)
+			snprintf(newTitle, sizeof(newTitle), "CV --- CPU time: %.2fms --- culled %u/%u instances", frameDelta * 1000,
+			         mod1._instanceBounds.count - _visibleInstances, mod1._instanceBounds.count);
+		else
+			snprintf(newTitle, sizeof(newTitle), "CV --- CPU time: %.2fms --- %u instances submitted to GPU culling", frameDelta * 1000,
+			         mod1._instanceBounds.count);
 		glfwSetWindowTitle(_window, newTitle);
 	}
+
+	// the model and frame contexts queue their resources on the way out, ~ResourceManager then flushes the queue
+	renderer->_device.waitIdle();
+	_pipelineManager->SavePipelineCache();
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "renderer.h"
 #include "Log.h"
 #include "vk_utils.h"
+#include "DeletionQueue.h"
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -90,6 +91,19 @@ namespace CV
     {
     }
 
+    // out of line for the unique_ptr of the forward declared DeletionQueue. Runs when main's reference goes, the last
+    // one: the resource manager and model hold the renderer too, so everything that allocated from these pools (upload
+    // batches) is gone by now. Nothing below them may hold it in a cycle (the PipelineManager only has a raw pointer)
+    Renderer::~Renderer()
+    {
+        if (!_device)
+            return;
+        _device.waitIdle();
+        _device.destroyCommandPool(_transferCommandPool);
+        _device.destroyCommandPool(_commandPool);
+        printl(Log::LogLevel::Info, "[VULKAN] Command pools destroyed");
+    }
+
     void Renderer::InitVulkan()
     {
         CreateInstance();
@@ -171,17 +185,19 @@ namespace CV
         QueueFamilyIndices indices = FindQueueFamilies(_physicalDevice, surface);
 
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-        std::set uniqueQueueFamilies = { indices._graphicsFamily.value(), indices._presentFamily.value() };
+        std::set uniqueQueueFamilies = { indices._graphicsFamily.value(), indices._presentFamily.value(), indices._transferFamily.value() };
 
         _queueFamily = indices._graphicsFamily.value();
+        _transferQueueFamily = indices._transferFamily.value();
 
-        float queuePriority = 1.0f;
+        // a second queue of the graphics family for uploads gets the lower priority
+        const float queuePriorities[] = { 1.0f, 0.5f };
         for (auto queueFamily : uniqueQueueFamilies)
         {
             vk::DeviceQueueCreateInfo queueCreateInfo{};
             queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfo.queueCount = queueFamily == _transferQueueFamily ? indices._transferQueueIndex + 1 : 1;
+            queueCreateInfo.pQueuePriorities = queuePriorities;
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
@@ -190,27 +206,34 @@ namespace CV
         drLocalRead.dynamicRenderingLocalRead = vk::True; */
 
         // mesh shading (optional)
-        vk::PhysicalDeviceMeshShaderFeaturesNV meshShaderFeatures{};
+        vk::PhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
         meshShaderFeatures.meshShader = vk::True;
 
-        //vk::PhysicalDeviceVulkan11Features vk11features;
-        //vk11features.shaderDrawParameters = vk::True;
-
-        // BDA and scalar layout
-        vk::PhysicalDeviceScalarBlockLayoutFeatures scalarFeatures{};
-        //scalarFeatures.pNext = &vk11features;
-        scalarFeatures.scalarBlockLayout = vk::True;
+        // SV_StartInstanceLocation, the GPU driven draws carry their instance in firstInstance
+        vk::PhysicalDeviceShaderDrawParametersFeatures drawParameters{};
+        drawParameters.shaderDrawParameters = vk::True;
 #if MESH_SHADING
-        scalarFeatures.pNext = &meshShaderFeatures;
+        drawParameters.pNext = &meshShaderFeatures;
 #endif
 
-        vk::PhysicalDeviceBufferDeviceAddressFeatures bdaFeatures{};
-        bdaFeatures.bufferDeviceAddress = vk::True;
-        bdaFeatures.bufferDeviceAddressCaptureReplay = vk::True;
-        bdaFeatures.pNext = &scalarFeatures;
+        // one struct for everything 1.2, it can't be chained next to the per feature structs it replaces
+        vk::PhysicalDeviceVulkan12Features vk12Features{};
+        vk12Features.pNext = &drawParameters;
+        // BDA and scalar layout
+        vk12Features.scalarBlockLayout = vk::True;
+        vk12Features.bufferDeviceAddress = vk::True;
+        vk12Features.bufferDeviceAddressCaptureReplay = vk::True;
+        // bindless
+        vk12Features.shaderSampledImageArrayNonUniformIndexing = vk::True;
+        vk12Features.descriptorBindingPartiallyBound = vk::True;
+        vk12Features.runtimeDescriptorArray = vk::True;
+        vk12Features.descriptorBindingVariableDescriptorCount = vk::True;
+        vk12Features.descriptorBindingSampledImageUpdateAfterBind = vk::True;
+        // GPU culling writes the draw count
+        vk12Features.drawIndirectCount = vk::True;
 
 #if MESH_SHADING
-        vk::PhysicalDeviceMeshShaderPropertiesNV meshShaderProperties{};
+        vk::PhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
 
         vk::PhysicalDeviceProperties2 props{};
         props.pNext = &meshShaderProperties;
@@ -218,19 +241,9 @@ namespace CV
         _physicalDevice.getProperties2(&props);
 #endif
 
-        // bindless
-        vk::PhysicalDeviceDescriptorIndexingFeatures bindless{};
-        // bindless.pNext = &drLocalRead;
-        bindless.pNext = &bdaFeatures;
-        bindless.shaderSampledImageArrayNonUniformIndexing = vk::True;
-        bindless.descriptorBindingPartiallyBound = vk::True;
-        bindless.runtimeDescriptorArray = vk::True;
-        bindless.descriptorBindingVariableDescriptorCount = vk::True;
-        bindless.descriptorBindingSampledImageUpdateAfterBind = vk::True;
-
         // dynamic rendering
         vk::PhysicalDeviceVulkan13Features enabledFeatures;
-        enabledFeatures.pNext = &bindless;
+        enabledFeatures.pNext = &vk12Features;
         enabledFeatures.synchronization2 = vk::True;
         enabledFeatures.dynamicRendering = vk::True;
 
@@ -238,6 +251,11 @@ namespace CV
         deviceFeatures.samplerAnisotropy = vk::True;
         deviceFeatures.fragmentStoresAndAtomics = vk::True;
         deviceFeatures.shaderInt64 = vk::True;
+        // GPU driven draws, firstInstance is the instance index
+        deviceFeatures.multiDrawIndirect = vk::True;
+        deviceFeatures.drawIndirectFirstInstance = vk::True;
+        // cooked .ktx2 textures, without it they fall back to the white texture
+        deviceFeatures.textureCompressionBC = _physicalDevice.getFeatures().textureCompressionBC;
 
         vk::DeviceCreateInfo createInfo{};
     	createInfo.pNext = &enabledFeatures;
@@ -270,14 +288,24 @@ namespace CV
 
         _graphicsQueue = _device.getQueue(indices._graphicsFamily.value(), 0);
         _presentQueue = _device.getQueue(indices._presentFamily.value(), 0);
+        _transferQueue = _device.getQueue(_transferQueueFamily, indices._transferQueueIndex);
+
+        if (_transferQueue == _graphicsQueue)
+            printl(Log::LogLevel::Info, "[VULKAN] No separate transfer queue, uploads share the graphics queue");
+        else
+            printl(Log::LogLevel::Info, "[VULKAN] Transfer queue: family {}, index {}{}", _transferQueueFamily, indices._transferQueueIndex,
+                _transferQueueFamily == _queueFamily ? " (graphics family)" : "");
 
         VULKAN_HPP_DEFAULT_DISPATCHER.init(_device);
+
+        _deletionQueue = std::make_unique<DeletionQueue>(_device, MAX_FRAMES_IN_FLIGHT);
     }
 
     void Renderer::CreateCommandPool(vk::SurfaceKHR surface)
     {
         QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(_physicalDevice, surface);
 
+        // one off work on the graphics queue (upload batches, ownership acquires). Frames record from their FrameContext
         vk::CommandPoolCreateInfo poolInfo{};
         poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
         poolInfo.queueFamilyIndex = queueFamilyIndices._graphicsFamily.value();
@@ -292,6 +320,20 @@ namespace CV
         {
             printl(Log::LogLevel::Error,"[VULKAN] Command Pool creation Failure: {}", std::string(err.what()));
         }
+
+        // upload batches record on the transfer queue, short lived and reset every submit
+        vk::CommandPoolCreateInfo transferPoolInfo{};
+        transferPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+        transferPoolInfo.queueFamilyIndex = _transferQueueFamily;
+
+        try
+        {
+            _transferCommandPool = _device.createCommandPool(transferPoolInfo);
+        }
+        catch (vk::SystemError& err)
+        {
+            printl(Log::LogLevel::Error,"[VULKAN] Transfer Command Pool creation Failure: {}", std::string(err.what()));
+        }
     }
 
     void Renderer::CreateDepthResources()
@@ -387,30 +429,9 @@ namespace CV
     //    CreateImageView();
     //}
 
-    void Renderer::CreateCommandBuffer(std::vector<vk::CommandBuffer>& cmdBuffers, size_t count) const
+    void Renderer::CreateSynObjects(std::vector<vk::Semaphore>& renderFinishedSem)
     {
-        cmdBuffers.resize(count * MAX_FRAMES_IN_FLIGHT);
-
-        vk::CommandBufferAllocateInfo allocInfo;
-        allocInfo.commandPool = _commandPool;
-        allocInfo.level = vk::CommandBufferLevel::ePrimary;
-        allocInfo.commandBufferCount = static_cast<uint32_t>(cmdBuffers.size());
-
-        try
-        {
-            cmdBuffers = _device.allocateCommandBuffers(allocInfo);
-            printl(Log::LogLevel::Info,"[VULKAN] Command Buffer creation Success");
-        }
-        catch (const vk::SystemError& err)
-        {
-            printl(Log::LogLevel::Error,"[VULKAN] Command Buffer creation Failure: {} ", std::string(err.what()));
-            throw;
-        }
-    }
-
-    void Renderer::CreateSynObjects(std::vector<vk::Semaphore>& imgAvailableSem, std::vector<vk::Semaphore>& renderFinishedSem, std::vector<vk::Fence>& inFlightFences)
-    {
-        imgAvailableSem.resize(MAX_FRAMES_IN_FLIGHT);
+        // the per frame in flight fence and image available semaphore are owned by the FrameContexts
         // only renderFinishedSem is resized to swapchain images size because it is used in two queues, it is signalled from graphics queue
         // when render is finished, and waited by present queue. If we index it with current frame parameter which is just cpu side fence parameter
         // it wont work. In the cpu code the current frame parameter is changed in the end of the loop, and its asynchronous to the gpu rendering and
@@ -418,29 +439,9 @@ namespace CV
         // var was used to index into the renderFinishedSem, so its possible (and highly likely for gpu driven work, where cpu is more idle than the gpu)
         // for it to index into the wrong semaphore, and signal an already signalled semaphore.
         renderFinishedSem.resize(_swapChainImages.size());
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
         vk::SemaphoreCreateInfo semaphoreCI{};
 
-        vk::FenceCreateInfo fenceCI{};
-        fenceCI.flags = vk::FenceCreateFlagBits::eSignaled;
-
-        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        {
-
-        	try
-            {
-                imgAvailableSem[i] = _device.createSemaphore(semaphoreCI);
-                inFlightFences[i] = _device.createFence(fenceCI);
-
-                printl(Log::LogLevel::Info,"[VULKAN] Fence/Semaphore creation Success for frame {} ", std::to_string(i));
-            }
-            catch (const vk::SystemError& err)
-            {
-                printl(Log::LogLevel::Error,"[VULKAN] Fence/Semaphore creation Failure for frame {}, error: {}", std::to_string(i), std::string(err.what()));
-                throw;
-            }
-        }
         for (int i = 0; i < _swapChainImages.size(); i++)
         {
 
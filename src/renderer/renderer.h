@@ -7,6 +7,7 @@
 namespace CV
 {
     class Texture;
+    class DeletionQueue;
     enum class Buffer
     {
         VERTEX,
@@ -17,7 +18,7 @@ namespace CV
     {
     public:
         Renderer();
-        ~Renderer() = default;
+        ~Renderer();
         void InitVulkan();
         void CreateSwapChain(vk::SurfaceKHR surface, GLFWwindow* window);
         // Vulkan base setup
@@ -27,10 +28,8 @@ namespace CV
         void CreateCommandPool(vk::SurfaceKHR surface);
         void CreateDepthResources();
         // void RecreateSwapChain(); // TODO
-        // drawing stuff
-        void CreateCommandBuffer(std::vector<vk::CommandBuffer>& cmdBuffers, size_t count) const;
-        // fence stuff
-        void CreateSynObjects(std::vector<vk::Semaphore>& imgAvailableSem, std::vector<vk::Semaphore>& renderFinishedSem, std::vector<vk::Fence>& inFlightFences);
+        // fence stuff. Render finished semaphores, one per swapchain image
+        void CreateSynObjects(std::vector<vk::Semaphore>& renderFinishedSem);
         void populateDebugMessengerCreateInfo(vk::DebugUtilsMessengerCreateInfoEXT& createInfo);
         void SetupDebugMessenger();
     public:
@@ -40,6 +39,9 @@ namespace CV
         u32 _queueFamily{};
         vk::Queue _graphicsQueue;
         vk::Queue _presentQueue;
+        // uploads (see UploadBatch). Can be the graphics queue itself on devices with a single queue
+        u32 _transferQueueFamily{};
+        vk::Queue _transferQueue;
         vk::SwapchainKHR _swapChain;
         vk::Format _swapChainImageFormat;
         vk::Extent2D _swapChainExtent;
@@ -50,12 +52,12 @@ namespace CV
         vk::DeviceMemory _depthImageMemory;
         vk::ImageView _depthImageView;
         vk::Format _depthImageFormat;
-        std::vector<vk::Buffer> _uniformBuffers{};
-        std::vector<vk::DeviceMemory> _uniformBufferMemory{};
-        std::vector<void*> _uniformBufferMapped{};
         // issue commands
         vk::CommandPool _commandPool;
+        vk::CommandPool _transferCommandPool;
         std::vector<vk::CommandBuffer> _commandBuffer;
+        // resources a frame in flight may still use go here instead of being destroyed (see DeletionQueue)
+        std::unique_ptr<DeletionQueue> _deletionQueue;
         // sync primitives
         vk::DebugUtilsMessengerEXT _debugMessenger;
 
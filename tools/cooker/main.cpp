@@ -0,0 +1,39 @@
+#include <pch.h>
+
+#include <cstring>
+
+#include "TextureCooker.h"
+
+// offline texture cooker: cravillac_cooker [--force] <model.gltf>...
+// writes a block compressed .ktx2 next to every image the models' materials use, see TextureCooker.h
+
+int main(int argc, char** argv)
+{
+	using Log = CV::Log;
+	Log::Init();
+
+	bool force = false;
+	std::vector<std::string> models;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--force") == 0)
+			force = true;
+		else
+			models.emplace_back(argv[i]);
+	}
+
+	if (models.empty())
+	{
+		printl(Log::LogLevel::Error, "[COOKER] usage: {} [--force] <model.gltf>...", argv[0]);
+		Log::Shutdown();
+		return 1;
+	}
+
+	u32 cooked = 0;
+	for (const auto& model : models)
+		cooked += CV::CookModelTextures(model, force);
+
+	printl(Log::LogLevel::Info, "[COOKER] Done, {} textures written", cooked);
+	Log::Shutdown();
+	return 0;
+}
@@ -54,4 +54,10 @@ target("game")
     add_files("src/*.cpp")
     add_headerfiles("src/*.h")
     add_deps("engine")
+target_end()
+
+target("cooker")
+    set_kind("binary")
+    add_files("tools/cooker/*.cpp")
+    add_deps("engine")
 target_end()
\ No newline at end of file